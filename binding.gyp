@@ -1,61 +1,131 @@
 {
+  "variables": {
+    "with_bench%": 0,
+    "with_opencl%": 0
+  },
+  "target_defaults": {
+    "cflags": ["-Wall", "-Wextra", "-O2"],
+    "conditions": [
+      ["OS=='win'", {
+        "conditions": [
+          [
+            "target_arch=='x64'", {
+              "variables": {
+                "openssl_root%": "C:/OpenSSL-Win64"
+              },
+            }, {
+              "variables": {
+                "openssl_root%": "C:/OpenSSL-Win32"
+              }
+            }
+          ]
+        ],
+        "libraries": [
+          "-l<(openssl_root)/lib/libeay32.lib",
+        ],
+        "include_dirs": [
+          "<(openssl_root)/include",
+        ],
+      }, {
+        "conditions": [
+          [
+            "target_arch=='ia32'", {
+              "variables": {
+                "openssl_config_path": "<(nodedir)/deps/openssl/config/piii"
+              }
+            }
+          ],
+          [
+            "target_arch=='x64'", {
+              "variables": {
+                "openssl_config_path": "<(nodedir)/deps/openssl/config/k8"
+              },
+            }
+          ],
+          [
+            "target_arch=='arm'", {
+              "variables": {
+                "openssl_config_path": "<(nodedir)/deps/openssl/config/arm"
+              }
+            }
+          ],
+        ],
+        "include_dirs": [
+          "<(nodedir)/deps/openssl/openssl/include",
+          "<(openssl_config_path)"
+        ]
+      }
+    ]]
+  },
   "targets": [
     {
       "target_name": "worker",
       "include_dirs": ["<!(node -e \"require('nan')\")"],
-      "cflags": ["-Wall", "-Wextra", "-O2"],
-      "sources": ["src/worker.cc", "src/pow.cc"],
+      "sources": [
+        "src/worker.cc",
+        "src/addrgen.cc",
+        "src/codecs.cc",
+        "src/decrypt.cc",
+        "src/framer.cc",
+        "src/inventory.cc",
+        "src/pow.cc",
+        "src/sha512.cc",
+        "src/store.cc",
+        "src/topology.cc",
+        "src/verify.cc",
+      ],
       "conditions": [
-        ["OS=='win'", {
-          "conditions": [
-            [
-              "target_arch=='x64'", {
-                "variables": {
-                  "openssl_root%": "C:/OpenSSL-Win64"
-                },
-              }, {
-                "variables": {
-                  "openssl_root%": "C:/OpenSSL-Win32"
-                }
-              }
-            ]
-          ],
-          "libraries": [
-            "-l<(openssl_root)/lib/libeay32.lib",
-          ],
-          "include_dirs": [
-            "<(openssl_root)/include",
+        ["OS=='linux'", {
+          "libraries": ["-ldl"]
+        }]
+      ]
+    }
+  ],
+  "conditions": [
+    # Standalone benchmark. It can't use OpenSSL symbols exported by
+    # node binary so it's linked against system library and not built
+    # by default. Use `npm run bench` to build and run it.
+    ["with_bench==1", {
+      "targets": [
+        {
+          "target_name": "bitmessage-bench",
+          "type": "executable",
+          "sources": [
+            "src/bench.cc",
+            "src/pow.cc",
+            "src/sha512.cc",
+            "src/topology.cc",
           ],
-        }, {
           "conditions": [
-            [
-              "target_arch=='ia32'", {
-                "variables": {
-                  "openssl_config_path": "<(nodedir)/deps/openssl/config/piii"
-                }
-              }
-            ],
-            [
-              "target_arch=='x64'", {
-                "variables": {
-                  "openssl_config_path": "<(nodedir)/deps/openssl/config/k8"
-                },
-              }
-            ],
-            [
-              "target_arch=='arm'", {
-                "variables": {
-                  "openssl_config_path": "<(nodedir)/deps/openssl/config/arm"
-                }
-              }
-            ],
+            ["OS!='win'", {
+              "libraries": ["-lcrypto", "-lpthread"]
+            }]
+          ]
+        }
+      ]
+    }],
+    # OpenCL POW devices. Module is loaded by worker at runtime so
+    # addon still works on systems without OpenCL runtime. Use `npm run
+    # opencl` to build it.
+    ["with_opencl==1", {
+      "targets": [
+        {
+          "target_name": "bitmessage-opencl",
+          "type": "loadable_module",
+          "product_prefix": "",
+          "product_extension": "node",
+          "sources": [
+            "src/opencl.cc",
           ],
-          "include_dirs": [
-            "<(nodedir)/deps/openssl/openssl/include",
-            "<(openssl_config_path)"
+          "conditions": [
+            ["OS=='mac'", {
+              "libraries": ["-framework OpenCL"]
+            }, {
+              "libraries": ["-lOpenCL"]
+            }]
           ]
         }
-      ]]
-    }
+      ]
+    }]
   ]
 }
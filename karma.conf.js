@@ -14,7 +14,17 @@ module.exports = function(config) {
 
 
     // list of files / patterns to load in the browser
-    files: ["test.js"],
+    files: [
+      "test.js",
+      // WebAssembly POW kernel, if built with `npm run wasm`.
+      {pattern: "build/bitmessage-pow.wasm", included: false, served: true},
+    ],
+
+
+    // WebAssembly POW kernel is fetched relative to the page by default
+    proxies: {
+      "/bitmessage-pow.wasm": "/base/build/bitmessage-pow.wasm",
+    },
 
 
     // preprocess matching files before serving them to the browser
@@ -1,6 +1,8 @@
 // NOTE(Kagami): End-users shouldn't import this module. While it
 // exports some helper routines, its API is _not_ stable.
 
+/* global BigInt */
+
 "use strict";
 
 var assert = exports.assert = function(condition, message) {
@@ -11,6 +13,18 @@ var assert = exports.assert = function(condition, message) {
 
 exports.PROTOCOL_VERSION = 3;
 
+// Error used to reject promises of cancelled POWs.
+function PowCancelError(message) {
+  this.name = "PowCancelError";
+  this.message = message || "POW cancelled";
+  if (Error.captureStackTrace) {
+    Error.captureStackTrace(this, PowCancelError);
+  }
+}
+PowCancelError.prototype = Object.create(Error.prototype);
+PowCancelError.prototype.constructor = PowCancelError;
+exports.PowCancelError = PowCancelError;
+
 // Missing methods to read/write 64 bits integers from/to buffers.
 // TODO(Kagami): Use this helpers in structs, pow, platform.
 
@@ -57,6 +71,66 @@ function writeUInt64BE(buf, value, offset, noAssert) {
 }
 exports.writeUInt64BE = writeUInt64BE;
 
+// POW targets may exceed 2^53, such values are represented as BigInt if
+// it's supported or as 8-byte big-endian Buffer otherwise.
+
+// Convert 64-bit unsigned value given in any of these forms to Buffer.
+exports.toUInt64Buffer = function(value) {
+  if (Buffer.isBuffer(value)) {
+    assert(value.length === 8, "Bad 64-bit buffer");
+    return value;
+  }
+  if (typeof value === "number") {
+    assert(value >= 0, "Bad 64-bit integer");
+    return writeUInt64BE(null, value);
+  }
+  // BigInt.
+  var hex = value.toString(16);
+  assert(value >= 0 && hex.length <= 16, "Bad 64-bit integer");
+  return new Buffer("0000000000000000".slice(hex.length) + hex, "hex");
+};
+
+// Convert hex string of 64-bit unsigned value to number if it's safe,
+// otherwise to BigInt or Buffer.
+exports.fromUInt64Hex = function(hex) {
+  assert(hex.length <= 16, "Bad 64-bit integer");
+  var value = parseInt(hex, 16);
+  if (value <= MAX_SAFE_INTEGER) {
+    return value;
+  }
+  hex = "0000000000000000".slice(hex.length) + hex;
+  if (typeof BigInt === "function") {
+    return BigInt("0x" + hex);
+  }
+  return new Buffer(hex, "hex");
+};
+
+// Nonces may be returned as number, which limits the search to 2^53, or
+// as BigInt/Buffer in which case the whole 64-bit space is searched.
+// Codes are the same as in native module.
+var NONCE_TYPES = {number: 0, bigint: 1, buffer: 2};
+
+exports.getNonceType = function(type) {
+  if (type == null) {
+    return NONCE_TYPES.number;
+  }
+  assert(NONCE_TYPES.hasOwnProperty(type), "Bad nonce type");
+  assert(type !== "bigint" || typeof BigInt === "function",
+         "BigInt is not supported");
+  return NONCE_TYPES[type];
+};
+
+// Convert safe integer nonce to the requested type.
+exports.convertNonce = function(nonce, type) {
+  if (type === "bigint") {
+    return BigInt(nonce);
+  } else if (type === "buffer") {
+    return writeUInt64BE(null, nonce);
+  } else {
+    return nonce;
+  }
+};
+
 exports.writeTime64BE = function(buf, time, offset, noAssert) {
   var timestamp = Math.floor(time.getTime() / 1000);
   return writeUInt64BE(buf, timestamp, offset, noAssert);
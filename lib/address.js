@@ -25,6 +25,7 @@ var assert = require("./_util").assert;
 var var_int = require("./structs").var_int;
 var PubkeyBitfield = require("./structs").PubkeyBitfield;
 var bmcrypto = require("./crypto");
+var platform = require("./platform");
 var popkey = require("./_util").popkey;
 
 /**
@@ -233,6 +234,15 @@ function checkripelen(ripelen, version) {
   }
 }
 
+// Minimal ripe length allowed for the given version.
+function minripelen(version) {
+  var ripelen = 1;
+  while (!checkripelen(ripelen, version)) {
+    ripelen++;
+  }
+  return ripelen;
+}
+
 /**
  * Encode Bitmessage address object into address string.
  * @return {string} Address string.
@@ -265,7 +275,7 @@ Address.fromRandom = function(opts) {
   assertripelen(ripelen, version);
 
   // TODO(Kagami): Speed it up using web workers in Browser.
-  // TODO(Kagami): Bind to C++ version of this code in Node.
+  // NOTE(Kagami): See `fromRandomAsync` for the native version.
   var encPrivateKey, encPublicKey, ripe, len;
   var signPrivateKey = bmcrypto.getPrivate();
   var signPublicKey = bmcrypto.getPublic(signPrivateKey);
@@ -308,7 +318,7 @@ Address.fromPassphrase = function(opts) {
   var passphrase = popkey(opts, "passphrase");
 
   // TODO(Kagami): Speed it up using web workers in Browser.
-  // TODO(Kagami): Bind to C++ version of this code in Node.
+  // NOTE(Kagami): See `fromPassphraseAsync` for the native version.
   var signPrivateKey, signPublicKey, encPrivateKey, encPublicKey;
   var ripe, len, tmp;
   var signnonce = 0;
@@ -341,6 +351,95 @@ Address.fromPassphrase = function(opts) {
   }
 };
 
+// Search keys on the native pool if platform supports it, otherwise run
+// the synchronous version.
+function searchkeysAsync(opts, search, fallback) {
+  var PPromise = platform.Promise;
+  var addrp;
+  if (!platform.searchKeys) {
+    addrp = new PPromise(function(resolve) {
+      resolve(fallback());
+    });
+    addrp.cancel = function() {};
+    return addrp;
+  }
+  var keysp = platform.searchKeys(search);
+  addrp = keysp.then(function(keys) {
+    opts.signPrivateKey = keys.signPrivateKey;
+    opts.encPrivateKey = keys.encPrivateKey;
+    return new Address(opts);
+  });
+  addrp.cancel = keysp.cancel;
+  addrp.getStats = keysp.getStats;
+  return addrp;
+}
+
+/**
+ * The same as [fromRandom]{@link module:bitmessage/address.fromRandom}
+ * but doesn't block. In Node keys are searched by the native POW pool
+ * threads ahead of any running POW.
+ * @param {Object=} opts - Address options, see `fromRandom`
+ * @param {number=} opts.poolSize - Number of threads to use (number of
+ * cores by default)
+ * @return {Promise.<Address>} A promise that contains new address object
+ * when fulfilled. It has `cancel` method to stop the search and
+ * `getStats` to get its progress in Node.
+ */
+Address.fromRandomAsync = function(opts) {
+  opts = objectAssign({}, opts);
+  var version = opts.version = opts.version || 4;
+  var ripelen = popkey(opts, "ripeLength") || 19;
+  assertripelen(ripelen, version);
+  var poolSize = popkey(opts, "poolSize");
+  var search = {
+    minLength: minripelen(version),
+    maxLength: ripelen,
+    poolSize: poolSize,
+  };
+  return searchkeysAsync(opts, search, function() {
+    opts.ripeLength = ripelen;
+    return Address.fromRandom(opts);
+  });
+};
+
+/**
+ * The same as [fromPassphrase]{@link
+ * module:bitmessage/address.fromPassphrase} but doesn't block. In Node
+ * keys are searched by the native POW pool threads ahead of any
+ * running POW, the resulting address is the same.
+ * @param {(string|Object)} opts - Passphrase or address options, see
+ * `fromPassphrase`
+ * @param {number=} opts.poolSize - Number of threads to use (number of
+ * cores by default)
+ * @return {Promise.<Address>} A promise that contains new address object
+ * when fulfilled. It has `cancel` method to stop the search and
+ * `getStats` to get its progress in Node.
+ */
+Address.fromPassphraseAsync = function(opts) {
+  if (typeof opts === "string") {
+    opts = {passphrase: opts};
+  } else {
+    opts = objectAssign({}, opts);
+  }
+  var version = opts.version = opts.version || 4;
+  var ripelen = popkey(opts, "ripeLength") || 19;
+  assertripelen(ripelen, version);
+  var passphrase = popkey(opts, "passphrase");
+  var poolSize = popkey(opts, "poolSize");
+  var search = {
+    // XXX(Kagami): Spec doesn't mention encoding, using UTF-8.
+    passphrase: new Buffer(passphrase, "utf8"),
+    minLength: minripelen(version),
+    maxLength: ripelen,
+    poolSize: poolSize,
+  };
+  return searchkeysAsync(opts, search, function() {
+    opts.ripeLength = ripelen;
+    opts.passphrase = passphrase;
+    return Address.fromPassphrase(opts);
+  });
+};
+
 Object.defineProperty(Address.prototype, "signPrivateKey", {
   get: function() {
     return this._signPrivateKey;
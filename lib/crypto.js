@@ -81,6 +81,40 @@ exports.sign = function(privateKey, msg) {
   return eccrypto.sign(privateKey, hash);
 };
 
+// Signatures requested during one event loop turn, e.g. by decoding of
+// many received objects, are verified as one native batch.
+var pendingVerifies = null;
+
+function flushVerifies() {
+  var pending = pendingVerifies;
+  pendingVerifies = null;
+  exports.verifyBatch(
+    pending.map(function(item) { return item.publicKey; }),
+    pending.map(function(item) { return item.msg; }),
+    pending.map(function(item) { return item.sig; })
+  ).then(function(bitmap) {
+    pending.forEach(function(item, i) {
+      if (isValid(bitmap, i)) {
+        item.resolve(null);
+      } else {
+        item.reject(new Error("Bad signature"));
+      }
+    });
+  }, function(err) {
+    pending.forEach(function(item) {
+      item.reject(err);
+    });
+  });
+}
+
+function isValid(bitmap, i) {
+  return Math.floor(bitmap[Math.floor(i / 8)] / Math.pow(2, i % 8)) % 2 === 1;
+}
+
+function setValid(bitmap, i) {
+  bitmap[Math.floor(i / 8)] += Math.pow(2, i % 8);
+}
+
 /**
  * Verify signature using ecdsa-with-sha1 scheme.
  * @param {Buffer} publicKey - A 65-byte public key
@@ -90,8 +124,56 @@ exports.sign = function(privateKey, msg) {
  * and rejects on bad key or signature.
  */
 exports.verify = function(publicKey, msg, sig) {
-  var hash = sha1(msg);
-  return eccrypto.verify(publicKey, hash, sig);
+  if (!platform.verifyBatch) {
+    return eccrypto.verify(publicKey, sha1(msg), sig);
+  }
+  return new PPromise(function(resolve, reject) {
+    if (!pendingVerifies) {
+      pendingVerifies = [];
+      setImmediate(flushVerifies);
+    }
+    pendingVerifies.push({
+      publicKey: publicKey,
+      msg: msg,
+      sig: sig,
+      resolve: resolve,
+      reject: reject,
+    });
+  });
+};
+
+/**
+ * Verify many ecdsa-with-sha1 signatures at once. Native implementation
+ * checks them in parallel on the POW thread pool. It follows OpenSSL
+ * (and PyBitmessage) which also accepts signatures with high S value.
+ * @param {Buffer[]} publicKeys - 65-byte public keys
+ * @param {Buffer[]} msgs - Messages being verified
+ * @param {Buffer[]} sigs - Signatures in DER format
+ * @param {Object=} opts - Verification options
+ * @param {number=} opts.poolSize - Number of threads to use (native
+ * only)
+ * @return {Promise.<Buffer>} A promise that contains bitmap with bit
+ * `i % 8` of byte `i / 8` set for every correct signature.
+ */
+exports.verifyBatch = function(publicKeys, msgs, sigs, opts) {
+  assert(msgs.length === publicKeys.length, "Bad messages");
+  assert(sigs.length === publicKeys.length, "Bad signatures");
+  var bitmap = new Buffer(Math.ceil(publicKeys.length / 8));
+  bitmap.fill(0);
+  if (!publicKeys.length) {
+    return PPromise.resolve(bitmap);
+  }
+  // Native worker may be unavailable.
+  if (!platform.verifyBatch) {
+    return PPromise.all(publicKeys.map(function(publicKey, i) {
+      return eccrypto.verify(publicKey, sha1(msgs[i]), sigs[i]).then(
+        function() { setValid(bitmap, i); },
+        function() {});
+    })).then(function() {
+      return bitmap;
+    });
+  }
+  return platform.verifyBatch(publicKeys, msgs, sigs, opts);
 };
 
 var SECP256K1_TYPE = 714;
@@ -174,3 +256,37 @@ exports.decrypt = function(privateKey, buf) {
     resolve(eccrypto.decrypt(privateKey, encObj));
   });
 };
+
+/**
+ * Try to decrypt message with every of the given private keys. Native
+ * implementation checks keys in parallel on the POW thread pool.
+ * @param {Buffer[]} privateKeys - 32-byte private keys of potential
+ * recipients
+ * @param {Buffer} buf - Encrypted data
+ * @param {Object=} opts - Decryption options
+ * @param {number=} opts.poolSize - Number of threads to use (native
+ * only)
+ * @return {Promise.<Object>} A promise that resolves with `{index,
+ * plaintext}` of the first matching key and rejects if none of the keys
+ * match.
+ */
+exports.decryptBatch = function(privateKeys, buf, opts) {
+  function inner(i) {
+    if (i >= privateKeys.length) {
+      return PPromise.reject(new Error("Failed to decrypt"));
+    }
+    return exports.decrypt(privateKeys[i], buf).then(function(plaintext) {
+      return {index: i, plaintext: plaintext};
+    }).catch(function() {
+      return inner(i + 1);
+    });
+  }
+
+  // Native worker may be unavailable.
+  if (!platform.decryptBatch || !privateKeys.length) {
+    return inner(0);
+  }
+  return platform.decryptBatch(privateKeys, buf, opts).catch(function() {
+    throw new Error("Failed to decrypt");
+  });
+};
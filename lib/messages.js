@@ -37,6 +37,7 @@ var bufferEqual = require("buffer-equal");
 var assert = require("./_util").assert;
 var structs = require("./structs");
 var bmcrypto = require("./crypto");
+var platform = require("./platform");
 var UserAgent = require("./user-agent");
 var util = require("./_util");
 
@@ -309,6 +310,35 @@ var addr = exports.addr = {
    * The same as [decode]{@link module:bitmessage/messages.addr.decode}.
    */
   decodePayload: function(buf) {
+    var packed = addr.decodePayloadPacked(buf);
+    var addrs = new Array(packed.count);
+    for (var i = 0; i < packed.count; i++) {
+      var addrBuf = packed.entries.slice(i*38, (i+1)*38);
+      addrs[i] = structs.net_addr.decode(addrBuf);
+    }
+    return {
+      addrs: addrs,
+      length: packed.length,
+    };
+  },
+
+  /**
+   * @typedef {Object} DecodePackedResult
+   * @property {number} count - Number of entries with public IPs
+   * @property {Buffer} entries - These entries packed, every one is
+   * 38-byte [net_addr]{@link module:bitmessage/structs.net_addr}
+   * @property {number} length - Real data length
+   * @memberof module:bitmessage/messages.addr
+   */
+
+  /**
+   * Decode `addr` message payload without creating per-entry objects.
+   * Private IPs are filtered natively in Node.
+   * @param {Buffer} buf - Message payload
+   * @return {DecodePackedResult}
+   * [Decoded entries.]{@link module:bitmessage/messages.addr.DecodePackedResult}
+   */
+  decodePayloadPacked: function(buf) {
     var decoded = structs.var_int.decode(buf);
     var listLength = decoded.value;
     // NOTE(Kagami): Check length before filtering private IPs because
@@ -316,17 +346,22 @@ var addr = exports.addr = {
     assert(listLength <= 1000, "Too many address entires");
     var length = decoded.length + listLength * 38;
     assert(buf.length >= length, "Buffer is too small");
-    var rest = decoded.rest;
-    var addrs = [];
-    var addrBuf;
-    for (var i = 0; i < listLength; i++) {
-      addrBuf = rest.slice(i*38, (i+1)*38);
-      if (!isPrivateIp(addrBuf.slice(20, 36))) {
-        addrs.push(structs.net_addr.decode(addrBuf));
+    var entries = decoded.rest.slice(0, listLength * 38);
+    if (platform.addrFilter) {
+      entries = platform.addrFilter(entries);
+    } else {
+      var kept = [];
+      for (var i = 0; i < listLength; i++) {
+        var addrBuf = entries.slice(i*38, (i+1)*38);
+        if (!isPrivateIp(addrBuf.slice(20, 36))) {
+          kept.push(addrBuf);
+        }
       }
+      entries = Buffer.concat(kept);
     }
     return {
-      addrs: addrs,
+      count: entries.length / 38,
+      entries: entries,
       // Real data length.
       length: length,
     };
@@ -406,10 +441,40 @@ var inv = exports.inv = {
     };
   },
 
+  /**
+   * @typedef {Object} DecodePackedResult
+   * @property {number} count - Number of vectors
+   * @property {Buffer} vectors - Packed 32-byte vectors
+   * @property {number} length - Real data length
+   * @memberof module:bitmessage/messages.inv
+   */
+
+  /**
+   * Decode `inv` message payload without splitting vectors into
+   * separate buffers, e.g. for
+   * [inv_vect.Set]{@link module:bitmessage/structs.inv_vect.Set}.  
+   * NOTE: `vectors` references input buffer.
+   * @param {Buffer} buf - Message payload
+   * @return {DecodePackedResult}
+   * [Decoded vectors.]{@link module:bitmessage/messages.inv.DecodePackedResult}
+   */
+  decodePayloadPacked: function(buf) {
+    var decoded = structs.var_int.decode(buf);
+    var listLength = decoded.value;
+    assert(listLength <= 50000, "Too many vectors");
+    var length = decoded.length + listLength * 32;
+    assert(buf.length >= length, "Buffer is too small");
+    return {
+      count: listLength,
+      vectors: decoded.rest.slice(0, listLength * 32),
+      length: length,
+    };
+  },
+
   /**
    * Encode `inv` message.
-   * @param {Buffer[]} vectors - [Inventory vector]{@link
-   * module:bitmessage/structs.inv_vect} list
+   * @param {(Buffer[]|Buffer)} vectors - [Inventory vector]{@link
+   * module:bitmessage/structs.inv_vect} list or packed vectors
    * @return {Buffer} Encoded message.
    */
   encode: function(vectors) {
@@ -422,6 +487,13 @@ var inv = exports.inv = {
    * The same as [encode]{@link module:bitmessage/messages.inv.encode}.
    */
   encodePayload: function(vectors) {
+    if (Buffer.isBuffer(vectors)) {
+      // Packed vectors, e.g. result of `inv_vect.Set#diff`.
+      assert(vectors.length % 32 === 0, "Bad vectors length");
+      var count = vectors.length / 32;
+      assert(count <= 50000, "Too many vectors");
+      return Buffer.concat([structs.var_int.encode(count), vectors]);
+    }
     assert(vectors.length <= 50000, "Too many vectors");
     // TODO(Kagami): Validate vectors length.
     var bufs = [structs.var_int.encode(vectors.length)].concat(vectors);
@@ -467,8 +539,8 @@ exports.getdata = objectAssign({}, inv, {
 
   /**
    * Encode `getdata` message.
-   * @param {Buffer[]} vectors - [Inventory vector]{@link
-   * module:bitmessage/structs.inv_vect} list
+   * @param {(Buffer[]|Buffer)} vectors - [Inventory vector]{@link
+   * module:bitmessage/structs.inv_vect} list or packed vectors
    * @return {Buffer} Encoded message.
    * @memberof module:bitmessage/messages.getdata
    */
@@ -67,14 +67,9 @@ function prependNonce(obj, opts) {
     } else {
       opts.payloadLength = obj.length + 8;  // Compensate for nonce
       target = POW.getTarget(opts);
-      powp = POW.doAsync({target: target, data: obj})
+      powp = POW.doAsync({target: target, data: obj, nonceType: "buffer"})
         .then(function(nonce) {
-          // TODO(Kagami): We may want to receive nonce as a Buffer from
-          // POW module to skip conversion step.
-          var payload = new Buffer(opts.payloadLength);
-          util.writeUInt64BE(payload, nonce, 0, true);
-          obj.copy(payload, 8);
-          return payload;
+          return Buffer.concat([nonce, obj], opts.payloadLength);
         });
       resolve(powp);
     }
@@ -480,26 +475,17 @@ var pubkey = exports.pubkey = {
 
 // Try to decrypt message with all provided identities.
 function tryDecryptMsg(identities, buf) {
-  function inner(i) {
-    if (i > last) {
-      return PPromise.reject(
-        new Error("Failed to decrypt msg with given identities")
-      );
-    }
-    return bmcrypto
-      .decrypt(identities[i].encPrivateKey, buf)
-      .then(function(decrypted) {
-        return {addr: identities[i], decrypted: decrypted};
-      }).catch(function() {
-        return inner(i + 1);
-      });
-  }
-
   if (Address.isAddress(identities)) {
     identities = [identities];
   }
-  var last = identities.length - 1;
-  return inner(0);
+  var keys = identities.map(function(addr) {
+    return addr.encPrivateKey;
+  });
+  return bmcrypto.decryptBatch(keys, buf).then(function(result) {
+    return {addr: identities[result.index], decrypted: result.plaintext};
+  }).catch(function() {
+    throw new Error("Failed to decrypt msg with given identities");
+  });
 }
 
 // Encode message from the given options.
@@ -839,21 +825,6 @@ var DEFAULT_ENCODING = msg.TRIVIAL;
 
 // Try to decrypt broadcast v4 with all provided subscription objects.
 function tryDecryptBroadcastV4(subscriptions, buf) {
-  function inner(i) {
-    if (i > last) {
-      return PPromise.reject(
-        new Error("Failed to decrypt broadcast with given identities")
-      );
-    }
-    return bmcrypto
-      .decrypt(subscriptions[i].getBroadcastPrivateKey(), buf)
-      .then(function(decrypted) {
-        return {addr: subscriptions[i], decrypted: decrypted};
-      }).catch(function() {
-        return inner(i + 1);
-      });
-  }
-
   if (Address.isAddress(subscriptions)) {
     subscriptions = [subscriptions];
   } else if (!Array.isArray(subscriptions)) {
@@ -865,8 +836,14 @@ function tryDecryptBroadcastV4(subscriptions, buf) {
   subscriptions = subscriptions.filter(function(a) {
     return a.version < 4;
   });
-  var last = subscriptions.length - 1;
-  return inner(0);
+  var keys = subscriptions.map(function(addr) {
+    return addr.getBroadcastPrivateKey();
+  });
+  return bmcrypto.decryptBatch(keys, buf).then(function(result) {
+    return {addr: subscriptions[result.index], decrypted: result.plaintext};
+  }).catch(function() {
+    throw new Error("Failed to decrypt broadcast with given identities");
+  });
 }
 
 /**
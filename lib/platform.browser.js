@@ -15,7 +15,9 @@ var hash = require("hash.js");
 var Sha512 = require("sha.js/sha512");
 var BN = require("bn.js");
 var work = require("webworkify");
-var assert = require("./_util").assert;
+var util = require("./_util");
+var assert = util.assert;
+var PowCancelError = util.PowCancelError;
 
 var cryptoObj = window.crypto || window.msCrypto;
 
@@ -50,13 +52,65 @@ exports.getTarget = function(opts) {
   denominator.iaddn(65536);
   denominator.imul(length);
   denominator.imul(new BN(opts.nonceTrialsPerByte));
-  var target = parseInt(B80.div(denominator).toString(16), 16);
-  assert(target <= 9007199254740991, "Unsafe target");
-  return target;
+  var target = B80.div(denominator).toString(16);
+  // Clamp to 64 bits the same way as native version does.
+  return util.fromUInt64Hex(target.length > 16 ? "ffffffffffffffff" : target);
+};
+
+// WebAssembly kernel built by `npm run wasm` is the default engine of
+// workers. It's fetched once relative to the page; if it's missing or
+// the browser lacks WebAssembly SIMD, workers use JS loop instead.
+var DEFAULT_WASM_SOURCE = "bitmessage-pow.wasm";
+var wasmSource = DEFAULT_WASM_SOURCE;
+var wasmModule = null;
+
+function compileWasm(source) {
+  if (typeof WebAssembly === "undefined" || source === null) {
+    return Promise.resolve(null);
+  }
+  if (source instanceof WebAssembly.Module) {
+    return Promise.resolve(source);
+  }
+  var bytes;
+  if (typeof source === "string") {
+    if (typeof fetch === "undefined") {
+      return Promise.resolve(null);
+    }
+    bytes = fetch(source).then(function(res) {
+      if (!res.ok) {
+        throw new Error("Can't fetch WebAssembly kernel");
+      }
+      return res.arrayBuffer();
+    });
+  } else {
+    bytes = Promise.resolve(source);
+  }
+  return bytes.then(function(buf) {
+    return WebAssembly.compile(buf);
+  });
+}
+
+// Resolves to compiled module or `null` if JS loop should be used.
+function getWasmModule() {
+  if (!wasmModule) {
+    wasmModule = compileWasm(wasmSource).catch(function() {
+      return null;
+    });
+  }
+  return wasmModule;
+}
+
+exports.setWasm = function(source) {
+  wasmSource = source === undefined ? DEFAULT_WASM_SOURCE : source;
+  wasmModule = null;
 };
 
 var FAILBACK_POOL_SIZE = 8;
 
+// Default pool size set by user, if any. Web Workers are spawned per
+// POW so there is no persistent pool to resize.
+var defaultPoolSize = 0;
+
 // NOTE(Kagami): We don't use promise shim in Browser implementation
 // because it's supported natively in new browsers (see
 // <http://caniuse.com/#feat=promises>) and we can use only new browsers
@@ -70,35 +124,61 @@ exports.pow = function(opts) {
   // libraries exist (see <https://stackoverflow.com/q/3289465>) but
   // they are buggy. Ulimately library user could adjust pool size
   // manually.
-  var poolSize = opts.poolSize || navigator.hardwareConcurrency;
+  var poolSize = opts.poolSize ||
+                 defaultPoolSize ||
+                 navigator.hardwareConcurrency;
   poolSize = poolSize || FAILBACK_POOL_SIZE;
 
-  var cancel;
+  var cancel = function() {};
   var powp = new Promise(function(resolve, reject) {
     assert(typeof poolSize === "number", "Bad pool size");
     assert(poolSize >= 1, "Pool size is too low");
     assert(poolSize <= 1024, "Pool size is too high");
-    assert(typeof opts.target === "number", "Bad target");
-    assert(opts.target >= 0, "Target is too low");
-    assert(opts.target <= 9007199254740991, "Target is too high");
-    assert(Buffer.isBuffer(opts.initialHash), "Bad initial hash");
-    assert(opts.initialHash.length === 64, "Bad initial hash");
+    var target = util.toUInt64Buffer(opts.target);
+    util.getNonceType(opts.nonceType);
+    // Workers search up to 2^53 nonces (2^32 with JS loop) so plain
+    // numbers are enough.
+    var start = opts.start == null ? 0 : opts.start;
+    var end = opts.end == null ? Infinity : opts.end;
+    var stride = opts.stride == null ? 1 : opts.stride;
+    assert(typeof start === "number" && start >= 0, "Bad range start");
+    assert(typeof end === "number" && end > start, "Bad range end");
+    assert(typeof stride === "number" && stride >= 1, "Bad range stride");
+    var initialHash = opts.initialHash;
+    if (opts.data) {
+      initialHash = exports.sha512(Array.isArray(opts.data) ?
+                                   Buffer.concat(opts.data) :
+                                   opts.data);
+    }
+    assert(Buffer.isBuffer(initialHash), "Bad initial hash");
+    assert(initialHash.length === 64, "Bad initial hash");
 
+    var done = false;
     function terminateAll() {
+      done = true;
       while (workers.length) {
         workers.shift().terminate();
       }
     }
 
+    var exhausted = 0;
     function onmessage(e) {
+      if (e.data === -2) {
+        // Only that worker is done, the rest still search their parts.
+        if (++exhausted === poolSize) {
+          terminateAll();
+          reject(new Error("Nonce range is exhausted"));
+        }
+        return;
+      }
       terminateAll();
       if (e.data >= 0) {
-        resolve(e.data);
+        resolve(util.convertNonce(e.data, opts.nonceType));
       } else {
         // It's very unlikely that execution will ever reach this place.
         // Currently the only reason why Worker may return value less
-        // than zero is a 32-bit nonce overflow (see worker
-        // implementation). It's 4G double hashes.
+        // than zero is a nonce overflow (see worker implementation).
+        // It's at least 4G double hashes.
         reject(new Error("uint32_t nonce overflow"));
       }
     }
@@ -112,26 +192,37 @@ exports.pow = function(opts) {
     }
 
     var workers = [];
-    var worker;
-    for (var i = 0; i < poolSize; i++) {
-      worker = work(require("./worker.browser.js"));
-      workers.push(worker);
-      // NOTE(Kagami): There is no race condition here. `onmessage` can
-      // only be called _after_ this for-loop finishes. See
-      // <https://stackoverflow.com/a/18192122> for details.
-      worker.onmessage = onmessage;
-      worker.onerror = onerror;
-      worker.postMessage({
-        num: i,
-        poolSize: poolSize,
-        target: opts.target,
-        initialHash: opts.initialHash,
-      });
-    }
+    getWasmModule().then(function(wasm) {
+      // Cancelled while the module was loading.
+      if (done) {
+        return;
+      }
+      var worker;
+      for (var i = 0; i < poolSize; i++) {
+        worker = work(require("./worker.browser.js"));
+        workers.push(worker);
+        // NOTE(Kagami): There is no race condition here. `onmessage`
+        // can only be called _after_ this for-loop finishes. See
+        // <https://stackoverflow.com/a/18192122> for details.
+        worker.onmessage = onmessage;
+        worker.onerror = onerror;
+        worker.postMessage({
+          num: i,
+          poolSize: poolSize,
+          targetHi: target.readUInt32BE(0),
+          targetLo: target.readUInt32BE(4),
+          initialHash: initialHash,
+          start: start,
+          end: end,
+          stride: stride,
+          wasm: wasm,
+        });
+      }
+    });
 
     cancel = function(e) {
       terminateAll();
-      reject(e);
+      reject(e || new PowCancelError());
     };
   });
   // Allow to stop a POW via custom function added to the Promise
@@ -140,4 +231,114 @@ exports.pow = function(opts) {
   return powp;
 };
 
+// There is no shared pool in Browser so run jobs one after another to
+// not oversubscribe cores, keeping the same interface as in Node.
+exports.powBatch = function(list, opts) {
+  var current = null;
+  var cancelled = list.map(function() { return null; });
+  var settlers = [];
+  var powps = list.map(function() {
+    return new Promise(function(resolve, reject) {
+      settlers.push({resolve: resolve, reject: reject});
+    });
+  });
+
+  function next(i) {
+    if (i >= list.length) {
+      current = null;
+      return;
+    }
+    if (cancelled[i]) {
+      settlers[i].reject(cancelled[i]);
+      return next(i + 1);
+    }
+    var powOpts = {
+      poolSize: opts.poolSize,
+      nonceType: opts.nonceType,
+      target: list[i].target,
+      start: list[i].start,
+      end: list[i].end,
+      stride: list[i].stride,
+      data: list[i].data,
+      initialHash: list[i].initialHash,
+    };
+    try {
+      current = {index: i, powp: exports.pow(powOpts)};
+    } catch(e) {
+      settlers[i].reject(e);
+      return next(i + 1);
+    }
+    current.powp.then(function(nonce) {
+      settlers[i].resolve(nonce);
+      next(i + 1);
+    }, function(err) {
+      settlers[i].reject(err);
+      next(i + 1);
+    });
+  }
+
+  function cancelOne(i, e) {
+    e = e || new PowCancelError();
+    cancelled[i] = e;
+    if (current && current.index === i) {
+      current.powp.cancel(e);
+    }
+  }
+
+  powps.forEach(function(powp, i) {
+    powp.cancel = function(e) {
+      cancelOne(i, e);
+    };
+  });
+  powps.cancel = function(e) {
+    for (var i = 0; i < list.length; i++) {
+      cancelOne(i, e);
+    }
+  };
+  next(0);
+  return powps;
+};
+
+exports.setPoolSize = function(poolSize) {
+  assert(typeof poolSize === "number", "Bad pool size");
+  assert(poolSize >= 0, "Pool size is too low");
+  assert(poolSize <= 1024, "Pool size is too high");
+  defaultPoolSize = poolSize;
+};
+
+// Web Workers run the whole POW within one call.
+exports.setBudget = function() {};
+
+// Nothing to calibrate, Web Workers are spawned per POW.
+exports.tunePoolSize = function() {
+  var poolSize = defaultPoolSize ||
+                 navigator.hardwareConcurrency ||
+                 FAILBACK_POOL_SIZE;
+  return Promise.resolve(poolSize);
+};
+
+// Browser doesn't allow to pin Web Workers.
+exports.setAffinity = function() {};
+
+exports.getTopology = function() {
+  var cores = navigator.hardwareConcurrency || FAILBACK_POOL_SIZE;
+  var cpus = [];
+  for (var i = 0; i < cores; i++) {
+    cpus.push({id: i, package: 0, core: i, node: 0, thread: 0});
+  }
+  return {cpus: cpus, cores: cores, packages: 1, nodes: 1, quota: 0};
+};
+
+// There is no GPU access from Web Workers, `backend` option is ignored.
+exports.getDeviceCount = function() {
+  return 0;
+};
+
+// Web Workers don't report their progress.
+exports.getStats = function() {
+  return {trials: 0, hashrate: 0, threads: []};
+};
+
+exports.shutdown = function() {};
+
 exports.Promise = window.Promise;
@@ -4,13 +4,16 @@
 
 "use strict";
 
+var fs = require("fs");
 var os = require("os");
+var path = require("path");
 var crypto = require("crypto");
 var PPromise = typeof Promise === "undefined" ?
                require("es6-promise").Promise :
                Promise;
-var bignum = require("bignum");
 var assert = require("./_util").assert;
+var PowCancelError = require("./_util").PowCancelError;
+var getNonceType = require("./_util").getNonceType;
 var worker = require("./worker");
 
 var createHash = crypto.createHash;
@@ -33,43 +36,519 @@ exports.ripemd160 = function(buf) {
 
 exports.randomBytes = crypto.randomBytes;
 
-// 2^80.
-var B80 = bignum("1208925819614629174706176");
-
-// NOTE(Kagami): We can't calculate entire target in JavaScript but the
-// result can be represented in native number type without losing
-// precision (targets mainly much less than 2^53).
+// Computed natively with 128-bit integers, see `pow_target`. Targets
+// above 2^53 are returned as BigInt (or Buffer on old Node).
 exports.getTarget = function(opts) {
-  // Slightly rearrange calculations and compute it bottom-up,
-  // right-to-left. See also:
-  // <https://github.com/Bitmessage/PyBitmessage/issues/758>.
-  var length = bignum(opts.payloadLength).add(opts.payloadLengthExtraBytes);
-  var denominator = bignum(opts.ttl)
-    .add(65536)
-    .mul(length)
-    .mul(opts.nonceTrialsPerByte);
-  var target = B80.div(denominator).toNumber();
-  assert(target <= 9007199254740991, "Unsafe target");
-  return target;
+  return worker.getTarget(
+    opts.ttl,
+    opts.payloadLength,
+    opts.nonceTrialsPerByte,
+    opts.payloadLengthExtraBytes
+  );
 };
 
+// Nonce range is passed only if some of its fields are given.
+function getRange(opts) {
+  if (opts.start == null && opts.end == null && opts.stride == null) {
+    return;
+  }
+  return {
+    start: opts.start == null ? undefined : opts.start,
+    end: opts.end == null ? undefined : opts.end,
+    stride: opts.stride == null ? undefined : opts.stride,
+  };
+}
+
+// Native scheduler accepts deadline as a plain timestamp.
+function getDeadline(deadline) {
+  return deadline instanceof Date ? deadline.getTime() : deadline;
+}
+
+var DEFAULT_PROGRESS_INTERVAL = 1000;
+
+// Native engines of the POW job, see `PowBackend`.
+var BACKENDS = {cpu: 1, gpu: 2, hybrid: 3};
+var DEVICE_MODULE = path.join(
+  __dirname, "..", "build", "Release", "bitmessage-opencl.node");
+
+// Device module is optional and loaded on first request, so jobs which
+// need devices fall back to CPU if it's not built or no GPU is found.
+var devicesLoaded = false;
+function loadDevices() {
+  if (!devicesLoaded) {
+    devicesLoaded = true;
+    worker.loadDevices(DEVICE_MODULE);
+  }
+  return worker.getDeviceCount();
+}
+
+function getBackends(backend) {
+  if (backend == null || backend === "cpu") {
+    return BACKENDS.cpu;
+  }
+  assert(BACKENDS.hasOwnProperty(backend), "Bad backend");
+  return loadDevices() ? BACKENDS[backend] : BACKENDS.cpu;
+}
+
+exports.getDeviceCount = loadDevices;
+
+// Native addon is used in Node, see `platform.browser.js`.
+exports.setWasm = function() {};
+
+// SMT siblings share SIMD units and don't make POW much faster, so use
+// one thread per physical core available to the process by default but
+// no more than cgroup CPU quota allows: extra threads are throttled
+// altogether and only add contention. Calibrated value replaces the
+// estimate once it's known.
+var defaultPoolSize = null;
+var tunedPoolSize = null;
+function getDefaultPoolSize() {
+  if (tunedPoolSize) {
+    return tunedPoolSize;
+  }
+  if (!defaultPoolSize) {
+    var topology = worker.getTopology();
+    var poolSize = topology.cores || os.cpus().length;
+    if (topology.quota) {
+      poolSize = Math.min(poolSize, Math.ceil(topology.quota));
+    }
+    defaultPoolSize = poolSize;
+  }
+  return defaultPoolSize;
+}
+
+// Calibrate pool size once, concurrent callers wait for the same run.
+// Calls `cb(poolSize)`, synchronously if it's already known.
+var tuneCallbacks = null;
+function tunePoolSize(cb) {
+  if (tunedPoolSize) {
+    return cb(tunedPoolSize);
+  }
+  if (tuneCallbacks) {
+    return tuneCallbacks.push(cb);
+  }
+  tuneCallbacks = [cb];
+  worker.tunePoolSize(function(err, poolSize) {
+    tunedPoolSize = poolSize || getDefaultPoolSize();
+    var callbacks = tuneCallbacks;
+    tuneCallbacks = null;
+    callbacks.forEach(function(callback) {
+      callback(tunedPoolSize);
+    });
+  });
+}
+
+// Stats of a job which hasn't started yet.
+function getEmptyStats() {
+  return {trials: 0, elapsed: 0, hashrate: 0, threads: []};
+}
+
+// Hash `data` of objects on the libuv thread pool so big payloads don't
+// block the event loop, `initialHash` is used as is. Calls
+// `cb(err, hashes)`.
+function getInitialHashes(list, cb) {
+  var datas = list.filter(function(item) {
+    return item.data;
+  }).map(function(item) {
+    return item.data;
+  });
+  worker.initialHashAsync(datas, function(err, packed) {
+    if (err) {
+      return cb(err);
+    }
+    var offset = 0;
+    cb(null, list.map(function(item) {
+      if (!item.data) {
+        return item.initialHash;
+      }
+      offset += 64;
+      return packed.slice(offset - 64, offset);
+    }));
+  });
+}
+
 exports.pow = function(opts) {
-  // TODO(Kagami): Allow to cancel a POW (see `platform.browser.js`).
+  var job = null;
+  var cancel = function() {};
+  var powp = new PPromise(function(resolve, reject) {
+    var poolSize = opts.poolSize;
+    var timer = null;
+    var cancelled = false;
+    function start(initialHash) {
+      job = worker.powAsync(
+        poolSize,
+        opts.target,
+        initialHash,
+        opts.priority,
+        getDeadline(opts.deadline),
+        getNonceType(opts.nonceType),
+        opts.checkpoint,
+        getRange(opts),
+        getBackends(opts.backend),
+        function(err, nonce) {
+          clearInterval(timer);
+          if (err) {
+            reject(err);
+          } else {
+            resolve(nonce);
+          }
+        }
+      );
+      // Counters are updated by native threads lock-free so polling
+      // them is cheap and doesn't slow down the computation.
+      if (opts.progress) {
+        timer = setInterval(function() {
+          opts.progress(job.getStats());
+        }, opts.progressInterval || DEFAULT_PROGRESS_INTERVAL);
+      }
+    }
+    cancel = function(e) {
+      cancelled = true;
+      clearInterval(timer);
+      if (job) {
+        job.cancel();
+      }
+      reject(e || new PowCancelError());
+    };
+    // Default pool size is calibrated before the first POW.
+    function run(initialHash) {
+      if (poolSize) {
+        return start(initialHash);
+      }
+      tunePoolSize(function(tuned) {
+        if (cancelled) {
+          return;
+        }
+        poolSize = tuned;
+        try {
+          start(initialHash);
+        } catch (e) {
+          reject(e);
+        }
+      });
+    }
+    if (!opts.data) {
+      return run(opts.initialHash);
+    }
+    getInitialHashes([opts], function(err, hashes) {
+      if (cancelled) {
+        return;
+      }
+      if (err) {
+        return reject(err);
+      }
+      try {
+        run(hashes[0]);
+      } catch (e) {
+        reject(e);
+      }
+    });
+  });
+  // Allow to stop a POW via custom function added to the Promise
+  // instance (the same as in Browser implementation).
+  powp.cancel = cancel;
+  powp.getStats = function() {
+    return job ? job.getStats() : getEmptyStats();
+  };
+  // Nothing is searched while data is being hashed or pool size is
+  // being calibrated.
+  powp.checkpoint = function() {
+    return job ? job.checkpoint() : opts.checkpoint;
+  };
+  return powp;
+};
+
+// Run several POWs as one native task. Returns array of promises with
+// the same `cancel` method as `pow` has; the array itself also has
+// `cancel` which stops all of them.
+exports.powBatch = function(list, opts) {
+  var poolSize = opts.poolSize || getDefaultPoolSize();
+  var job = null;
+  var cancelled = list.map(function() { return false; });
+  var settlers = [];
+  var powps = list.map(function() {
+    var powp = new PPromise(function(resolve, reject) {
+      settlers.push({resolve: resolve, reject: reject});
+    });
+    return powp;
+  });
+  function start(hashes) {
+    var items = list.map(function(item, i) {
+      return {
+        target: item.target,
+        initialHash: hashes[i],
+        priority: item.priority,
+        deadline: getDeadline(item.deadline),
+        checkpoint: item.checkpoint,
+        range: getRange(item),
+      };
+    });
+    job = worker.powBatch(
+      poolSize,
+      items,
+      getNonceType(opts.nonceType),
+      getBackends(opts.backend),
+      function(err, index, nonce) {
+        if (err) {
+          settlers[index].reject(err);
+        } else {
+          settlers[index].resolve(nonce);
+        }
+      }
+    );
+    // Jobs cancelled while data was being hashed.
+    cancelled.forEach(function(c, i) {
+      if (c) {
+        job.cancel(i);
+      }
+    });
+  }
+  function cancelOne(i, e) {
+    cancelled[i] = true;
+    if (job) {
+      job.cancel(i);
+    }
+    settlers[i].reject(e || new PowCancelError());
+  }
+  powps.forEach(function(powp, i) {
+    powp.cancel = function(e) {
+      cancelOne(i, e);
+    };
+    powp.getStats = function() {
+      return job ? job.getStats(i) : getEmptyStats();
+    };
+    powp.checkpoint = function() {
+      return job ? job.checkpoint(i) : list[i].checkpoint;
+    };
+  });
+  powps.cancel = function(e) {
+    list.forEach(function(item, i) {
+      cancelOne(i, e);
+    });
+  };
+  var hasData = list.some(function(item) {
+    return item.data;
+  });
+  if (!hasData) {
+    start(list.map(function(item) {
+      return item.initialHash;
+    }));
+    return powps;
+  }
+  function rejectAll(err) {
+    settlers.forEach(function(settler) {
+      settler.reject(err);
+    });
+  }
+  getInitialHashes(list, function(err, hashes) {
+    if (err) {
+      return rejectAll(err);
+    }
+    if (cancelled.every(function(c) { return c; })) {
+      return;
+    }
+    try {
+      start(hashes);
+    } catch (e) {
+      rejectAll(e);
+    }
+  });
+  return powps;
+};
+
+exports.powCheckBatch = function(payloads, targets) {
+  return worker.powCheckBatch(payloads, targets, undefined);
+};
+
+exports.powCheckBatchAsync = function(payloads, targets) {
   return new PPromise(function(resolve, reject) {
-    var poolSize = opts.poolSize || os.cpus().length;
-    worker.powAsync(
+    worker.powCheckBatch(payloads, targets, function(err, bitmap) {
+      if (err) {
+        reject(err);
+      } else {
+        resolve(bitmap);
+      }
+    });
+  });
+};
+
+// Search address keys on the POW pool, see `Address.fromRandomAsync`.
+// Resolves with `{signPrivateKey, encPrivateKey}`, promise has the same
+// `cancel` and `getStats` methods as `pow` has.
+exports.searchKeys = function(opts) {
+  var cancel = function() {};
+  var getStats = function() {};
+  var keysp = new PPromise(function(resolve, reject) {
+    var poolSize = opts.poolSize || getDefaultPoolSize();
+    var job = worker.searchKeys(
       poolSize,
-      opts.target,
-      opts.initialHash,
-      function(err, nonce) {
+      opts.passphrase,
+      opts.minLength,
+      opts.maxLength,
+      function(err, keys) {
         if (err) {
           reject(err);
         } else {
-          resolve(nonce);
+          resolve(keys);
         }
       }
     );
+    cancel = function(e) {
+      job.cancel();
+      reject(e || new PowCancelError("Address generation cancelled"));
+    };
+    getStats = function() {
+      return job.getStats();
+    };
   });
+  keysp.cancel = cancel;
+  keysp.getStats = getStats;
+  return keysp;
+};
+
+// Try every key on the POW pool, see `crypto.decryptBatch`. Malformed
+// payload rejects the same way as failed decryption does.
+exports.decryptBatch = function(privateKeys, buf, opts) {
+  opts = opts || {};
+  return new PPromise(function(resolve, reject) {
+    var poolSize = opts.poolSize || getDefaultPoolSize();
+    worker.decryptBatch(
+      poolSize,
+      buf,
+      Buffer.concat(privateKeys),
+      function(err, result) {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(result);
+        }
+      }
+    );
+  });
+};
+
+// Keys of wrong size are replaced by invalid ones so their signatures
+// just fail.
+var BAD_PUBLIC_KEY = new Buffer(65);
+BAD_PUBLIC_KEY.fill(0);
+
+exports.verifyBatch = function(publicKeys, msgs, sigs, opts) {
+  opts = opts || {};
+  return new PPromise(function(resolve, reject) {
+    var poolSize = opts.poolSize || getDefaultPoolSize();
+    var keys = publicKeys.map(function(publicKey) {
+      return publicKey.length === 65 ? publicKey : BAD_PUBLIC_KEY;
+    });
+    worker.verifyBatch(
+      poolSize,
+      Buffer.concat(keys),
+      msgs,
+      sigs,
+      function(err, bitmap) {
+        if (err) {
+          reject(err);
+        } else {
+          resolve(bitmap);
+        }
+      }
+    );
+  });
+};
+
+// Synchronous file access of on-disk `pow.SolutionCache`. Missing file
+// is read as `null`.
+exports.readFile = function(filename) {
+  try {
+    return fs.readFileSync(filename);
+  } catch (e) {
+    if (e.code === "ENOENT") {
+      return null;
+    }
+    throw e;
+  }
+};
+
+exports.appendFile = function(filename, buf) {
+  fs.appendFileSync(filename, buf);
+};
+
+// Replace the file atomically so a crash doesn't lose the old records.
+exports.writeFile = function(filename, buf) {
+  var tmp = filename + ".tmp";
+  fs.writeFileSync(tmp, buf);
+  fs.renameSync(tmp, filename);
+};
+
+// Native list codecs, see `structs.var_int_list` and `messages.addr`.
+exports.varIntListDecode = worker.varIntListDecode;
+exports.varIntListEncode = worker.varIntListEncode;
+exports.addrFilter = worker.addrFilter;
+
+exports.invHashBatch = function(buffers) {
+  return worker.invHashBatch(buffers, undefined);
+};
+
+exports.invHashBatchAsync = function(buffers) {
+  return new PPromise(function(resolve, reject) {
+    worker.invHashBatch(buffers, function(err, vectors) {
+      if (err) {
+        reject(err);
+      } else {
+        resolve(vectors);
+      }
+    });
+  });
+};
+
+// Native set of inventory vectors, see `structs.inv_vect.Set`.
+exports.InvSet = worker.InvSet;
+
+// Native framer, see `structs.message.Framer`.
+exports.Framer = worker.Framer;
+
+// Native object log, see `store.ObjectStore`.
+exports.ObjectStore = worker.ObjectStore;
+
+exports.setPoolSize = function(poolSize) {
+  assert(typeof poolSize === "number", "Bad pool size");
+  worker.setPoolSize(poolSize);
+};
+
+exports.setBudget = function(duty) {
+  assert(typeof duty === "number", "Bad CPU budget");
+  worker.setBudget(Math.round(duty));
+};
+
+exports.tunePoolSize = function() {
+  return new PPromise(function(resolve) {
+    tunePoolSize(resolve);
+  });
+};
+
+exports.setAffinity = function(opts) {
+  if (!opts) {
+    worker.setAffinity(false, false, -1, undefined);
+    return;
+  }
+  if (opts === true) {
+    opts = {};
+  }
+  var node = opts.node == null ? -1 : opts.node;
+  assert(typeof node === "number", "Bad NUMA node");
+  assert(opts.cpus == null || Array.isArray(opts.cpus), "Bad CPU list");
+  worker.setAffinity(true, !!opts.physicalOnly, node, opts.cpus || undefined);
+};
+
+exports.getTopology = function() {
+  return worker.getTopology();
+};
+
+exports.getStats = function() {
+  return worker.getStats();
+};
+
+exports.shutdown = function() {
+  worker.shutdown();
 };
 
 exports.Promise = PPromise;
@@ -4,6 +4,8 @@
  * @module bitmessage/pow
  */
 
+/* global BigInt */
+
 "use strict";
 
 var objectAssign = Object.assign || require("object-assign");
@@ -26,7 +28,9 @@ var util = require("./_util");
  * to the data length to make sending small messages more difficult.
  * 1000 is the network minimum so any lower values will be automatically
  * raised to 1000.
- * @return {number} Target.
+ * @return {(number|BigInt|Buffer)} Exact target. Values above 2^53 are
+ * returned as BigInt if it's supported or as 8-byte big-endian Buffer
+ * otherwise; every POW routine accepts all of these forms.
  * @function
  * @static
  */
@@ -44,11 +48,12 @@ var getTarget = exports.getTarget = function(opts) {
 /**
  * Check a POW.
  * @param {Object} opts - Proof of work options
- * @param {number} opts.target - Proof of work target or pass
+ * @param {(number|BigInt|Buffer)} opts.target - Proof of work target or pass
  * [getTarget]{@link module:bitmessage/pow.getTarget} options to `opts`
  * to compute it
  * @param {Buffer} opts.payload - Message payload (with nonce)
- * @param {(number|Buffer)} opts.nonce  - ...or already derived nonce
+ * @param {(number|BigInt|Buffer)} opts.nonce  - ...or already derived
+ * nonce
  * @param {Buffer} opts.initialHash - ...and initial hash
  * @return {boolean} Is the proof of work sufficient.
  */
@@ -63,19 +68,12 @@ exports.check = function(opts) {
     nonce = opts.payload.slice(0, 8);
     initialHash = bmcrypto.sha512(opts.payload.slice(8));
   } else {
-    if (typeof opts.nonce === "number") {
-      nonce = new Buffer(8);
-      // High 32 bits.
-      nonce.writeUInt32BE(Math.floor(opts.nonce / 4294967296), 0, true);
-      // Low 32 bits.
-      nonce.writeUInt32BE(opts.nonce % 4294967296, 4, true);
-    } else {
-      nonce = opts.nonce;
-    }
+    nonce = util.toUInt64Buffer(opts.nonce);
     initialHash = opts.initialHash;
   }
-  var targetHi = Math.floor(target / 4294967296);
-  var targetLo = target % 4294967296;
+  target = util.toUInt64Buffer(target);
+  var targetHi = target.readUInt32BE(0, true);
+  var targetLo = target.readUInt32BE(4, true);
   var dataToHash = Buffer.concat([nonce, initialHash]);
   var resultHash = bmcrypto.sha512(bmcrypto.sha512(dataToHash));
   var trialHi = resultHash.readUInt32BE(0, true);
@@ -89,26 +87,638 @@ exports.check = function(opts) {
   }
 };
 
+// Object data may be passed by chunks.
+function concatData(data) {
+  return Array.isArray(data) ? Buffer.concat(data) : data;
+}
+
+// Split batch into arrays of payloads and targets.
+function getCheckArgs(list) {
+  var payloads = [];
+  var targets = [];
+  list.forEach(function(item) {
+    var target = item.target;
+    if (target === undefined) {
+      target = getTarget(item);
+    }
+    payloads.push(item.payload);
+    targets.push(target);
+  });
+  return {payloads: payloads, targets: targets};
+}
+
+// Bitmap of `check` results in JavaScript, used if there is no native
+// implementation.
+function checkBatchJS(args) {
+  var bitmap = new Buffer(Math.ceil(args.payloads.length / 8));
+  bitmap.fill(0);
+  args.payloads.forEach(function(payload, i) {
+    if (exports.check({payload: payload, target: args.targets[i]})) {
+      bitmap[Math.floor(i / 8)] += Math.pow(2, i % 8);
+    }
+  });
+  return bitmap;
+}
+
+/**
+ * Check POWs of several objects at once. In Node it's done natively
+ * right from the payload buffers, without intermediate allocations.
+ * @param {Object[]} list - Check options of every object: `payload`
+ * (with nonce) and `target` or [getTarget]{@link
+ * module:bitmessage/pow.getTarget} options to compute it
+ * @return {Buffer} Bitmap where bit `i % 8` of byte `i / 8` is set if
+ * the proof of work of `i`-th object is sufficient.
+ */
+exports.checkBatch = function(list) {
+  var args = getCheckArgs(list);
+  if (!platform.powCheckBatch) {
+    return checkBatchJS(args);
+  }
+  return platform.powCheckBatch(args.payloads, args.targets);
+};
+
+/**
+ * The same as [checkBatch]{@link module:bitmessage/pow.checkBatch} but
+ * in Node hashing is done on a worker thread, so it doesn't block the
+ * event loop. Payloads must not be modified till the promise is
+ * settled.
+ * @param {Object[]} list - Check options of every object
+ * @return {Promise.<Buffer>} A promise that contains the bitmap when
+ * fulfilled.
+ */
+exports.checkBatchAsync = function(list) {
+  var args = getCheckArgs(list);
+  if (!platform.powCheckBatchAsync) {
+    return new platform.Promise(function(resolve) {
+      resolve(checkBatchJS(args));
+    });
+  }
+  return platform.powCheckBatchAsync(args.payloads, args.targets);
+};
+
+/**
+ * The same as [check]{@link module:bitmessage/pow.check} but hashes
+ * the payload off the event loop in Node, which matters for big
+ * objects.
+ * @param {Object} opts - Check options, the same as `check` takes
+ * @return {Promise.<boolean>} A promise that contains the check result
+ * when fulfilled.
+ */
+exports.checkAsync = function(opts) {
+  if (!opts.payload) {
+    // Nothing to hash.
+    return new platform.Promise(function(resolve) {
+      resolve(exports.check(opts));
+    });
+  }
+  return exports.checkBatchAsync([opts]).then(function(bitmap) {
+    return bitmap[0] === 1;
+  });
+};
+
 /**
  * Do a POW.
  * @param {Object} opts - Proof of work options
- * @param {Buffer} opts.data - Object message payload without nonce to
- * get the initial hash from
+ * @param {(Buffer|Buffer[])} opts.data - Object message payload
+ * without nonce to get the initial hash from, may be split into chunks.
+ * In Node it's hashed on a worker thread without copying, so it must
+ * not be modified till the POW starts
  * @param {Buffer} opts.initialHash - ...or already computed initial
  * hash
- * @param {number} opts.target - POW target
+ * @param {(number|BigInt|Buffer)} opts.target - POW target
  * @param {number=} opts.poolSize - POW calculation pool size (by
- * default equals to number of cores)
- * @return {Promise.<number>} A promise that contains computed nonce for
- * the given target when fulfilled.
+ * default calibrated by
+ * [tunePoolSize]{@link module:bitmessage/pow.tunePoolSize} in Node and
+ * equals to number of logical cores in Browser)
+ * @param {number=} opts.priority - Jobs with higher priority are
+ * computed first: running lower priority jobs are paused to free cores
+ * and continue from the same position afterwards (0 by default, Node
+ * only). Key search, trial decryption and signature checks always go
+ * before any POW
+ * @param {(Date|number)=} opts.deadline - Among jobs of the same
+ * priority ones with earlier deadline go first, jobs without deadline
+ * go last. It's only a scheduling hint, POW is not stopped when it
+ * passes (Node only)
+ * @param {function=} opts.progress - Called periodically with
+ * [job stats]{@link module:bitmessage/pow.JobStats} while POW is
+ * running (Node only)
+ * @param {number=} opts.progressInterval - Interval of `progress`
+ * calls in milliseconds (1000 by default)
+ * @param {string=} opts.nonceType - Type of the resulting nonce:
+ * `"number"` (default), `"bigint"` or `"buffer"` (8-byte big-endian,
+ * ready to be put into the object). Numbers limit the search to 2^53
+ * nonces, with other types the full 64-bit space is searched (Node
+ * only, Browser workers are limited to 2^32 anyway)
+ * @param {(number|BigInt|Buffer)=} opts.start - Search only nonces
+ * `start + i * stride`, 0 by default
+ * @param {(number|BigInt|Buffer)=} opts.end - ...below `end`. The
+ * promise is rejected once they all are searched
+ * @param {(number|BigInt|Buffer)=} opts.stride - ...1 by default
+ * @param {Buffer=} opts.checkpoint - Continue the search from the
+ * progress saved by `checkpoint()` of the previous POW of the same
+ * object, e.g. after restart of the process (Node only)
+ * @param {?SolutionCache=} opts.cache - Reuse nonce found by
+ * previous POW of the same object for the same or harder target,
+ * `null` to not use the default cache set by
+ * [setCache]{@link module:bitmessage/pow.setCache}. Requires the
+ * initial hash so `data` is hashed on the main thread then; ignored if
+ * `start`, `end` or `stride` is set
+ * @param {string=} opts.backend - Where to search: `"cpu"` (default),
+ * `"gpu"` or `"hybrid"` (both at once). GPUs are used via OpenCL module
+ * built by `npm run opencl`; if it's missing or no device is found the
+ * CPU is used instead (Node only). GPU can't be interrupted within a
+ * call so `cancel()` takes effect after the current batch of nonces
+ * @return {Promise.<(number|BigInt|Buffer)>} A promise that contains
+ * computed nonce for the given target when fulfilled. It has additional `cancel([err])`
+ * method which stops the computation and rejects the promise with `err`
+ * or with [CancelError]{@link module:bitmessage/pow.CancelError}. In
+ * Node native threads stop within one kernel call after that (tens of
+ * microseconds in practice), in Browser Web Workers are terminated
+ * right away. In Node it also has `getStats()` method which returns
+ * current [job stats]{@link module:bitmessage/pow.JobStats} and
+ * `checkpoint()` which returns the search progress as a Buffer to be
+ * persisted and passed back as `opts.checkpoint`; progress is saved up
+ * to the last kernel call, so nothing is searched twice.
  */
 exports.doAsync = function(opts) {
+  var cache = opts.cache === undefined ? defaultCache : opts.cache;
+  // Cached nonce may lie outside of the requested range.
+  if (!cache ||
+      opts.start != null ||
+      opts.end != null ||
+      opts.stride != null) {
+    return platform.pow(opts);
+  }
+  var initialHash = opts.data ?
+                    bmcrypto.sha512(concatData(opts.data)) :
+                    opts.initialHash;
+  var target = opts.target;
+  var nonce = cache.get(initialHash, target, opts.nonceType);
+  if (nonce != null) {
+    var powp = platform.Promise.resolve(nonce);
+    powp.cancel = function() {};
+    powp.getStats = function() {
+      return {trials: 0, elapsed: 0, hashrate: 0, threads: []};
+    };
+    powp.checkpoint = function() {
+      return opts.checkpoint;
+    };
+    return powp;
+  }
+  var job = objectAssign({}, opts, {initialHash: initialHash});
+  delete job.data;
+  var resultp = platform.pow(job);
+  resultp.then(function(nonce) {
+    cache.set(initialHash, target, nonce);
+  }, function() {});
+  return resultp;
+};
+
+/**
+ * Do POWs of several objects at once. All of them are queued to the
+ * shared pool together so they don't compete for cores and finish in
+ * order.
+ * @param {Object[]} list - Proof of work options of every object, see
+ * [doAsync]{@link module:bitmessage/pow.doAsync}
+ * @param {Object=} opts - Options
+ * @param {number=} opts.poolSize - POW calculation pool size used by
+ * every object
+ * @param {string=} opts.nonceType - Type of the resulting nonces, see
+ * [doAsync]{@link module:bitmessage/pow.doAsync}
+ * @param {string=} opts.backend - Where to search, see
+ * [doAsync]{@link module:bitmessage/pow.doAsync}
+ * @return {Promise.<(number|BigInt|Buffer)>[]} Promises of the computed
+ * nonces, in the same order as `list`. Every promise has `cancel([err])` method the
+ * same as [doAsync]{@link module:bitmessage/pow.doAsync} returns, the
+ * array itself also has `cancel([err])` which stops all of them.
+ */
+exports.doBatchAsync = function(list, opts) {
+  return platform.powBatch(list, opts || {});
+};
+
+/**
+ * Run the POW in the current process. Default transport of
+ * [doDistributedAsync]{@link module:bitmessage/pow.doDistributedAsync}
+ * and what the remote side of other transports should call.
+ * @param {Object} job - Part of the POW, see
+ * [doDistributedAsync]{@link module:bitmessage/pow.doDistributedAsync}
+ * @return {Promise} The same as
+ * [doAsync]{@link module:bitmessage/pow.doAsync} returns.
+ */
+exports.localTransport = function(job) {
+  return exports.doAsync(job);
+};
+
+/**
+ * Split one POW between several workers, e.g. other processes or
+ * hosts. Worker `i` of `n` searches nonces `i + k * n`, so workers of
+ * different speed don't wait for each other. The first found nonce
+ * wins and the rest of workers are cancelled.
+ * @param {Object} opts - Proof of work options, the same as
+ * [doAsync]{@link module:bitmessage/pow.doAsync} takes except `start`
+ * and `stride` which are set per worker
+ * @param {function[]} transports - One function per worker. Every one
+ * is called with the worker's part of the job: `opts` with `data`
+ * replaced by `initialHash` and with `start` and `stride` set. It
+ * should pass it to [doAsync]{@link module:bitmessage/pow.doAsync} on
+ * the remote side (as
+ * [localTransport]{@link module:bitmessage/pow.localTransport} does
+ * locally) and return a promise of the found nonce. If the promise has
+ * `cancel()` method it's called once the result isn't needed anymore.
+ * @return {Promise.<(number|BigInt|Buffer)>} A promise that contains
+ * the first found nonce. It's rejected with the last error if every
+ * worker failed. It has additional `cancel([err])` method which stops
+ * all workers.
+ */
+exports.doDistributedAsync = function(opts, transports) {
+  util.assert(transports.length >= 1, "No transports");
   var initialHash;
   if (opts.data) {
-    initialHash = bmcrypto.sha512(opts.data);
+    initialHash = bmcrypto.sha512(concatData(opts.data));
   } else {
     initialHash = opts.initialHash;
   }
-  opts = objectAssign({}, opts, {initialHash: initialHash});
-  return platform.pow(opts);
+  var results = [];
+  var cancel = function() {};
+  var powp = new platform.Promise(function(resolve, reject) {
+    var settled = false;
+    var failed = 0;
+    function stopAll() {
+      settled = true;
+      results.forEach(function(result) {
+        if (result && typeof result.cancel === "function") {
+          result.cancel();
+        }
+      });
+    }
+    results = transports.map(function(transport, i) {
+      var job = objectAssign({}, opts, {
+        initialHash: initialHash,
+        start: i,
+        stride: transports.length,
+      });
+      delete job.data;
+      var result = transport(job);
+      platform.Promise.resolve(result).then(function(nonce) {
+        if (!settled) {
+          stopAll();
+          resolve(nonce);
+        }
+      }, function(err) {
+        if (!settled && ++failed === transports.length) {
+          settled = true;
+          reject(err);
+        }
+      });
+      return result;
+    });
+    cancel = function(e) {
+      stopAll();
+      reject(e || new util.PowCancelError());
+    };
+  });
+  powp.cancel = cancel;
+  return powp;
+};
+
+// Every record is initial hash, target and nonce.
+var CACHE_RECORD_SIZE = 64 + 8 + 8;
+var DEFAULT_CACHE_SIZE = 1024;
+
+// Compare 64-bit big-endian buffers.
+function compareUInt64(a, b) {
+  var hiA = a.readUInt32BE(0, true);
+  var hiB = b.readUInt32BE(0, true);
+  if (hiA !== hiB) {
+    return hiA < hiB ? -1 : 1;
+  }
+  var loA = a.readUInt32BE(4, true);
+  var loB = b.readUInt32BE(4, true);
+  return loA < loB ? -1 : (loA > loB ? 1 : 0);
+}
+
+/**
+ * LRU cache of found POW solutions keyed by initial hash. One nonce is
+ * kept per object: the one found for the lowest (hardest) target since
+ * it also satisfies every easier target. Records are stored packed in a
+ * single buffer, 80 bytes each.
+ * @param {Object=} opts - Cache options
+ * @param {number=} opts.size - Maximum number of records (1024 by
+ * default)
+ * @param {string=} opts.path - Persist records to this file (Node
+ * only). It's an append-only log of records which is compacted when it
+ * grows twice as large as the cache
+ * @constructor
+ * @static
+ */
+function SolutionCache(opts) {
+  if (!(this instanceof SolutionCache)) {
+    return new SolutionCache(opts);
+  }
+  opts = opts || {};
+  var size = opts.size || DEFAULT_CACHE_SIZE;
+  util.assert(size >= 1, "Bad cache size");
+  this._size = size;
+  this._records = new Buffer(size * CACHE_RECORD_SIZE);
+  // Slot of every initial hash, slots are linked from the most recently
+  // used one.
+  this._slots = {};
+  this._prev = [];
+  this._next = [];
+  this._head = -1;
+  this._tail = -1;
+  this._used = 0;
+  this._path = opts.path;
+  this._logged = 0;
+  if (this._path) {
+    util.assert(platform.readFile, "On-disk cache is not supported");
+    this._load();
+  }
+}
+exports.SolutionCache = SolutionCache;
+
+SolutionCache.prototype._unlink = function(slot) {
+  var prev = this._prev[slot];
+  var next = this._next[slot];
+  if (prev === -1) {
+    this._head = next;
+  } else {
+    this._next[prev] = next;
+  }
+  if (next === -1) {
+    this._tail = prev;
+  } else {
+    this._prev[next] = prev;
+  }
+};
+
+SolutionCache.prototype._pushFront = function(slot) {
+  this._prev[slot] = -1;
+  this._next[slot] = this._head;
+  if (this._head === -1) {
+    this._tail = slot;
+  } else {
+    this._prev[this._head] = slot;
+  }
+  this._head = slot;
+};
+
+SolutionCache.prototype._touch = function(slot) {
+  if (this._head !== slot) {
+    this._unlink(slot);
+    this._pushFront(slot);
+  }
+};
+
+// Put the record without logging it. Returns false if the cached one
+// is at least as good.
+SolutionCache.prototype._put = function(record) {
+  var key = record.toString("hex", 0, 64);
+  var slot = this._slots[key];
+  var offset;
+  if (slot !== undefined) {
+    offset = slot * CACHE_RECORD_SIZE;
+    var cachedTarget = this._records.slice(offset + 64, offset + 72);
+    this._touch(slot);
+    if (compareUInt64(record.slice(64, 72), cachedTarget) >= 0) {
+      return false;
+    }
+  } else {
+    if (this._used < this._size) {
+      slot = this._used++;
+    } else {
+      slot = this._tail;
+      offset = slot * CACHE_RECORD_SIZE;
+      delete this._slots[this._records.toString("hex", offset, offset + 64)];
+      this._unlink(slot);
+    }
+    this._slots[key] = slot;
+    this._pushFront(slot);
+  }
+  record.copy(this._records, slot * CACHE_RECORD_SIZE);
+  return true;
+};
+
+SolutionCache.prototype._load = function() {
+  var buf = platform.readFile(this._path);
+  if (!buf) {
+    return;
+  }
+  // Trailing partial record of the interrupted write is skipped.
+  var count = Math.floor(buf.length / CACHE_RECORD_SIZE);
+  for (var i = 0; i < count; i++) {
+    var offset = i * CACHE_RECORD_SIZE;
+    this._put(buf.slice(offset, offset + CACHE_RECORD_SIZE));
+  }
+  this._logged = count;
+  if (count > this._size * 2 || count * CACHE_RECORD_SIZE < buf.length) {
+    this._compact();
+  }
+};
+
+// Rewrite the log with the current records only, least recent first so
+// they are evicted first after reload.
+SolutionCache.prototype._compact = function() {
+  var bufs = [];
+  for (var slot = this._tail; slot !== -1; slot = this._prev[slot]) {
+    var offset = slot * CACHE_RECORD_SIZE;
+    bufs.push(this._records.slice(offset, offset + CACHE_RECORD_SIZE));
+  }
+  platform.writeFile(this._path, Buffer.concat(bufs));
+  this._logged = bufs.length;
+};
+
+/**
+ * Find nonce for the object. Nonce found for the harder target is
+ * returned right away, for the easier one it's checked against the
+ * requested target.
+ * @param {Buffer} initialHash - Initial hash of the object
+ * @param {(number|BigInt|Buffer)} target - Required target
+ * @param {string=} nonceType - Type of the returned nonce, see
+ * [doAsync]{@link module:bitmessage/pow.doAsync}
+ * @return {?(number|BigInt|Buffer)} Nonce or `null` if not found.
+ */
+SolutionCache.prototype.get = function(initialHash, target, nonceType) {
+  util.getNonceType(nonceType);
+  var slot = this._slots[initialHash.toString("hex")];
+  if (slot === undefined) {
+    return null;
+  }
+  var offset = slot * CACHE_RECORD_SIZE;
+  var cachedTarget = this._records.slice(offset + 64, offset + 72);
+  var nonce = new Buffer(8);
+  this._records.copy(nonce, 0, offset + 72, offset + 80);
+  target = util.toUInt64Buffer(target);
+  var check = {nonce: nonce, initialHash: initialHash, target: target};
+  if (compareUInt64(cachedTarget, target) > 0 && !exports.check(check)) {
+    return null;
+  }
+  this._touch(slot);
+  if (nonceType === "buffer") {
+    return nonce;
+  }
+  var hex = nonce.toString("hex");
+  if (nonceType === "bigint") {
+    return BigInt("0x" + hex);
+  }
+  var value = util.fromUInt64Hex(hex);
+  return typeof value === "number" ? value : null;
+};
+
+/**
+ * Remember nonce found for the object.
+ * @param {Buffer} initialHash - Initial hash of the object
+ * @param {(number|BigInt|Buffer)} target - Target it was found for
+ * @param {(number|BigInt|Buffer)} nonce - The nonce
+ */
+SolutionCache.prototype.set = function(initialHash, target, nonce) {
+  util.assert(initialHash.length === 64, "Bad initial hash");
+  var record = Buffer.concat([
+    initialHash,
+    util.toUInt64Buffer(target),
+    util.toUInt64Buffer(nonce),
+  ]);
+  if (!this._put(record) || !this._path) {
+    return;
+  }
+  platform.appendFile(this._path, record);
+  if (++this._logged > this._size * 2) {
+    this._compact();
+  }
+};
+
+var defaultCache = null;
+
+/**
+ * Set the cache used by [doAsync]{@link module:bitmessage/pow.doAsync}
+ * when `opts.cache` is not given. Disabled by default.
+ * @param {?SolutionCache} cache - Solution cache or `null` to disable
+ */
+exports.setCache = function(cache) {
+  defaultCache = cache || null;
 };
+
+/**
+ * Statistics of a POW job.
+ * @typedef {Object} JobStats
+ * @property {number} trials - Number of computed hashes
+ * @property {number} elapsed - Milliseconds since the job was started
+ * till now or till it's finished
+ * @property {number} hashrate - Hashes per second
+ * @property {Object[]} threads - The same `{trials, elapsed, hashrate}`
+ * for every thread slot of the job, `elapsed` counts only the time
+ * thread was working on it
+ * @static
+ */
+
+/**
+ * Error which rejects promise of the cancelled POW.
+ * @constructor
+ */
+exports.CancelError = util.PowCancelError;
+
+/**
+ * Set the size of the POW thread pool shared by all jobs. In Node the
+ * pool is started lazily on the first POW and by default grows up to
+ * the maximal requested `poolSize`; fixed size disables that growth.
+ * Running POWs are resized on the fly without losing progress. In
+ * Browser it only sets default pool size for the next POWs.
+ * @param {number} poolSize - Number of threads, `0` to restore the
+ * default behavior
+ * @function
+ */
+exports.setPoolSize = platform.setPoolSize;
+
+/**
+ * Limit CPU usage of the POW thread pool without shrinking it. Every
+ * thread computes by short chunks and sleeps in between so it's busy
+ * only `duty` percent of time, e.g. 8 threads at 50% take about 4
+ * cores. All running and queued POWs slow down evenly and the change
+ * takes effect within milliseconds, so background POWs can back off
+ * while the host is busy and speed up once it's idle. GPU devices are
+ * not limited. No-op in Browser.
+ * @param {number} duty - Percent of CPU time in [1, 100], `100` for no
+ * limit (default)
+ * @function
+ */
+exports.setBudget = platform.setBudget;
+
+/**
+ * Stop POW thread pool. Running and queued POWs are rejected. The pool
+ * will be started again by the next
+ * [doAsync]{@link module:bitmessage/pow.doAsync} call. Useful to let
+ * the process exit cleanly.
+ * @function
+ */
+exports.shutdown = platform.shutdown;
+
+/**
+ * Pin threads of the POW pool to CPUs. Running POWs move to the new
+ * CPUs after their current chunk of nonces. Threads are placed one per
+ * physical core spread across sockets first and only then on SMT
+ * siblings. No-op in Browser.
+ * @param {(Object|boolean)} opts - Placement options, `true` to pin to
+ * all available CPUs or `false` to unpin
+ * @param {boolean=} opts.physicalOnly - Don't use SMT siblings
+ * @param {number=} opts.node - Use only CPUs of this NUMA node
+ * @param {number[]=} opts.cpus - ...or explicit list of CPU IDs taken
+ * by threads in the given order
+ * @function
+ */
+exports.setAffinity = platform.setAffinity;
+
+/**
+ * Find the default pool size of
+ * [doAsync]{@link module:bitmessage/pow.doAsync}: POW is run for a
+ * short time on more and more threads, up to the physical cores
+ * available to the process and its cgroup CPU quota, while the total
+ * hashrate keeps growing. Calibration takes from a hundred milliseconds
+ * to a few seconds and is done once per process, the first `doAsync`
+ * without `poolSize` waits for it. Other POWs running at the same time
+ * skew the result. In Browser it returns the default pool size.
+ * @return {Promise.<number>} A promise that contains the pool size.
+ * @function
+ */
+exports.tunePoolSize = platform.tunePoolSize;
+
+/**
+ * Get topology of CPUs available to the process.
+ * @return {Object} `{cpus, cores, packages, nodes, quota}` where `cpus`
+ * has `{id, package, core, node, thread}` of every logical CPU and
+ * `thread` is an index among SMT siblings of the core. `quota` is
+ * cgroup CPU bandwidth limit in CPUs, `0` if unlimited (Linux only).
+ * In Browser every core is reported as a separate one.
+ * @function
+ */
+exports.getTopology = platform.getTopology;
+
+/**
+ * Set the WebAssembly POW kernel used by Browser workers. By default
+ * it's fetched from `bitmessage-pow.wasm` relative to the page; build it
+ * with `npm run wasm` and serve it along with the bundle. Workers fall
+ * back to pure JS implementation if the kernel can't be loaded or the
+ * browser doesn't support WebAssembly SIMD. Does nothing in Node.
+ * @param {(string|ArrayBuffer|Uint8Array|WebAssembly.Module)=} source -
+ * URL, bytes or compiled module of the kernel; `null` to always use JS
+ * and nothing to restore the default
+ * @function
+ */
+exports.setWasm = platform.setWasm;
+
+/**
+ * Get the number of GPUs available for POW. Loads the OpenCL module on
+ * first call. Always `0` in Browser.
+ * @return {number}
+ * @function
+ */
+exports.getDeviceCount = platform.getDeviceCount;
+
+/**
+ * Get statistics of the POW thread pool.
+ * @return {Object} `{trials, hashrate, threads}` where `threads` has
+ * `{trials, elapsed, hashrate}` of every running thread since it was
+ * started (`elapsed` is busy time in milliseconds). Always empty in
+ * Browser.
+ * @function
+ */
+exports.getStats = platform.getStats;
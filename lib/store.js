@@ -0,0 +1,149 @@
+/**
+ * Persistent storage of objects for relaying nodes. Objects are
+ * appended to a log file which is memory-mapped for reading, so
+ * payloads for `getdata` responses are served without copying and
+ * opening the store only reads record headers. The index is kept in
+ * memory and keyed by inventory vector. Node-only and requires native
+ * module (not supported on Windows).
+ * @module bitmessage/store
+ */
+
+"use strict";
+
+var structs = require("./structs");
+var platform = require("./platform");
+var util = require("./_util");
+
+var assert = util.assert;
+
+/**
+ * Object store backed by the given file which is created if needed.
+ * Objects which have expired are not loaded and a record left
+ * incomplete by a crash is cut off.
+ * @param {string} path - Path to the log file
+ * @param {number=} now - Current time in seconds
+ * @constructor
+ * @static
+ */
+function ObjectStore(path, now) {
+  if (!(this instanceof ObjectStore)) {
+    return new ObjectStore(path, now);
+  }
+  assert(platform.ObjectStore, "Object store is not supported");
+  assert(typeof path === "string", "Bad path");
+  this._native = new platform.ObjectStore(path, getNow(now));
+}
+exports.ObjectStore = ObjectStore;
+
+function getNow(now) {
+  return now === undefined ? util.tnow() : now;
+}
+
+function checkVector(vector) {
+  assert(Buffer.isBuffer(vector) && vector.length === 32, "Bad vector");
+  return vector;
+}
+
+/**
+ * Store the object. Expiration time is read from the object header.
+ * @param {Buffer} payload - Object message payload
+ * @return {Buffer} Inventory vector of the object.
+ */
+ObjectStore.prototype.add = function(payload) {
+  assert(payload.length >= 16, "Buffer is too small");
+  var vector = structs.inv_vect.encode(payload);
+  var expires = util.readTimestamp64BE(payload, 8);
+  this._native.put(vector, expires, payload);
+  return vector;
+};
+
+/**
+ * Get the object payload. Returned Buffer points into the file mapped
+ * read-only, so writing to it crashes the process; copy it if it needs
+ * to be changed. It stays valid after the object is removed or the
+ * store is closed.
+ * @param {Buffer} vector - Inventory vector
+ * @return {?Buffer}
+ */
+ObjectStore.prototype.get = function(vector) {
+  return this._native.get(checkVector(vector));
+};
+
+/**
+ * Check whether the object is stored.
+ * @param {Buffer} vector - Inventory vector
+ * @return {boolean}
+ */
+ObjectStore.prototype.has = function(vector) {
+  return this._native.contains(checkVector(vector));
+};
+
+/**
+ * Remove the object.
+ * @param {Buffer} vector - Inventory vector
+ * @return {boolean} False if there was no such object.
+ */
+ObjectStore.prototype.remove = function(vector) {
+  return this._native.delete(checkVector(vector));
+};
+
+/**
+ * Drop expired objects. Cost depends on the number of expired objects
+ * rather than on the size of the store.
+ * @param {number=} now - Current time in seconds
+ * @return {number} Number of dropped objects.
+ */
+ObjectStore.prototype.prune = function(now) {
+  return this._native.prune(getNow(now));
+};
+
+/**
+ * Vectors of all stored objects, e.g. for the `inv` message.
+ * @return {Buffer} Packed 32-byte vectors.
+ */
+ObjectStore.prototype.vectors = function() {
+  return this._native.vectors();
+};
+
+/**
+ * Find advertised objects which are missing from the store, see
+ * [Set.diff]{@link module:bitmessage/structs.inv_vect.Set#diff}.
+ * @param {(Buffer[]|Buffer)} vectors - Vectors to check
+ * @return {Buffer} Packed missing vectors in the input order.
+ */
+ObjectStore.prototype.diff = function(vectors) {
+  var packed = Buffer.isBuffer(vectors) ? vectors : Buffer.concat(vectors);
+  assert(packed.length % 32 === 0, "Bad vectors length");
+  return this._native.diff(packed);
+};
+
+/**
+ * Rewrite the file without removed and expired objects. New file
+ * replaces the old one atomically. Blocks until done.
+ * @param {number=} now - Current time in seconds
+ */
+ObjectStore.prototype.compact = function(now) {
+  this._native.compact(getNow(now));
+};
+
+/**
+ * Flush written objects to disk.
+ */
+ObjectStore.prototype.sync = function() {
+  this._native.sync();
+};
+
+/**
+ * Close the file. Other methods throw afterwards.
+ */
+ObjectStore.prototype.close = function() {
+  this._native.close();
+};
+
+/**
+ * Number of stored objects.
+ * @return {number}
+ */
+ObjectStore.prototype.size = function() {
+  return this._native.size();
+};
@@ -29,9 +29,11 @@ var objectAssign = Object.assign || require("object-assign");
 var bufferEqual = require("buffer-equal");
 var bmcrypto = require("./crypto");
 var POW = require("./pow");
+var platform = require("./platform");
 var util = require("./_util");
 
 var assert = util.assert;
+var PPromise = platform.Promise;
 var IPv4_MAPPING = util.IPv4_MAPPING;
 var inet_pton = util.inet_pton;
 
@@ -91,6 +93,95 @@ function findMagic(buf) {
   }
 }
 
+// Errors of native framer by status.
+var FRAMER_ERRORS = [
+  null,
+  "Magic not found, skipping buffer data",
+  "Magic in the middle of buffer, skipping some data at start",
+  "Message is too large, skipping it",
+  "Non-ASCII characters in command, skipping message",
+  "Bad checksum, skipping message",
+];
+
+/**
+ * Incremental decoder of the peer message stream. Unlike
+ * [tryDecode]{@link module:bitmessage/structs.message.tryDecode} it
+ * keeps the incomplete data itself and returns all messages completed
+ * by the pushed chunk at once. Native implementation verifies checksums
+ * off the event loop and doesn't copy payloads: all of them are slices
+ * of a single buffer (so don't modify them in place).
+ * @example
+ * var framer = new structs.message.Framer();
+ * socket.on("data", function(chunk) {
+ *   framer.push(chunk).then(function(results) {
+ *     results.forEach(function(res) {
+ *       if (res.message) {
+ *         console.log(res.message.command);
+ *       }
+ *     });
+ *   });
+ * });
+ * @constructor
+ * @memberof module:bitmessage/structs.message
+ */
+function Framer() {
+  if (!(this instanceof Framer)) {
+    return new Framer();
+  }
+  this._native = platform.Framer ? new platform.Framer() : null;
+  this._buf = new Buffer(0);
+  this._last = PPromise.resolve();
+}
+
+/**
+ * Append received data. Chunks are framed in the push order.
+ * @param {Buffer} chunk - Data chunk
+ * @return {Promise.<TryDecodeResult[]>} A promise that resolves with
+ * [results]{@link module:bitmessage/structs.message.TryDecodeResult}
+ * (without `rest`) in the stream order.
+ */
+Framer.prototype.push = function(chunk) {
+  var self = this;
+  var resultp = this._last.then(function() {
+    return self._native ? self._pushNative(chunk) : self._pushJS(chunk);
+  });
+  this._last = resultp.catch(function() {});
+  return resultp;
+};
+
+Framer.prototype._pushNative = function(chunk) {
+  var framer = this._native;
+  return new PPromise(function(resolve, reject) {
+    framer.push(chunk, function(err, arena, messages) {
+      if (err) {
+        return reject(err);
+      }
+      resolve(messages.map(function(msg) {
+        if (msg.status) {
+          return {error: new Error(FRAMER_ERRORS[msg.status])};
+        }
+        return {message: {
+          command: msg.command,
+          payload: arena.slice(msg.offset, msg.offset + msg.length),
+          length: 24 + msg.length,
+        }};
+      }));
+    });
+  });
+};
+
+Framer.prototype._pushJS = function(chunk) {
+  var results = [];
+  var res;
+  this._buf = Buffer.concat([this._buf, chunk]);
+  while ((res = message.tryDecode(this._buf))) {
+    this._buf = res.rest;
+    delete res.rest;
+    results.push(res);
+  }
+  return results;
+};
+
 /**
  * Message structure.
  * @see {@link https://bitmessage.org/wiki/Protocol_specification#Message_structure}
@@ -104,6 +195,8 @@ var message = exports.message = {
    */
   MAGIC: 0xE9BEB4D9,
 
+  Framer: Framer,
+
   /**
    * @typedef {Object} TryDecodeResult
    * @property {Object} message - Decoded message
@@ -643,12 +736,21 @@ exports.var_str = {
   },
 };
 
+// Values native `var_int_list` encoder accepts, other ones go to
+// `var_int.encode` for the error messages.
+function isSafeInteger(value) {
+  return typeof value === "number" &&
+         value >= 0 &&
+         value <= 9007199254740991 &&
+         Math.floor(value) === value;
+}
+
 /**
  * Variable length list of integers.
  * @see {@link https://bitmessage.org/wiki/Protocol_specification#Variable_length_list_of_integers}
  * @namespace
  */
-exports.var_int_list = {
+var var_int_list = exports.var_int_list = {
   /**
    * @typedef {Object} DecodeResult
    * @property {number} list - Stored numbers
@@ -666,6 +768,11 @@ exports.var_int_list = {
    * [Decoded `var_int_list` structure.]{@link module:bitmessage/structs.var_int_list.DecodeResult}
    */
   decode: function(buf) {
+    if (platform.varIntListDecode) {
+      var packed = var_int_list.decodePacked(buf);
+      packed.list = Array.prototype.slice.call(packed.list);
+      return packed;
+    }
     var decoded = var_int.decode(buf);
     var listLength = decoded.value;
     var list = new Array(listLength);
@@ -680,12 +787,36 @@ exports.var_int_list = {
     return {list: list, length: sumLength, rest: rest};
   },
 
+  /**
+   * Decode `var_int_list` into a typed array. In Node the whole list is
+   * validated and parsed natively in one pass.  
+   * NOTE: `rest` references input buffer.
+   * @param {Buffer} buf - A buffer that starts with encoded
+   * `var_int_list`
+   * @return {DecodeResult} The same as [decode]{@link
+   * module:bitmessage/structs.var_int_list.decode} returns but `list` is
+   * a `Float64Array`.
+   */
+  decodePacked: function(buf) {
+    if (!platform.varIntListDecode) {
+      var decoded = var_int_list.decode(buf);
+      decoded.list = new Float64Array(decoded.list);
+      return decoded;
+    }
+    var res = platform.varIntListDecode(buf);
+    res.rest = buf.slice(res.length);
+    return res;
+  },
+
   /**
    * Encode list of numbers into `var_int_list`.
    * @param {number[]} list - A number list
    * @return {Buffer} Encoded `var_int_list`.
    */
   encode: function(list) {
+    if (platform.varIntListEncode && list.every(isSafeInteger)) {
+      return platform.varIntListEncode(list);
+    }
     var var_ints = list.map(var_int.encode);
     var bufs = [var_int.encode(list.length)].concat(var_ints);
     return Buffer.concat(bufs);
@@ -816,7 +947,7 @@ exports.net_addr = {
  * @see {@link https://bitmessage.org/wiki/Protocol_specification#Inventory_Vectors}
  * @namespace
  */
-exports.inv_vect = {
+var inv_vect = exports.inv_vect = {
   // NOTE(Kagami): Only encode operation is defined because decoding of
   // the encoded vector is impossible.
 
@@ -828,6 +959,126 @@ exports.inv_vect = {
   encode: function(buf) {
     return bmcrypto.sha512(bmcrypto.sha512(buf)).slice(0, 32);
   },
+
+  /**
+   * Encode inventory vectors of several objects at once.
+   * @param {Buffer[]} bufs - Payloads to calculate the vectors for
+   * @return {Buffer} Packed 32-byte vectors in the same order.
+   */
+  encodeBatch: function(bufs) {
+    if (platform.invHashBatch) {
+      return platform.invHashBatch(bufs);
+    }
+    return Buffer.concat(bufs.map(inv_vect.encode));
+  },
+
+  /**
+   * The same as [encodeBatch]{@link
+   * module:bitmessage/structs.inv_vect.encodeBatch} but hashes off the
+   * event loop if possible. Buffers must not be modified meanwhile.
+   * @param {Buffer[]} bufs - Payloads to calculate the vectors for
+   * @return {Promise.<Buffer>} A promise that resolves with packed
+   * vectors.
+   */
+  encodeBatchAsync: function(bufs) {
+    if (platform.invHashBatchAsync) {
+      return platform.invHashBatchAsync(bufs);
+    }
+    return new PPromise(function(resolve) {
+      resolve(inv_vect.encodeBatch(bufs));
+    });
+  },
+
+  Set: InvSet,
+};
+
+// Accept vector list or packed vectors.
+function packVectors(vectors) {
+  if (Buffer.isBuffer(vectors)) {
+    assert(vectors.length % 32 === 0, "Bad vectors length");
+    return vectors;
+  }
+  return Buffer.concat(vectors);
+}
+
+/**
+ * Set of inventory vectors. Native implementation is an open-addressing
+ * hash table which stores vectors packed, without per-vector objects.
+ * Methods accept either list of 32-byte vectors or one buffer with
+ * packed vectors (e.g. the rest of `inv` payload after the count).
+ * @constructor
+ * @memberof module:bitmessage/structs.inv_vect
+ */
+function InvSet() {
+  if (!(this instanceof InvSet)) {
+    return new InvSet();
+  }
+  this._native = platform.InvSet ? new platform.InvSet() : null;
+  this._keys = {};
+  this._size = 0;
+}
+
+/**
+ * Add vectors to the set.
+ * @param {(Buffer[]|Buffer)} vectors - Vectors to add
+ * @return {number} Number of vectors which were not in the set.
+ */
+InvSet.prototype.add = function(vectors) {
+  var packed = packVectors(vectors);
+  if (this._native) {
+    return this._native.insert(packed);
+  }
+  var added = 0;
+  for (var i = 0; i < packed.length; i += 32) {
+    var key = packed.toString("hex", i, i + 32);
+    if (!this._keys[key]) {
+      this._keys[key] = true;
+      added++;
+    }
+  }
+  this._size += added;
+  return added;
+};
+
+/**
+ * Check whether the vector is in the set.
+ * @param {Buffer} vector - A 32-byte vector
+ * @return {boolean}
+ */
+InvSet.prototype.has = function(vector) {
+  assert(vector.length === 32, "Bad vector length");
+  if (this._native) {
+    return this._native.contains(vector);
+  }
+  return !!this._keys[vector.toString("hex")];
+};
+
+/**
+ * Find vectors missing from the set, e.g. to request them with
+ * `getdata`.
+ * @param {(Buffer[]|Buffer)} vectors - Vectors to check
+ * @return {Buffer} Packed missing vectors in the input order.
+ */
+InvSet.prototype.diff = function(vectors) {
+  var packed = packVectors(vectors);
+  if (this._native) {
+    return this._native.diff(packed);
+  }
+  var missing = [];
+  for (var i = 0; i < packed.length; i += 32) {
+    if (!this._keys[packed.toString("hex", i, i + 32)]) {
+      missing.push(packed.slice(i, i + 32));
+    }
+  }
+  return Buffer.concat(missing);
+};
+
+/**
+ * Number of vectors in the set.
+ * @return {number}
+ */
+InvSet.prototype.size = function() {
+  return this._native ? this._native.size() : this._size;
 };
 
 /**
@@ -10,14 +10,53 @@ function sha512(buf) {
   return new Sha512().update(buf).digest();
 }
 
+// Nonces are passed to WebAssembly kernel as doubles.
+var MAX_WASM_NONCE = 9007199254740991;
+// Nonces per kernel call, well below int32 index limit. Worker is
+// terminated to stop the search so it doesn't need to be small.
+var WASM_CHUNK = 1048576;
+
+// Search with WebAssembly kernel, see `src/pow_wasm.cc`. Throws if the
+// module can't be instantiated so the caller falls back to `pow`.
+function powWasm(opts) {
+  var instance = new WebAssembly.Instance(opts.wasm, {});
+  var search = instance.exports.pow_wasm_search;
+  var memory = new Uint8Array(instance.exports.memory.buffer);
+  memory.set(opts.initialHash, instance.exports.pow_wasm_hash());
+  var nonce = opts.start + opts.num * opts.stride;
+  var step = opts.poolSize * opts.stride;
+  var end = opts.end;
+  var count, i;
+
+  while (true) {
+    if (nonce > MAX_WASM_NONCE) {
+      return -1;
+    }
+    if (nonce >= end) {
+      return -2;
+    }
+    count = Math.min(
+      WASM_CHUNK,
+      Math.ceil((end - nonce) / step),
+      Math.floor((MAX_WASM_NONCE - nonce) / step) + 1
+    );
+    i = search(opts.targetHi, opts.targetLo, nonce, step, count);
+    if (i >= 0) {
+      return nonce + i * step;
+    }
+    nonce += count * step;
+  }
+}
+
 function pow(opts) {
-  var nonce = opts.num;
-  var poolSize = opts.poolSize;
+  var nonce = opts.start + opts.num * opts.stride;
+  var step = opts.poolSize * opts.stride;
+  var end = opts.end;
   var message = new Buffer(72);
   message.fill(0);
   Buffer(opts.initialHash).copy(message, 8);
-  var targetHi = Math.floor(opts.target / 4294967296);
-  var targetLo = opts.target % 4294967296;
+  var targetHi = opts.targetHi;
+  var targetLo = opts.targetLo;
   var digest, trialHi, trialLo;
 
   while (true) {
@@ -26,17 +65,21 @@ function pow(opts) {
     if (nonce > 4294967295) {
       return -1;
     }
+    // This worker's part of the range is searched.
+    if (nonce >= end) {
+      return -2;
+    }
 
     message.writeUInt32BE(nonce, 4, true);
     digest = sha512(sha512(message));
     trialHi = digest.readUInt32BE(0, true);
 
     if (trialHi > targetHi) {
-      nonce += poolSize;
+      nonce += step;
     } else if (trialHi === targetHi) {
       trialLo = digest.readUInt32BE(4, true);
       if (trialLo > targetLo) {
-        nonce += poolSize;
+        nonce += step;
       } else {
         return nonce;
       }
@@ -48,6 +91,15 @@ function pow(opts) {
 
 module.exports = function(self) {
   self.onmessage = function(e) {
-    self.postMessage(pow(e.data));
+    var opts = e.data;
+    if (opts.wasm) {
+      try {
+        self.postMessage(powWasm(opts));
+        return;
+      } catch(err) {
+        // Fall back to JS loop below.
+      }
+    }
+    self.postMessage(pow(opts));
   };
 };
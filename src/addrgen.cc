@@ -0,0 +1,356 @@
+// Address key search, see `Address.fromRandom` and
+// `Address.fromPassphrase` for the JS version.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+#include <openssl/rand.h>
+#include <openssl/ripemd.h>
+#include <openssl/sha.h>
+#include "./addrgen.h"
+#include "./pow.h"
+#include "./threads.h"
+
+#define PUBLIC_KEY_SIZE 65
+#define RIPE_SIZE 20
+// Candidates checked per call, so the EC context is not allocated for
+// every one of them. Random keys are walked by longer runs to amortize
+// the scalar multiplication and inversion, see `check_random`.
+#define PASSPHRASE_BATCH 8
+#define RANDOM_BATCH 256
+
+struct AddrSearch {
+  int mode;
+  size_t min_length;
+  size_t max_length;
+  // Shared read-only by all threads.
+  EC_GROUP* group;
+  BIGNUM* order;
+  // ADDR_RANDOM: signing key is fixed, encryption key of the first
+  // found match is stored.
+  uint8_t sign_private[PRIVATE_KEY_SIZE];
+  uint8_t sign_public[PUBLIC_KEY_SIZE];
+  PowMutex mutex;
+  bool found;
+  uint8_t enc_private[PRIVATE_KEY_SIZE];
+  // ADDR_PASSPHRASE
+  uint8_t* passphrase;
+  size_t passphrase_length;
+};
+
+// Per call scratch of the EC math.
+typedef struct {
+  BN_CTX* ctx;
+  BIGNUM* key;
+  EC_POINT* point;
+} AddrScratch;
+
+static bool scratch_init(const AddrSearch* search, AddrScratch* scratch) {
+  scratch->ctx = BN_CTX_new();
+  scratch->key = BN_new();
+  scratch->point = EC_POINT_new(search->group);
+  return scratch->ctx && scratch->key && scratch->point;
+}
+
+static void scratch_free(AddrScratch* scratch) {
+  EC_POINT_free(scratch->point);
+  BN_free(scratch->key);
+  BN_CTX_free(scratch->ctx);
+}
+
+// Serialize affine point as uncompressed public key.
+static bool point_to_public(const AddrSearch* search,
+                            AddrScratch* scratch,
+                            const EC_POINT* point,
+                            uint8_t* public_key) {
+  return EC_POINT_point2oct(search->group, point,
+                            POINT_CONVERSION_UNCOMPRESSED,
+                            public_key, PUBLIC_KEY_SIZE,
+                            scratch->ctx) == PUBLIC_KEY_SIZE;
+}
+
+// Write big-endian zero padded private key.
+static void key_to_private(const BIGNUM* key, uint8_t* private_key) {
+  size_t length = BN_num_bytes(key);
+  memset(private_key, 0, PRIVATE_KEY_SIZE - length);
+  BN_bn2bin(key, private_key + PRIVATE_KEY_SIZE - length);
+}
+
+// Derive uncompressed public key. Fails on invalid private key.
+static bool get_public(const AddrSearch* search,
+                       AddrScratch* scratch,
+                       const uint8_t* private_key,
+                       uint8_t* public_key) {
+  if (!BN_bin2bn(private_key, PRIVATE_KEY_SIZE, scratch->key) ||
+      BN_is_zero(scratch->key) ||
+      BN_cmp(scratch->key, search->order) >= 0) {
+    return false;
+  }
+  return EC_POINT_mul(search->group, scratch->point, scratch->key,
+                      NULL, NULL, scratch->ctx) &&
+         point_to_public(search, scratch, scratch->point, public_key);
+}
+
+// Whether ripe of the key pair has the wanted length.
+static bool check_ripe(const AddrSearch* search,
+                       const uint8_t* sign_public,
+                       const uint8_t* enc_public) {
+  uint8_t keys[PUBLIC_KEY_SIZE * 2];
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  uint8_t ripe[RIPE_SIZE];
+  memcpy(keys, sign_public, PUBLIC_KEY_SIZE);
+  memcpy(keys + PUBLIC_KEY_SIZE, enc_public, PUBLIC_KEY_SIZE);
+  SHA512(keys, sizeof(keys), hash);
+  RIPEMD160(hash, sizeof(hash), ripe);
+  size_t zeroes = 0;
+  while (zeroes < RIPE_SIZE && ripe[zeroes] == 0) {
+    zeroes++;
+  }
+  size_t length = RIPE_SIZE - zeroes;
+  return length >= search->min_length && length <= search->max_length;
+}
+
+// Encode Bitmessage `var_int`, returns its length.
+static size_t encode_var_int(uint64_t value, uint8_t* buf) {
+  size_t length;
+  if (value < 253) {
+    buf[0] = (uint8_t)value;
+    return 1;
+  } else if (value <= 0xffff) {
+    buf[0] = 253;
+    length = 2;
+  } else if (value <= 0xffffffff) {
+    buf[0] = 254;
+    length = 4;
+  } else {
+    buf[0] = 255;
+    length = 8;
+  }
+  for (size_t i = 0; i < length; i++) {
+    buf[length - i] = (uint8_t)(value >> (i * 8));
+  }
+  return length + 1;
+}
+
+// Private key is the first half of `sha512(passphrase || var_int(n))`.
+static void derive_private(const AddrSearch* search,
+                           uint64_t n,
+                           uint8_t* private_key) {
+  uint8_t encoded[9];
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  SHA512_CTX sha;
+  SHA512_Init(&sha);
+  SHA512_Update(&sha, search->passphrase, search->passphrase_length);
+  SHA512_Update(&sha, encoded, encode_var_int(n, encoded));
+  SHA512_Final(hash, &sha);
+  memcpy(private_key, hash, PRIVATE_KEY_SIZE);
+}
+
+// Candidate `i` of the passphrase search uses nonces `2i` and `2i+1`,
+// the same order as in JS.
+static void derive_pair(const AddrSearch* search,
+                        uint64_t i,
+                        uint8_t* sign_private,
+                        uint8_t* enc_private) {
+  derive_private(search, i * 2, sign_private);
+  derive_private(search, i * 2 + 1, enc_private);
+}
+
+// Encryption keys are walked as consecutive points from a random start
+// `k`: kG, (k+1)G, (k+2)G, ... Every next one is a single point
+// addition instead of a scalar multiplication, and points of the run
+// are converted to affine coordinates at once with one modular
+// inversion. Start is uniform and the run never wraps around the group
+// order, so every key is as valid as the `getPrivate` one.
+static bool check_random(void* ctx,
+                         uint64_t nonce,
+                         size_t count,
+                         uint64_t* found) {
+  AddrSearch* search = (AddrSearch*)ctx;
+  const EC_GROUP* group = search->group;
+  AddrScratch scratch = {NULL, NULL, NULL};
+  uint8_t start[PRIVATE_KEY_SIZE];
+  uint8_t enc_private[PRIVATE_KEY_SIZE];
+  uint8_t enc_public[PUBLIC_KEY_SIZE];
+  bool matched = false;
+  size_t i;
+  EC_POINT** points = (EC_POINT**)calloc(count, sizeof(EC_POINT*));
+  BIGNUM* limit = BN_new();
+  bool ok = points && limit && scratch_init(search, &scratch);
+  for (i = 0; ok && i < count; i++) {
+    points[i] = EC_POINT_new(group);
+    ok = points[i] != NULL;
+  }
+  // Keys are [k, k + count) so k must be below `order - count`.
+  ok = ok &&
+       BN_copy(limit, search->order) &&
+       BN_sub_word(limit, count);
+  do {
+    ok = ok &&
+         RAND_bytes(start, PRIVATE_KEY_SIZE) == 1 &&
+         BN_bin2bn(start, PRIVATE_KEY_SIZE, scratch.key);
+  } while (ok && (BN_is_zero(scratch.key) ||
+                  BN_cmp(scratch.key, limit) >= 0));
+  ok = ok && EC_POINT_mul(group, points[0], scratch.key,
+                          NULL, NULL, scratch.ctx);
+  for (i = 1; ok && i < count; i++) {
+    ok = EC_POINT_add(group, points[i], points[i - 1],
+                      EC_GROUP_get0_generator(group), scratch.ctx);
+  }
+  ok = ok && EC_POINTs_make_affine(group, count, points, scratch.ctx);
+
+  for (i = 0; ok && i < count && !matched; i++) {
+    matched = point_to_public(search, &scratch, points[i], enc_public) &&
+              check_ripe(search, search->sign_public, enc_public);
+  }
+  if (matched && BN_add_word(scratch.key, i - 1)) {
+    key_to_private(scratch.key, enc_private);
+    // Any match will do, keep the first one.
+    pow_mutex_lock(&search->mutex);
+    if (!search->found) {
+      memcpy(search->enc_private, enc_private, PRIVATE_KEY_SIZE);
+      search->found = true;
+    }
+    pow_mutex_unlock(&search->mutex);
+    *found = nonce + i - 1;
+  } else {
+    matched = false;
+  }
+
+  for (i = 0; points && i < count; i++) {
+    EC_POINT_free(points[i]);
+  }
+  free(points);
+  BN_free(limit);
+  scratch_free(&scratch);
+  return matched;
+}
+
+static bool check_passphrase(void* ctx,
+                             uint64_t nonce,
+                             size_t count,
+                             uint64_t* found) {
+  AddrSearch* search = (AddrSearch*)ctx;
+  AddrScratch scratch;
+  uint8_t sign_private[PRIVATE_KEY_SIZE];
+  uint8_t enc_private[PRIVATE_KEY_SIZE];
+  uint8_t sign_public[PUBLIC_KEY_SIZE];
+  uint8_t enc_public[PUBLIC_KEY_SIZE];
+  bool matched = false;
+  if (!scratch_init(search, &scratch)) {
+    scratch_free(&scratch);
+    return false;
+  }
+  for (size_t i = 0; i < count && !matched; i++) {
+    derive_pair(search, nonce + i, sign_private, enc_private);
+    matched = get_public(search, &scratch, sign_private, sign_public) &&
+              get_public(search, &scratch, enc_private, enc_public) &&
+              check_ripe(search, sign_public, enc_public);
+    if (matched) {
+      *found = nonce + i;
+    }
+  }
+  scratch_free(&scratch);
+  return matched;
+}
+
+AddrSearch* addr_search_new(int mode,
+                            const uint8_t* passphrase,
+                            size_t passphrase_length,
+                            size_t min_length,
+                            size_t max_length) {
+  if ((mode != ADDR_RANDOM && mode != ADDR_PASSPHRASE) ||
+      min_length < 1 ||
+      min_length > max_length ||
+      max_length > RIPE_SIZE) {
+    return NULL;
+  }
+  AddrSearch* search = (AddrSearch*)calloc(1, sizeof(AddrSearch));
+  if (!search) {
+    return NULL;
+  }
+  pow_mutex_init(&search->mutex);
+  search->mode = mode;
+  search->min_length = min_length;
+  search->max_length = max_length;
+  search->group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+  search->order = BN_new();
+  AddrScratch scratch = {NULL, NULL, NULL};
+  bool ok = search->group &&
+            search->order &&
+            scratch_init(search, &scratch) &&
+            EC_GROUP_get_order(search->group, search->order, scratch.ctx) &&
+            // Speeds up multiplication by the generator a lot.
+            EC_GROUP_precompute_mult(search->group, scratch.ctx);
+  if (ok && mode == ADDR_RANDOM) {
+    // Retry in the unlikely case of invalid key.
+    do {
+      ok = RAND_bytes(search->sign_private, PRIVATE_KEY_SIZE) == 1;
+    } while (ok && !get_public(search, &scratch,
+                               search->sign_private, search->sign_public));
+  } else if (ok) {
+    search->passphrase = (uint8_t*)malloc(passphrase_length + 1);
+    search->passphrase_length = passphrase_length;
+    ok = search->passphrase != NULL;
+    if (ok && passphrase_length) {
+      memcpy(search->passphrase, passphrase, passphrase_length);
+    }
+  }
+  scratch_free(&scratch);
+  if (!ok) {
+    addr_search_free(search);
+    return NULL;
+  }
+  return search;
+}
+
+void addr_search_free(AddrSearch* search) {
+  pow_mutex_destroy(&search->mutex);
+  EC_GROUP_free(search->group);
+  BN_free(search->order);
+  OPENSSL_cleanse(search->sign_private, PRIVATE_KEY_SIZE);
+  OPENSSL_cleanse(search->enc_private, PRIVATE_KEY_SIZE);
+  if (search->passphrase) {
+    OPENSSL_cleanse(search->passphrase, search->passphrase_length);
+  }
+  free(search->passphrase);
+  free(search);
+}
+
+PowJob* addr_search_job(AddrSearch* search, size_t pool_size) {
+  PowSearch job_search;
+  job_search.check =
+    search->mode == ADDR_RANDOM ? check_random : check_passphrase;
+  job_search.ctx = search;
+  job_search.batch =
+    search->mode == ADDR_RANDOM ? RANDOM_BATCH : PASSPHRASE_BATCH;
+  job_search.lowest = search->mode == ADDR_PASSPHRASE;
+  PowJob* job = pow_job_new_search(pool_size, &job_search, 0);
+  if (job) {
+    // Don't wait for POW jobs to finish.
+    pow_job_set_priority(job, POW_PRIORITY_URGENT, 0);
+  }
+  return job;
+}
+
+bool addr_search_keys(AddrSearch* search,
+                      uint64_t nonce,
+                      uint8_t* sign_private,
+                      uint8_t* enc_private) {
+  if (search->mode == ADDR_PASSPHRASE) {
+    derive_pair(search, nonce, sign_private, enc_private);
+    return true;
+  }
+  pow_mutex_lock(&search->mutex);
+  bool found = search->found;
+  if (found) {
+    memcpy(sign_private, search->sign_private, PRIVATE_KEY_SIZE);
+    memcpy(enc_private, search->enc_private, PRIVATE_KEY_SIZE);
+  }
+  pow_mutex_unlock(&search->mutex);
+  return found;
+}
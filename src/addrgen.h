@@ -0,0 +1,44 @@
+#ifndef BITCHAN_BITMESSAGE_ADDRGEN_H_
+#define BITCHAN_BITMESSAGE_ADDRGEN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./pow.h"
+
+static const size_t PRIVATE_KEY_SIZE = 32;
+
+enum AddrMode {
+  // Random encryption keys for a random signing key. Keys are taken
+  // by runs of consecutive ones starting from a random point.
+  ADDR_RANDOM = 0,
+  // Deterministic key pairs derived from the passphrase.
+  ADDR_PASSPHRASE = 1
+};
+
+// Search for keys whose ripe, with leading zero bytes stripped, is
+// `min_length` to `max_length` bytes long. Candidates are the same as
+// `Address.fromRandom` and `Address.fromPassphrase` ones; the
+// passphrase search returns the first matching pair so it gives the
+// same address.
+typedef struct AddrSearch AddrSearch;
+
+// Returns NULL on bad input.
+AddrSearch* addr_search_new(int mode,
+                            const uint8_t* passphrase,
+                            size_t passphrase_length,
+                            size_t min_length,
+                            size_t max_length);
+
+void addr_search_free(AddrSearch* search);
+
+// Create pool job searching keys. Search must outlive the job.
+PowJob* addr_search_job(AddrSearch* search, size_t pool_size);
+
+// Fill the private keys for the candidate found by the job. Returns
+// false if nothing was found.
+bool addr_search_keys(AddrSearch* search,
+                      uint64_t nonce,
+                      uint8_t* sign_private,
+                      uint8_t* enc_private);
+
+#endif  // BITCHAN_BITMESSAGE_ADDRGEN_H_
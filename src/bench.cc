@@ -0,0 +1,352 @@
+// Standalone POW benchmark. Measures single-thread throughput of every
+// double SHA-512 kernel available on this CPU against the reference
+// OpenSSL one and then scaling of the thread pool with the default
+// kernel, with unpinned and pinned threads.
+//
+// Usage: bitmessage-bench [--json] [--seconds=N] [--pool-sizes=1,2,4]
+//                         [--placements=none,spread,physical]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "./pow.h"
+#include "./sha512.h"
+#include "./threads.h"
+#include "./topology.h"
+
+// Fixed initial hash so results are comparable between runs.
+static const uint8_t INITIAL_HASH[HASH_SIZE] = {
+  0x8f, 0xf2, 0xd6, 0x85, 0xdb, 0x89, 0xa0, 0xaf, 0x2e, 0x3d, 0xbf, 0xd3,
+  0xf7, 0x00, 0xae, 0x96, 0xef, 0x4d, 0x9a, 0x1e, 0xac, 0x72, 0xfd, 0x77,
+  0x8b, 0xbb, 0x36, 0x8c, 0x75, 0x10, 0xcd, 0xdd, 0xa3, 0x49, 0xe0, 0x32,
+  0x07, 0xe1, 0xc4, 0x96, 0x5b, 0xd9, 0x5c, 0x6f, 0x72, 0x65, 0xe8, 0xf1,
+  0xa4, 0x81, 0xa0, 0x8a, 0xfa, 0xb3, 0x87, 0x4e, 0xaa, 0xfb, 0x9a, 0xde,
+  0x09, 0xa1, 0x08, 0x80,
+};
+
+// Unreachable target so pool runs are stopped only by the timer.
+static const uint64_t SWEEP_TARGET = 0;
+// Easy target to check `pow` results with, ~64K trials on average.
+static const uint64_t CHECK_TARGET = 0xffffffffffffffffULL >> 16;
+
+static double now() {
+  return pow_now_ns() / 1e9;
+}
+
+// Thread placements to compare: not pinned, pinned spreading over
+// cores before SMT siblings and pinned to the first siblings only.
+static const char* PLACEMENTS[] = {"none", "spread", "physical"};
+static const size_t PLACEMENT_COUNT = 3;
+
+typedef struct {
+  bool json;
+  double seconds;
+  std::vector<size_t> pool_sizes;
+  std::vector<size_t> placements;
+} BenchOptions;
+
+typedef struct {
+  const PowKernel* kernel;
+  double rate;
+} KernelResult;
+
+typedef struct {
+  size_t placement;
+  size_t pool_size;
+  double rate;
+  bool valid;
+} PoolResult;
+
+// Return number of double hashes per second.
+static double measure(const PowKernel* kernel,
+                      const PowBlock* block,
+                      double seconds) {
+  static const uint64_t BATCH = 4096;
+  uint64_t nonces[MAX_LANES] = {0};
+  uint64_t trials[MAX_LANES];
+  uint64_t total = 0;
+  uint64_t sink = 0;
+  double start = now();
+  double elapsed;
+  do {
+    for (uint64_t i = 0; i < BATCH; i++) {
+      for (size_t lane = 0; lane < kernel->lanes; lane++) {
+        nonces[lane] = total + lane;
+      }
+      kernel->fn(block, nonces, trials);
+      sink ^= trials[0];
+      total += kernel->lanes;
+    }
+    elapsed = now() - start;
+  } while (elapsed < seconds);
+  // Don't let compiler throw the work away.
+  if (sink == 1) {
+    fprintf(stderr, "\n");
+  }
+  return total / elapsed;
+}
+
+typedef struct {
+  PowMutex mutex;
+  PowCond cond;
+  bool done;
+} BenchWait;
+
+static void on_done(PowJob*, void* data) {
+  BenchWait* wait = (BenchWait*)data;
+  pow_mutex_lock(&wait->mutex);
+  wait->done = true;
+  pow_cond_signal(&wait->cond);
+  pow_mutex_unlock(&wait->mutex);
+}
+
+static bool set_placement(size_t placement) {
+  PowAffinity affinity = {placement != 0, placement == 2, -1, 0, NULL};
+  return pow_set_affinity(&affinity) == RESULT_OK;
+}
+
+// Return hashes per second of the whole pool of the given size.
+static double measure_pool(size_t pool_size, double seconds) {
+  pow_shutdown();
+  if (pow_set_pool_size(pool_size)) {
+    return 0;
+  }
+  PowJob* job = pow_job_new(pool_size, SWEEP_TARGET, INITIAL_HASH, 0);
+  if (!job) {
+    return 0;
+  }
+  BenchWait wait = {POW_MUTEX_INITIALIZER, POW_COND_INITIALIZER, false};
+  PowStats stats = {0, 0};
+  if (pow_submit(job, on_done, &wait) == RESULT_OK) {
+    pow_sleep_ns((uint64_t)(seconds * 1e9));
+    pow_job_stats(job, &stats, NULL, 0);
+    pow_cancel(job);
+    pow_mutex_lock(&wait.mutex);
+    while (!wait.done) {
+      pow_cond_wait(&wait.cond, &wait.mutex);
+    }
+    pow_mutex_unlock(&wait.mutex);
+  }
+  pow_job_free(job);
+  return stats.elapsed ? stats.trials * 1e9 / stats.elapsed : 0;
+}
+
+// Solve an easy target with the pool and verify the nonce with the
+// reference kernel.
+static bool check_pool(size_t pool_size, const PowBlock* block) {
+  uint64_t nonce;
+  if (pow(pool_size, CHECK_TARGET, INITIAL_HASH, 0, &nonce) != RESULT_OK) {
+    return false;
+  }
+  uint64_t nonces[MAX_LANES] = {nonce};
+  uint64_t trials[MAX_LANES];
+  pow_kernel_find("openssl")->fn(block, nonces, trials);
+  return trials[0] <= CHECK_TARGET;
+}
+
+static bool parse_pool_sizes(const char* arg, std::vector<size_t>* sizes) {
+  sizes->clear();
+  while (*arg) {
+    char* end;
+    unsigned long size = strtoul(arg, &end, 10);
+    if (end == arg || size < 1 || size > MAX_POOL_SIZE) {
+      return false;
+    }
+    sizes->push_back(size);
+    arg = *end == ',' ? end + 1 : end;
+    if (*end && *end != ',') {
+      return false;
+    }
+  }
+  return !sizes->empty();
+}
+
+// Powers of two up to the number of CPUs plus the number of CPUs
+// itself, so both SMT and non-SMT configurations are visible.
+static void default_pool_sizes(std::vector<size_t>* sizes) {
+  size_t max_size = pow_topology()->count;
+  if (max_size > MAX_POOL_SIZE) {
+    max_size = MAX_POOL_SIZE;
+  }
+  for (size_t size = 1; size < max_size; size *= 2) {
+    sizes->push_back(size);
+  }
+  sizes->push_back(max_size);
+}
+
+static bool parse_placements(const char* arg, std::vector<size_t>* list) {
+  list->clear();
+  while (*arg) {
+    size_t length = strcspn(arg, ",");
+    size_t i;
+    for (i = 0; i < PLACEMENT_COUNT; i++) {
+      if (strlen(PLACEMENTS[i]) == length &&
+          strncmp(arg, PLACEMENTS[i], length) == 0) {
+        break;
+      }
+    }
+    if (i == PLACEMENT_COUNT) {
+      return false;
+    }
+    list->push_back(i);
+    arg += length;
+    if (*arg == ',') {
+      arg++;
+    }
+  }
+  return !list->empty();
+}
+
+// Physical-only placement differs from the spread one only on SMT
+// machines.
+static void default_placements(std::vector<size_t>* list) {
+  const PowTopology* topology = pow_topology();
+  list->push_back(0);
+  list->push_back(1);
+  if (topology->cores < topology->count) {
+    list->push_back(2);
+  }
+}
+
+static bool parse_options(int argc, char** argv, BenchOptions* opts) {
+  opts->json = false;
+  opts->seconds = 1.0;
+  default_pool_sizes(&opts->pool_sizes);
+  default_placements(&opts->placements);
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--json") == 0) {
+      opts->json = true;
+    } else if (strncmp(arg, "--seconds=", 10) == 0) {
+      opts->seconds = atof(arg + 10);
+      if (opts->seconds <= 0) {
+        return false;
+      }
+    } else if (strncmp(arg, "--pool-sizes=", 13) == 0) {
+      if (!parse_pool_sizes(arg + 13, &opts->pool_sizes)) {
+        return false;
+      }
+    } else if (strncmp(arg, "--placements=", 13) == 0) {
+      if (!parse_placements(arg + 13, &opts->placements)) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void print_table(const std::vector<KernelResult>& kernels,
+                        double reference,
+                        const std::vector<PoolResult>& pools) {
+  printf("%-10s %6s %12s %8s\n", "kernel", "lanes", "hashes/s", "speedup");
+  for (size_t i = 0; i < kernels.size(); i++) {
+    const KernelResult& r = kernels[i];
+    printf("%-10s %6zu %12.0f %7.2fx\n",
+           r.kernel->name, r.kernel->lanes, r.rate, r.rate / reference);
+  }
+  const PowTopology* topology = pow_topology();
+  printf("\ncpus: %zu, cores: %zu, packages: %zu, nodes: %zu\n",
+         topology->count, topology->cores, topology->packages,
+         topology->nodes);
+  printf("pool kernel: %s\n", pow_kernel_select()->name);
+  printf("%-10s %-10s %12s %12s %10s %6s\n", "placement", "pool_size",
+         "hashes/s", "per thread", "efficiency", "check");
+  double base = pools.empty() ? 0 : pools[0].rate / pools[0].pool_size;
+  for (size_t i = 0; i < pools.size(); i++) {
+    const PoolResult& r = pools[i];
+    double per_thread = r.rate / r.pool_size;
+    printf("%-10s %-10zu %12.0f %12.0f %9.1f%% %6s\n",
+           PLACEMENTS[r.placement], r.pool_size, r.rate, per_thread,
+           base ? per_thread / base * 100 : 0, r.valid ? "ok" : "FAIL");
+  }
+}
+
+// Efficiency is per-thread rate relative to the first measurement, so
+// sweep should start from 1 to get the classic definition.
+static void print_json(const std::vector<KernelResult>& kernels,
+                       double reference,
+                       const std::vector<PoolResult>& pools) {
+  const PowTopology* topology = pow_topology();
+  printf("{\n");
+  printf("  \"cpus\": %zu,\n", topology->count);
+  printf("  \"cores\": %zu,\n", topology->cores);
+  printf("  \"packages\": %zu,\n", topology->packages);
+  printf("  \"nodes\": %zu,\n", topology->nodes);
+  printf("  \"reference_hashrate\": %.0f,\n", reference);
+  printf("  \"kernels\": [\n");
+  for (size_t i = 0; i < kernels.size(); i++) {
+    const KernelResult& r = kernels[i];
+    printf("    {\"name\": \"%s\", \"lanes\": %zu, \"hashrate\": %.0f, "
+           "\"speedup\": %.3f}%s\n",
+           r.kernel->name, r.kernel->lanes, r.rate, r.rate / reference,
+           i + 1 < kernels.size() ? "," : "");
+  }
+  printf("  ],\n");
+  printf("  \"pool_kernel\": \"%s\",\n", pow_kernel_select()->name);
+  printf("  \"pool\": [\n");
+  double base = pools.empty() ? 0 : pools[0].rate / pools[0].pool_size;
+  for (size_t i = 0; i < pools.size(); i++) {
+    const PoolResult& r = pools[i];
+    double per_thread = r.rate / r.pool_size;
+    printf("    {\"placement\": \"%s\", \"pool_size\": %zu, "
+           "\"hashrate\": %.0f, \"per_thread\": %.0f, "
+           "\"efficiency\": %.3f, \"valid\": %s}%s\n",
+           PLACEMENTS[r.placement], r.pool_size, r.rate, per_thread,
+           base ? per_thread / base : 0,
+           r.valid ? "true" : "false", i + 1 < pools.size() ? "," : "");
+  }
+  printf("  ]\n");
+  printf("}\n");
+}
+
+int main(int argc, char** argv) {
+  BenchOptions opts;
+  if (!parse_options(argc, argv, &opts)) {
+    fprintf(stderr,
+            "Usage: %s [--json] [--seconds=N] [--pool-sizes=1,2,4] "
+            "[--placements=none,spread,physical]\n",
+            argv[0]);
+    return 1;
+  }
+
+  PowBlock block;
+  pow_block_init(&block, INITIAL_HASH);
+  double reference =
+    measure(pow_kernel_find("openssl"), &block, opts.seconds);
+
+  std::vector<KernelResult> kernels;
+  const PowKernel* kernel;
+  for (size_t i = 0; (kernel = pow_kernel_at(i)) != NULL; i++) {
+    KernelResult r = {kernel, measure(kernel, &block, opts.seconds)};
+    kernels.push_back(r);
+  }
+
+  std::vector<PoolResult> pools;
+  bool valid = true;
+  for (size_t p = 0; p < opts.placements.size(); p++) {
+    size_t placement = opts.placements[p];
+    if (!set_placement(placement)) {
+      continue;
+    }
+    for (size_t i = 0; i < opts.pool_sizes.size(); i++) {
+      size_t pool_size = opts.pool_sizes[i];
+      PoolResult r = {placement, pool_size,
+                      measure_pool(pool_size, opts.seconds),
+                      check_pool(pool_size, &block)};
+      valid = valid && r.valid;
+      pools.push_back(r);
+    }
+  }
+  pow_shutdown();
+
+  if (opts.json) {
+    print_json(kernels, reference, pools);
+  } else {
+    print_table(kernels, reference, pools);
+  }
+  return valid ? 0 : 2;
+}
@@ -0,0 +1,138 @@
+// Bulk list codecs, see `structs.var_int_list` for the JS version.
+
+#include <stdint.h>
+#include <string.h>
+#include "./codecs.h"
+
+static const uint8_t IPV4_MAPPING[12] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff,
+};
+
+static const uint8_t IPV6_LOOPBACK[16] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+};
+
+static uint64_t read_be(const uint8_t* p, size_t size) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < size; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+// The same ranges as `isPrivateIp` of messages.js.
+static bool is_private_ip(const uint8_t* ip) {
+  if (memcmp(ip, IPV4_MAPPING, sizeof(IPV4_MAPPING)) == 0) {
+    const uint8_t* v4 = ip + sizeof(IPV4_MAPPING);
+    return v4[0] == 127 ||
+           v4[0] == 10 ||
+           (v4[0] == 192 && v4[1] == 168) ||
+           (v4[0] == 172 && (v4[1] & 0xf0) == 0x10) ||
+           (v4[0] == 169 && v4[1] == 254);
+  }
+  return memcmp(ip, IPV6_LOOPBACK, sizeof(IPV6_LOOPBACK)) == 0 ||
+         (ip[0] == 0xfe && (ip[1] & 0xc0) == 0x80) ||
+         (ip[0] & 0xfe) == 0xfc;
+}
+
+int codec_var_int_decode(const uint8_t* buf,
+                         size_t length,
+                         uint64_t* value,
+                         size_t* size) {
+  if (length < 1) {
+    return CODEC_TRUNCATED;
+  }
+  size_t value_size;
+  uint64_t min;
+  switch (buf[0]) {
+    case 253:
+      value_size = 2;
+      min = 253;
+      break;
+    case 254:
+      value_size = 4;
+      min = 65536;
+      break;
+    case 255:
+      value_size = 8;
+      min = 4294967296ULL;
+      break;
+    default:
+      *value = buf[0];
+      *size = 1;
+      return CODEC_OK;
+  }
+  if (length < 1 + value_size) {
+    return CODEC_TRUNCATED;
+  }
+  *value = read_be(buf + 1, value_size);
+  *size = 1 + value_size;
+  if (*value < min) {
+    return CODEC_IMPRACTICAL;
+  }
+  if (*value > CODEC_MAX_SAFE_INTEGER) {
+    return CODEC_UNSAFE;
+  }
+  return CODEC_OK;
+}
+
+size_t codec_var_int_size(uint64_t value) {
+  if (value < 253) {
+    return 1;
+  } else if (value < 65536) {
+    return 3;
+  } else if (value < 4294967296ULL) {
+    return 5;
+  }
+  return 9;
+}
+
+size_t codec_var_int_encode(uint64_t value, uint8_t* out) {
+  size_t size = codec_var_int_size(value);
+  if (size == 1) {
+    out[0] = (uint8_t)value;
+    return 1;
+  }
+  out[0] = size == 3 ? 253 : size == 5 ? 254 : 255;
+  for (size_t i = size - 1; i >= 1; i--) {
+    out[i] = (uint8_t)value;
+    value >>= 8;
+  }
+  return size;
+}
+
+int codec_var_int_list_decode(const uint8_t* buf,
+                              size_t length,
+                              size_t count,
+                              double* values,
+                              size_t* size) {
+  size_t pos = *size;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t value;
+    size_t value_size;
+    int error = codec_var_int_decode(buf + pos, length - pos,
+                                     &value, &value_size);
+    if (error) {
+      return error;
+    }
+    values[i] = (double)value;
+    pos += value_size;
+  }
+  *size = pos;
+  return CODEC_OK;
+}
+
+size_t codec_addr_filter(const uint8_t* entries,
+                         size_t count,
+                         uint8_t* out) {
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* entry = entries + i * CODEC_ADDR_SIZE;
+    // Time, stream, services precede the IP.
+    if (!is_private_ip(entry + 20)) {
+      memmove(out + kept * CODEC_ADDR_SIZE, entry, CODEC_ADDR_SIZE);
+      kept++;
+    }
+  }
+  return kept;
+}
@@ -0,0 +1,50 @@
+#ifndef BITCHAN_BITMESSAGE_CODECS_H_
+#define BITCHAN_BITMESSAGE_CODECS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Bulk codecs of protocol lists, see `structs.var_int_list` and
+// `messages.addr`.
+
+static const uint64_t CODEC_MAX_SAFE_INTEGER = 9007199254740991ULL;
+static const size_t CODEC_VAR_INT_MAX_SIZE = 9;
+static const size_t CODEC_ADDR_SIZE = 38;
+
+enum {
+  CODEC_OK = 0,
+  CODEC_TRUNCATED = 1,
+  // Value could be encoded shorter.
+  CODEC_IMPRACTICAL = 2,
+  // Value doesn't fit JS number.
+  CODEC_UNSAFE = 3,
+};
+
+// Decode `var_int` at the start of the buffer, `size` is set to its
+// encoded length.
+int codec_var_int_decode(const uint8_t* buf,
+                         size_t length,
+                         uint64_t* value,
+                         size_t* size);
+
+// Encode `var_int` into `out` (at least `CODEC_VAR_INT_MAX_SIZE` bytes),
+// returns its length.
+size_t codec_var_int_encode(uint64_t value, uint8_t* out);
+
+size_t codec_var_int_size(uint64_t value);
+
+// Decode `count` var_ints following the list length, `size` is
+// advanced past them.
+int codec_var_int_list_decode(const uint8_t* buf,
+                              size_t length,
+                              size_t count,
+                              double* values,
+                              size_t* size);
+
+// Copy `net_addr` entries with public IPs to `out`, return their
+// number.
+size_t codec_addr_filter(const uint8_t* entries,
+                         size_t count,
+                         uint8_t* out);
+
+#endif  // BITCHAN_BITMESSAGE_CODECS_H_
@@ -0,0 +1,259 @@
+// Parallel trial decryption, see `tryDecryptMsg` for the JS version.
+// Follows eccrypto: shared secret is the X coordinate of ECDH point,
+// its SHA-512 is split into AES-256-CBC and HMAC-SHA-256 keys, MAC
+// covers IV, ephemeral public key and ciphertext.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/bn.h>
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+#include "./decrypt.h"
+#include "./pow.h"
+
+#define IV_SIZE 16
+#define COORD_SIZE 32
+#define PUBLIC_KEY_SIZE 65
+#define MAC_SIZE 32
+// IV, curve type, X length, X, Y length, Y, ciphertext, MAC.
+#define HEADER_SIZE (IV_SIZE + 2 + 2 + COORD_SIZE + 2 + COORD_SIZE)
+#define MIN_PAYLOAD_SIZE (HEADER_SIZE + MAC_SIZE)
+#define SECP256K1_TYPE 714
+// Keys checked per call, so the EC context is not allocated for every
+// one of them.
+#define DECRYPT_BATCH 16
+
+struct DecryptSearch {
+  // Shared read-only by all threads.
+  EC_GROUP* group;
+  BIGNUM* order;
+  EC_POINT* ephem_public;
+  // IV, ephemeral public key and ciphertext, in the MAC order.
+  uint8_t* data;
+  size_t data_length;
+  uint8_t mac[MAC_SIZE];
+  uint8_t* keys;
+  size_t key_count;
+};
+
+// Per call scratch of the EC math.
+typedef struct {
+  BN_CTX* ctx;
+  BIGNUM* key;
+  BIGNUM* x;
+  EC_POINT* point;
+} DecryptScratch;
+
+static bool scratch_init(const DecryptSearch* search,
+                         DecryptScratch* scratch) {
+  scratch->ctx = BN_CTX_new();
+  scratch->key = BN_new();
+  scratch->x = BN_new();
+  scratch->point = EC_POINT_new(search->group);
+  return scratch->ctx && scratch->key && scratch->x && scratch->point;
+}
+
+static void scratch_free(DecryptScratch* scratch) {
+  EC_POINT_free(scratch->point);
+  BN_free(scratch->x);
+  BN_free(scratch->key);
+  BN_CTX_free(scratch->ctx);
+}
+
+static uint16_t read_u16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+// Compute SHA-512 of the shared secret of the given key, the first half
+// is encryption key and the second is MAC key. Fails on invalid private
+// key.
+static bool derive_keys(const DecryptSearch* search,
+                        DecryptScratch* scratch,
+                        const uint8_t* private_key,
+                        uint8_t* hash) {
+  uint8_t secret[COORD_SIZE];
+  if (!BN_bin2bn(private_key, DECRYPT_KEY_SIZE, scratch->key) ||
+      BN_is_zero(scratch->key) ||
+      BN_cmp(scratch->key, search->order) >= 0 ||
+      !EC_POINT_mul(search->group, scratch->point, NULL,
+                    search->ephem_public, scratch->key, scratch->ctx) ||
+      !EC_POINT_get_affine_coordinates_GFp(search->group, scratch->point,
+                                           scratch->x, NULL,
+                                           scratch->ctx)) {
+    return false;
+  }
+  // Zero padded big-endian X.
+  size_t length = BN_num_bytes(scratch->x);
+  memset(secret, 0, COORD_SIZE - length);
+  BN_bn2bin(scratch->x, secret + COORD_SIZE - length);
+  SHA512(secret, COORD_SIZE, hash);
+  return true;
+}
+
+static bool check_mac(const DecryptSearch* search, const uint8_t* mac_key) {
+  uint8_t mac[MAC_SIZE];
+  unsigned int mac_length = 0;
+  if (!HMAC(EVP_sha256(), mac_key, SHA512_DIGEST_LENGTH / 2,
+            search->data, search->data_length, mac, &mac_length) ||
+      mac_length != MAC_SIZE) {
+    return false;
+  }
+  return CRYPTO_memcmp(mac, search->mac, MAC_SIZE) == 0;
+}
+
+static bool check_keys(void* ctx,
+                       uint64_t nonce,
+                       size_t count,
+                       uint64_t* found) {
+  DecryptSearch* search = (DecryptSearch*)ctx;
+  DecryptScratch scratch;
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  bool matched = false;
+  if (!scratch_init(search, &scratch)) {
+    scratch_free(&scratch);
+    OPENSSL_cleanse(hash, sizeof(hash));
+    return false;
+  }
+  for (uint64_t i = nonce; i < nonce + count && i < search->key_count; i++) {
+    const uint8_t* key = search->keys + i * DECRYPT_KEY_SIZE;
+    if (derive_keys(search, &scratch, key, hash) &&
+        check_mac(search, hash + SHA512_DIGEST_LENGTH / 2)) {
+      *found = i;
+      matched = true;
+      break;
+    }
+  }
+  scratch_free(&scratch);
+  OPENSSL_cleanse(hash, sizeof(hash));
+  return matched;
+}
+
+DecryptSearch* decrypt_search_new(const uint8_t* payload,
+                                  size_t length,
+                                  const uint8_t* keys,
+                                  size_t key_count) {
+  if (length < MIN_PAYLOAD_SIZE ||
+      read_u16(payload + IV_SIZE) != SECP256K1_TYPE ||
+      read_u16(payload + IV_SIZE + 2) != COORD_SIZE ||
+      read_u16(payload + IV_SIZE + 4 + COORD_SIZE) != COORD_SIZE ||
+      !key_count) {
+    return NULL;
+  }
+  DecryptSearch* search = (DecryptSearch*)calloc(1, sizeof(DecryptSearch));
+  if (!search) {
+    return NULL;
+  }
+  size_t ciphertext_length = length - MIN_PAYLOAD_SIZE;
+  search->data_length = IV_SIZE + PUBLIC_KEY_SIZE + ciphertext_length;
+  search->data = (uint8_t*)malloc(search->data_length);
+  search->keys = (uint8_t*)malloc(key_count * DECRYPT_KEY_SIZE);
+  search->key_count = key_count;
+  search->group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+  search->order = BN_new();
+  bool ok = search->data && search->keys && search->group && search->order;
+  if (ok) {
+    uint8_t* public_key = search->data + IV_SIZE;
+    memcpy(search->data, payload, IV_SIZE);
+    public_key[0] = POINT_CONVERSION_UNCOMPRESSED;
+    memcpy(public_key + 1, payload + IV_SIZE + 4, COORD_SIZE);
+    memcpy(public_key + 1 + COORD_SIZE,
+           payload + IV_SIZE + 6 + COORD_SIZE,
+           COORD_SIZE);
+    memcpy(public_key + PUBLIC_KEY_SIZE,
+           payload + HEADER_SIZE,
+           ciphertext_length);
+    memcpy(search->mac, payload + length - MAC_SIZE, MAC_SIZE);
+    memcpy(search->keys, keys, key_count * DECRYPT_KEY_SIZE);
+    BN_CTX* ctx = BN_CTX_new();
+    search->ephem_public = EC_POINT_new(search->group);
+    // Point is validated to be on the curve.
+    ok = ctx &&
+         search->ephem_public &&
+         EC_GROUP_get_order(search->group, search->order, ctx) &&
+         EC_POINT_oct2point(search->group, search->ephem_public,
+                            public_key, PUBLIC_KEY_SIZE, ctx);
+    BN_CTX_free(ctx);
+  }
+  if (!ok) {
+    decrypt_search_free(search);
+    return NULL;
+  }
+  return search;
+}
+
+void decrypt_search_free(DecryptSearch* search) {
+  EC_POINT_free(search->ephem_public);
+  EC_GROUP_free(search->group);
+  BN_free(search->order);
+  if (search->keys) {
+    OPENSSL_cleanse(search->keys, search->key_count * DECRYPT_KEY_SIZE);
+  }
+  free(search->keys);
+  free(search->data);
+  free(search);
+}
+
+PowJob* decrypt_search_job(DecryptSearch* search, size_t pool_size) {
+  PowSearch job_search;
+  job_search.check = check_keys;
+  job_search.ctx = search;
+  job_search.batch = DECRYPT_BATCH;
+  // The same key as the serial search would pick.
+  job_search.lowest = true;
+  PowJob* job = pow_job_new_search(pool_size, &job_search, 0);
+  if (job && pow_job_set_range(job, 0, search->key_count, 1)) {
+    pow_job_free(job);
+    return NULL;
+  }
+  if (job) {
+    // Received objects wait for it.
+    pow_job_set_priority(job, POW_PRIORITY_URGENT, 0);
+  }
+  return job;
+}
+
+bool decrypt_search_plaintext(DecryptSearch* search,
+                              uint64_t index,
+                              uint8_t** plaintext,
+                              size_t* length) {
+  DecryptScratch scratch;
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  const uint8_t* iv = search->data;
+  const uint8_t* ciphertext = search->data + IV_SIZE + PUBLIC_KEY_SIZE;
+  int ciphertext_length =
+    (int)(search->data_length - IV_SIZE - PUBLIC_KEY_SIZE);
+  int update_length = 0;
+  int final_length = 0;
+  if (index >= search->key_count) {
+    return false;
+  }
+  bool ok = scratch_init(search, &scratch) &&
+            derive_keys(search, &scratch,
+                        search->keys + index * DECRYPT_KEY_SIZE, hash) &&
+            check_mac(search, hash + SHA512_DIGEST_LENGTH / 2);
+  scratch_free(&scratch);
+  // CBC output is never longer than the input.
+  uint8_t* out = (uint8_t*)malloc(ciphertext_length + 1);
+  EVP_CIPHER_CTX* cipher = EVP_CIPHER_CTX_new();
+  ok = ok &&
+       out &&
+       cipher &&
+       EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, hash, iv) &&
+       EVP_DecryptUpdate(cipher, out, &update_length,
+                         ciphertext, ciphertext_length) &&
+       EVP_DecryptFinal_ex(cipher, out + update_length, &final_length);
+  EVP_CIPHER_CTX_free(cipher);
+  OPENSSL_cleanse(hash, sizeof(hash));
+  if (!ok) {
+    free(out);
+    return false;
+  }
+  *plaintext = out;
+  *length = (size_t)(update_length + final_length);
+  return true;
+}
@@ -0,0 +1,37 @@
+#ifndef BITCHAN_BITMESSAGE_DECRYPT_H_
+#define BITCHAN_BITMESSAGE_DECRYPT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./pow.h"
+
+static const size_t DECRYPT_KEY_SIZE = 32;
+
+// Trial decryption of one ECIES payload (`crypto.encrypted` format of
+// eccrypto) with many private keys. Every candidate is a key index; it
+// matches if the MAC computed from its ECDH shared secret is correct.
+typedef struct DecryptSearch DecryptSearch;
+
+// Copies the payload and `key_count` packed 32-byte keys. Returns NULL
+// if payload is malformed or there are no keys.
+DecryptSearch* decrypt_search_new(const uint8_t* payload,
+                                  size_t length,
+                                  const uint8_t* keys,
+                                  size_t key_count);
+
+void decrypt_search_free(DecryptSearch* search);
+
+// Create pool job checking the keys. The lowest matching index is
+// reported, the job fails with `RESULT_NOT_FOUND` if no key matches.
+// Search must outlive the job.
+PowJob* decrypt_search_job(DecryptSearch* search, size_t pool_size);
+
+// Decrypt the payload with the key found by the job. `plaintext` is
+// allocated with malloc and must be freed by the caller. Returns false
+// if key is wrong or padding is bad.
+bool decrypt_search_plaintext(DecryptSearch* search,
+                              uint64_t index,
+                              uint8_t** plaintext,
+                              size_t* length);
+
+#endif  // BITCHAN_BITMESSAGE_DECRYPT_H_
@@ -0,0 +1,240 @@
+// Native stream framer, see `Framer` of structs.js.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include "./framer.h"
+
+// Initial arena size, enough for most of socket reads.
+#define MIN_ARENA_SIZE 65536
+
+static const uint8_t MAGIC[4] = {0xE9, 0xBE, 0xB4, 0xD9};
+
+struct Framer {
+  uint8_t* data;
+  size_t length;
+  size_t capacity;
+  // Bytes of the too large message which are still to be dropped.
+  uint64_t skip;
+};
+
+static uint32_t read_u32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) |
+         ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) |
+         (uint32_t)p[3];
+}
+
+// Return position of the magic or of the magic's prefix at the end of
+// the buffer, or -1.
+static ptrdiff_t find_magic(const uint8_t* buf, size_t length) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + length;
+  while ((p = (const uint8_t*)memchr(p, MAGIC[0], end - p)) != NULL) {
+    size_t left = end - p < 4 ? (size_t)(end - p) : 4;
+    if (memcmp(p, MAGIC, left) == 0) {
+      return p - buf;
+    }
+    p++;
+  }
+  return -1;
+}
+
+static bool reserve(Framer* framer, size_t capacity) {
+  if (capacity <= framer->capacity) {
+    return true;
+  }
+  size_t size = framer->capacity ? framer->capacity : MIN_ARENA_SIZE;
+  while (size < capacity) {
+    size *= 2;
+  }
+  uint8_t* data = (uint8_t*)realloc(framer->data, size);
+  if (!data) {
+    return false;
+  }
+  framer->data = data;
+  framer->capacity = size;
+  return true;
+}
+
+static bool append_message(FramerBatch* batch,
+                           size_t* capacity,
+                           const FramerMessage* message) {
+  if (batch->count == *capacity) {
+    size_t size = *capacity ? *capacity * 2 : 16;
+    FramerMessage* messages = (FramerMessage*)realloc(
+      batch->messages, size * sizeof(FramerMessage));
+    if (!messages) {
+      return false;
+    }
+    batch->messages = messages;
+    *capacity = size;
+  }
+  batch->messages[batch->count++] = *message;
+  return true;
+}
+
+// Command is NUL padded ASCII.
+static bool read_command(const uint8_t* p, char* command) {
+  size_t length = 0;
+  for (size_t i = 0; i < FRAMER_COMMAND_SIZE; i++) {
+    if (p[i] > 127) {
+      return false;
+    }
+    if (p[i]) {
+      length = i + 1;
+    }
+  }
+  memcpy(command, p, length);
+  command[length] = 0;
+  return true;
+}
+
+static bool check_checksum(const uint8_t* header, const uint8_t* payload,
+                           size_t length) {
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  SHA512(payload, length, hash);
+  return memcmp(header + 20, hash, 4) == 0;
+}
+
+Framer* framer_new() {
+  return (Framer*)calloc(1, sizeof(Framer));
+}
+
+void framer_free(Framer* framer) {
+  free(framer->data);
+  free(framer);
+}
+
+bool framer_push(Framer* framer, const uint8_t* data, size_t length) {
+  if (framer->skip) {
+    size_t skipped = framer->skip < length ? (size_t)framer->skip : length;
+    framer->skip -= skipped;
+    data += skipped;
+    length -= skipped;
+  }
+  if (!reserve(framer, framer->length + length)) {
+    return false;
+  }
+  // Empty chunk may come with NULL data.
+  if (length) {
+    memcpy(framer->data + framer->length, data, length);
+  }
+  framer->length += length;
+  return true;
+}
+
+bool framer_take(Framer* framer, FramerBatch* batch) {
+  const uint8_t* data = framer->data;
+  size_t pos = 0;
+  size_t capacity = 0;
+  size_t next_length = 0;
+  uint64_t skip = 0;
+  bool has_payloads = false;
+  bool ok = true;
+  memset(batch, 0, sizeof(FramerBatch));
+
+  while (framer->length - pos >= FRAMER_HEADER_SIZE) {
+    size_t avail = framer->length - pos;
+    const uint8_t* header = data + pos;
+    FramerMessage message;
+    memset(&message, 0, sizeof(message));
+    message.offset = pos;
+
+    if (memcmp(header, MAGIC, 4) != 0) {
+      ptrdiff_t index = find_magic(header, avail);
+      if (index < 0) {
+        message.status = FRAMER_MAGIC_NOT_FOUND;
+        message.length = avail;
+      } else {
+        message.status = FRAMER_MAGIC_IN_MIDDLE;
+        message.length = (size_t)index;
+      }
+      if (!append_message(batch, &capacity, &message)) {
+        ok = false;
+        break;
+      }
+      pos += message.length;
+      continue;
+    }
+
+    uint32_t payload_length = read_u32(header + 16);
+    size_t message_length = FRAMER_HEADER_SIZE + (size_t)payload_length;
+    if (payload_length > FRAMER_MAX_PAYLOAD_SIZE) {
+      message.status = FRAMER_TOO_LARGE;
+      if (!append_message(batch, &capacity, &message)) {
+        ok = false;
+        break;
+      }
+      // Drop the rest of the message as it arrives instead of buffering
+      // it.
+      uint64_t full = FRAMER_HEADER_SIZE + (uint64_t)payload_length;
+      if (avail >= full) {
+        pos += (size_t)full;
+      } else {
+        skip = full - avail;
+        pos = framer->length;
+      }
+      continue;
+    }
+    if (avail < message_length) {
+      next_length = message_length;
+      break;
+    }
+
+    if (!read_command(header + 4, message.command)) {
+      message.status = FRAMER_BAD_COMMAND;
+    } else if (!check_checksum(header, header + FRAMER_HEADER_SIZE,
+                               payload_length)) {
+      message.status = FRAMER_BAD_CHECKSUM;
+    } else {
+      message.status = FRAMER_OK;
+      message.offset = pos + FRAMER_HEADER_SIZE;
+      message.length = payload_length;
+      has_payloads = true;
+    }
+    if (!append_message(batch, &capacity, &message)) {
+      ok = false;
+      break;
+    }
+    pos += message_length;
+  }
+
+  uint8_t* arena = NULL;
+  size_t size = MIN_ARENA_SIZE;
+  size_t tail = framer->length - pos;
+  if (ok && pos && has_payloads) {
+    while (size < tail || size < next_length) {
+      size *= 2;
+    }
+    arena = (uint8_t*)malloc(size);
+    ok = arena != NULL;
+  }
+  if (!ok) {
+    framer_batch_free(batch);
+    return false;
+  }
+
+  if (pos) {
+    if (has_payloads) {
+      // Hand the consumed part over and move the tail to a new arena.
+      memcpy(arena, data + pos, tail);
+      batch->arena = framer->data;
+      batch->arena_length = pos;
+      framer->data = arena;
+      framer->capacity = size;
+    } else {
+      memmove(framer->data, data + pos, tail);
+    }
+    framer->length = tail;
+    framer->skip += skip;
+  }
+  return true;
+}
+
+void framer_batch_free(FramerBatch* batch) {
+  free(batch->messages);
+  batch->messages = NULL;
+  batch->count = 0;
+}
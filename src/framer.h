@@ -0,0 +1,63 @@
+#ifndef BITCHAN_BITMESSAGE_FRAMER_H_
+#define BITCHAN_BITMESSAGE_FRAMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Incremental framer of the peer message stream, see
+// `structs.message.tryDecode` for the JS version. Socket data is
+// appended to the arena; complete messages are cut off in batches and
+// the consumed part of the arena is handed to the caller, so payloads
+// can be used in place. Only the incomplete tail is ever copied.
+typedef struct Framer Framer;
+
+static const size_t FRAMER_HEADER_SIZE = 24;
+static const size_t FRAMER_COMMAND_SIZE = 12;
+// See: <https://github.com/Bitmessage/PyBitmessage/issues/767>.
+static const size_t FRAMER_MAX_PAYLOAD_SIZE = 1600003;
+
+// Message status, every error but the last two skips some data without
+// a message.
+enum {
+  FRAMER_OK = 0,
+  FRAMER_MAGIC_NOT_FOUND = 1,
+  FRAMER_MAGIC_IN_MIDDLE = 2,
+  FRAMER_TOO_LARGE = 3,
+  FRAMER_BAD_COMMAND = 4,
+  FRAMER_BAD_CHECKSUM = 5,
+};
+
+typedef struct {
+  int status;
+  // NUL terminated, valid only for `FRAMER_OK`.
+  char command[FRAMER_COMMAND_SIZE + 1];
+  // Position of the payload in the batch arena.
+  size_t offset;
+  size_t length;
+} FramerMessage;
+
+typedef struct {
+  // Consumed part of the arena, allocated with malloc and owned by the
+  // caller. NULL if there are no complete messages.
+  uint8_t* arena;
+  size_t arena_length;
+  FramerMessage* messages;
+  size_t count;
+} FramerBatch;
+
+Framer* framer_new();
+
+void framer_free(Framer* framer);
+
+// Append received data. Returns false if out of memory.
+bool framer_push(Framer* framer, const uint8_t* data, size_t length);
+
+// Cut off all complete messages verifying their checksums. Errors are
+// reported in the stream order together with messages. Returns false if
+// out of memory, framer is unchanged then.
+bool framer_take(Framer* framer, FramerBatch* batch);
+
+// Release the messages array, `arena` is left to the caller.
+void framer_batch_free(FramerBatch* batch);
+
+#endif  // BITCHAN_BITMESSAGE_FRAMER_H_
@@ -0,0 +1,198 @@
+// Inventory vectors hashing and dedup set, see `structs.inv_vect`.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include "./inventory.h"
+
+#define MIN_CAPACITY 1024
+
+// Slots are kept at most 3/4 full; `used` marks occupied slots since
+// the all-zero vector is valid too.
+struct InvSet {
+  InvHashKey key;
+  uint8_t* vectors;
+  uint8_t* used;
+  size_t capacity;
+  size_t size;
+};
+
+static uint64_t read_u64_le(const uint8_t* p) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+static uint64_t rotl(uint64_t x, int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+#define SIP_ROUND(v0, v1, v2, v3) \
+  do {                            \
+    v0 += v1;                     \
+    v1 = rotl(v1, 13);            \
+    v1 ^= v0;                     \
+    v0 = rotl(v0, 32);            \
+    v2 += v3;                     \
+    v3 = rotl(v3, 16);            \
+    v3 ^= v2;                     \
+    v0 += v3;                     \
+    v3 = rotl(v3, 21);            \
+    v3 ^= v0;                     \
+    v2 += v1;                     \
+    v1 = rotl(v1, 17);            \
+    v1 ^= v2;                     \
+    v2 = rotl(v2, 32);            \
+  } while (0)
+
+bool inv_hash_key_new(InvHashKey* key) {
+  uint8_t bytes[16];
+  if (RAND_bytes(bytes, sizeof(bytes)) != 1) {
+    return false;
+  }
+  key->k0 = read_u64_le(bytes);
+  key->k1 = read_u64_le(bytes + 8);
+  return true;
+}
+
+uint64_t inv_vector_hash(const InvHashKey* key, const uint8_t* vector) {
+  uint64_t v0 = key->k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = key->k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = key->k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = key->k1 ^ 0x7465646279746573ULL;
+  for (size_t i = 0; i <= INV_VECTOR_SIZE; i += 8) {
+    // The last block only holds the message length.
+    uint64_t m = i < INV_VECTOR_SIZE ?
+      read_u64_le(vector + i) :
+      (uint64_t)INV_VECTOR_SIZE << 56;
+    v3 ^= m;
+    SIP_ROUND(v0, v1, v2, v3);
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+  v2 ^= 0xff;
+  for (int i = 0; i < 4; i++) {
+    SIP_ROUND(v0, v1, v2, v3);
+  }
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Return slot of the vector or of the free slot where it belongs.
+static size_t find_slot(const InvSet* set, const uint8_t* vector) {
+  size_t mask = set->capacity - 1;
+  size_t i = (size_t)inv_vector_hash(&set->key, vector) & mask;
+  while (set->used[i] &&
+         memcmp(set->vectors + i * INV_VECTOR_SIZE, vector,
+                INV_VECTOR_SIZE) != 0) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static bool set_alloc(InvSet* set, size_t capacity) {
+  set->vectors = (uint8_t*)malloc(capacity * INV_VECTOR_SIZE);
+  set->used = (uint8_t*)calloc(capacity, 1);
+  if (!set->vectors || !set->used) {
+    free(set->vectors);
+    free(set->used);
+    return false;
+  }
+  set->capacity = capacity;
+  return true;
+}
+
+static bool grow(InvSet* set) {
+  InvSet old = *set;
+  if (!set_alloc(set, old.capacity * 2)) {
+    *set = old;
+    return false;
+  }
+  for (size_t i = 0; i < old.capacity; i++) {
+    if (old.used[i]) {
+      const uint8_t* vector = old.vectors + i * INV_VECTOR_SIZE;
+      size_t slot = find_slot(set, vector);
+      memcpy(set->vectors + slot * INV_VECTOR_SIZE, vector, INV_VECTOR_SIZE);
+      set->used[slot] = 1;
+    }
+  }
+  free(old.vectors);
+  free(old.used);
+  return true;
+}
+
+void inv_hash_batch(const uint8_t* const* payloads,
+                    const size_t* lengths,
+                    size_t count,
+                    uint8_t* out) {
+  uint8_t hash[SHA512_DIGEST_LENGTH];
+  for (size_t i = 0; i < count; i++) {
+    SHA512(payloads[i], lengths[i], hash);
+    SHA512(hash, SHA512_DIGEST_LENGTH, hash);
+    memcpy(out + i * INV_VECTOR_SIZE, hash, INV_VECTOR_SIZE);
+  }
+}
+
+InvSet* inv_set_new() {
+  InvSet* set = (InvSet*)calloc(1, sizeof(InvSet));
+  if (set && (!inv_hash_key_new(&set->key) ||
+              !set_alloc(set, MIN_CAPACITY))) {
+    free(set);
+    return NULL;
+  }
+  return set;
+}
+
+void inv_set_free(InvSet* set) {
+  free(set->vectors);
+  free(set->used);
+  free(set);
+}
+
+size_t inv_set_size(const InvSet* set) {
+  return set->size;
+}
+
+bool inv_set_insert(InvSet* set,
+                    const uint8_t* vectors,
+                    size_t count,
+                    size_t* added) {
+  *added = 0;
+  for (size_t i = 0; i < count; i++) {
+    if ((set->size + 1) * 4 > set->capacity * 3 && !grow(set)) {
+      return false;
+    }
+    const uint8_t* vector = vectors + i * INV_VECTOR_SIZE;
+    size_t slot = find_slot(set, vector);
+    if (!set->used[slot]) {
+      memcpy(set->vectors + slot * INV_VECTOR_SIZE, vector, INV_VECTOR_SIZE);
+      set->used[slot] = 1;
+      set->size++;
+      (*added)++;
+    }
+  }
+  return true;
+}
+
+bool inv_set_contains(const InvSet* set, const uint8_t* vector) {
+  return set->used[find_slot(set, vector)] != 0;
+}
+
+size_t inv_set_diff(const InvSet* set,
+                    const uint8_t* vectors,
+                    size_t count,
+                    uint8_t* out) {
+  size_t missing = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* vector = vectors + i * INV_VECTOR_SIZE;
+    if (!inv_set_contains(set, vector)) {
+      // May overlap if the input is used for output.
+      memmove(out + missing * INV_VECTOR_SIZE, vector, INV_VECTOR_SIZE);
+      missing++;
+    }
+  }
+  return missing;
+}
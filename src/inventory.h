@@ -0,0 +1,58 @@
+#ifndef BITCHAN_BITMESSAGE_INVENTORY_H_
+#define BITCHAN_BITMESSAGE_INVENTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const size_t INV_VECTOR_SIZE = 32;
+
+// Write inventory vectors (first 32 bytes of double SHA-512) of `count`
+// objects into the flat `out` buffer.
+void inv_hash_batch(const uint8_t* const* payloads,
+                    const size_t* lengths,
+                    size_t count,
+                    uint8_t* out);
+
+// Key of `inv_vector_hash`, random per table.
+typedef struct {
+  uint64_t k0;
+  uint64_t k1;
+} InvHashKey;
+
+// Generate a new random key. Returns false if there is no entropy.
+bool inv_hash_key_new(InvHashKey* key);
+
+// SipHash-2-4 of the vector. Vectors come from peers unverified, so
+// their own bytes can't be used as the slot index: a peer could send
+// ones with the same low bits and make probing quadratic.
+uint64_t inv_vector_hash(const InvHashKey* key, const uint8_t* vector);
+
+// Open-addressing set of inventory vectors, slots are picked with
+// `inv_vector_hash`.
+typedef struct InvSet InvSet;
+
+InvSet* inv_set_new();
+
+void inv_set_free(InvSet* set);
+
+size_t inv_set_size(const InvSet* set);
+
+// Insert `count` packed vectors, setting `added` to the number of ones
+// which were not in the set. Returns false if out of memory, vectors
+// inserted till then stay in the set.
+bool inv_set_insert(InvSet* set,
+                    const uint8_t* vectors,
+                    size_t count,
+                    size_t* added);
+
+bool inv_set_contains(const InvSet* set, const uint8_t* vector);
+
+// Copy vectors missing from the set into `out` (which must fit `count`
+// of them) and return their number. Order is kept, duplicates of the
+// input are not removed.
+size_t inv_set_diff(const InvSet* set,
+                    const uint8_t* vectors,
+                    size_t count,
+                    uint8_t* out);
+
+#endif  // BITCHAN_BITMESSAGE_INVENTORY_H_
@@ -0,0 +1,365 @@
+// OpenCL POW device module. It's built as a separate loadable module
+// (see binding.gyp) so the addon doesn't depend on OpenCL runtime;
+// worker loads it on demand and falls back to CPU if it's missing or
+// there are no GPUs.
+
+#define __STDC_LIMIT_MACROS
+#define CL_TARGET_OPENCL_VERSION 120
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#include "./pow.h"
+
+// Every work item checks one nonce: message is the nonce followed by
+// initial hash so both SHA-512 rounds fit in a single block. The lowest
+// matching index of the call is kept in `result`.
+static const char KERNEL_SOURCE[] =
+"#define ROTR(x, n) rotate((x), (ulong)(64 - (n)))\n"
+"#define CH(x, y, z) bitselect((z), (y), (x))\n"
+"#define MAJ(x, y, z) bitselect((x), (y), (x) ^ (z))\n"
+"#define S0(x) (ROTR(x, 28) ^ ROTR(x, 34) ^ ROTR(x, 39))\n"
+"#define S1(x) (ROTR(x, 14) ^ ROTR(x, 18) ^ ROTR(x, 41))\n"
+"#define G0(x) (ROTR(x, 1) ^ ROTR(x, 8) ^ ((x) >> 7))\n"
+"#define G1(x) (ROTR(x, 19) ^ ROTR(x, 61) ^ ((x) >> 6))\n"
+"\n"
+"__constant ulong K[80] = {\n"
+"  0x428a2f98d728ae22UL, 0x7137449123ef65cdUL, 0xb5c0fbcfec4d3b2fUL,\n"
+"  0xe9b5dba58189dbbcUL, 0x3956c25bf348b538UL, 0x59f111f1b605d019UL,\n"
+"  0x923f82a4af194f9bUL, 0xab1c5ed5da6d8118UL, 0xd807aa98a3030242UL,\n"
+"  0x12835b0145706fbeUL, 0x243185be4ee4b28cUL, 0x550c7dc3d5ffb4e2UL,\n"
+"  0x72be5d74f27b896fUL, 0x80deb1fe3b1696b1UL, 0x9bdc06a725c71235UL,\n"
+"  0xc19bf174cf692694UL, 0xe49b69c19ef14ad2UL, 0xefbe4786384f25e3UL,\n"
+"  0x0fc19dc68b8cd5b5UL, 0x240ca1cc77ac9c65UL, 0x2de92c6f592b0275UL,\n"
+"  0x4a7484aa6ea6e483UL, 0x5cb0a9dcbd41fbd4UL, 0x76f988da831153b5UL,\n"
+"  0x983e5152ee66dfabUL, 0xa831c66d2db43210UL, 0xb00327c898fb213fUL,\n"
+"  0xbf597fc7beef0ee4UL, 0xc6e00bf33da88fc2UL, 0xd5a79147930aa725UL,\n"
+"  0x06ca6351e003826fUL, 0x142929670a0e6e70UL, 0x27b70a8546d22ffcUL,\n"
+"  0x2e1b21385c26c926UL, 0x4d2c6dfc5ac42aedUL, 0x53380d139d95b3dfUL,\n"
+"  0x650a73548baf63deUL, 0x766a0abb3c77b2a8UL, 0x81c2c92e47edaee6UL,\n"
+"  0x92722c851482353bUL, 0xa2bfe8a14cf10364UL, 0xa81a664bbc423001UL,\n"
+"  0xc24b8b70d0f89791UL, 0xc76c51a30654be30UL, 0xd192e819d6ef5218UL,\n"
+"  0xd69906245565a910UL, 0xf40e35855771202aUL, 0x106aa07032bbd1b8UL,\n"
+"  0x19a4c116b8d2d0c8UL, 0x1e376c085141ab53UL, 0x2748774cdf8eeb99UL,\n"
+"  0x34b0bcb5e19b48a8UL, 0x391c0cb3c5c95a63UL, 0x4ed8aa4ae3418acbUL,\n"
+"  0x5b9cca4f7763e373UL, 0x682e6ff3d6b2b8a3UL, 0x748f82ee5defb2fcUL,\n"
+"  0x78a5636f43172f60UL, 0x84c87814a1f0ab72UL, 0x8cc702081a6439ecUL,\n"
+"  0x90befffa23631e28UL, 0xa4506cebde82bde9UL, 0xbef9a3f7b2c67915UL,\n"
+"  0xc67178f2e372532bUL, 0xca273eceea26619cUL, 0xd186b8c721c0c207UL,\n"
+"  0xeada7dd6cde0eb1eUL, 0xf57d4f7fee6ed178UL, 0x06f067aa72176fbaUL,\n"
+"  0x0a637dc5a2c898a6UL, 0x113f9804bef90daeUL, 0x1b710b35131c471bUL,\n"
+"  0x28db77f523047d84UL, 0x32caab7b40c72493UL, 0x3c9ebe0a15c9bebcUL,\n"
+"  0x431d67c49c100d4cUL, 0x4cc5d4becb3e42b6UL, 0x597f299cfc657e2aUL,\n"
+"  0x5fcb6fab3ad6faecUL, 0x6c44198c4a475817UL\n"
+"};\n"
+"\n"
+"__constant ulong IV[8] = {\n"
+"  0x6a09e667f3bcc908UL, 0xbb67ae8584caa73bUL, 0x3c6ef372fe94f82bUL,\n"
+"  0xa54ff53a5f1d36f1UL, 0x510e527fade682d1UL, 0x9b05688c2b3e6c1fUL,\n"
+"  0x1f83d9abfb41bd6bUL, 0x5be0cd19137e2179UL\n"
+"};\n"
+"\n"
+"// Hash single padded block `w`, which is overwritten.\n"
+"void sha512_block(ulong* state, ulong* w) {\n"
+"  ulong a = IV[0], b = IV[1], c = IV[2], d = IV[3];\n"
+"  ulong e = IV[4], f = IV[5], g = IV[6], h = IV[7];\n"
+"  for (int i = 0; i < 80; i++) {\n"
+"    ulong wi;\n"
+"    if (i < 16) {\n"
+"      wi = w[i];\n"
+"    } else {\n"
+"      wi = G1(w[(i - 2) & 15]) + w[(i - 7) & 15] +\n"
+"           G0(w[(i - 15) & 15]) + w[i & 15];\n"
+"      w[i & 15] = wi;\n"
+"    }\n"
+"    ulong t1 = h + S1(e) + CH(e, f, g) + K[i] + wi;\n"
+"    ulong t2 = S0(a) + MAJ(a, b, c);\n"
+"    h = g; g = f; f = e; e = d + t1;\n"
+"    d = c; c = b; b = a; a = t1 + t2;\n"
+"  }\n"
+"  state[0] = IV[0] + a; state[1] = IV[1] + b;\n"
+"  state[2] = IV[2] + c; state[3] = IV[3] + d;\n"
+"  state[4] = IV[4] + e; state[5] = IV[5] + f;\n"
+"  state[6] = IV[6] + g; state[7] = IV[7] + h;\n"
+"}\n"
+"\n"
+"__kernel void pow_search(__constant ulong* hash,\n"
+"                         ulong target,\n"
+"                         ulong start,\n"
+"                         ulong stride,\n"
+"                         ulong count,\n"
+"                         volatile __global uint* result) {\n"
+"  size_t index = get_global_id(0);\n"
+"  if (index >= count) {\n"
+"    return;\n"
+"  }\n"
+"  ulong w[16];\n"
+"  ulong state[8];\n"
+"  int i;\n"
+"  w[0] = start + index * stride;\n"
+"  for (i = 0; i < 8; i++) {\n"
+"    w[i + 1] = hash[i];\n"
+"  }\n"
+"  w[9] = 0x8000000000000000UL;\n"
+"  for (i = 10; i < 15; i++) {\n"
+"    w[i] = 0;\n"
+"  }\n"
+"  w[15] = 72 * 8;\n"
+"  sha512_block(state, w);\n"
+"  for (i = 0; i < 8; i++) {\n"
+"    w[i] = state[i];\n"
+"  }\n"
+"  w[8] = 0x8000000000000000UL;\n"
+"  for (i = 9; i < 15; i++) {\n"
+"    w[i] = 0;\n"
+"  }\n"
+"  w[15] = 64 * 8;\n"
+"  sha512_block(state, w);\n"
+"  if (state[0] <= target) {\n"
+"    atomic_min(result, (uint)index);\n"
+"  }\n"
+"}\n";
+
+static const cl_uint NO_RESULT = UINT32_MAX;
+static const size_t MAX_LOCAL_SIZE = 256;
+// Enough work items to keep every compute unit busy.
+static const size_t MIN_GROUPS_PER_UNIT = 16;
+
+typedef struct {
+  cl_context context;
+  cl_command_queue queue;
+  cl_program program;
+  cl_kernel kernel;
+  cl_mem hash;
+  cl_mem result;
+  size_t local_size;
+} OpenClDevice;
+
+static void close_device(OpenClDevice* device) {
+  if (device->result) {
+    clReleaseMemObject(device->result);
+  }
+  if (device->hash) {
+    clReleaseMemObject(device->hash);
+  }
+  if (device->kernel) {
+    clReleaseKernel(device->kernel);
+  }
+  if (device->program) {
+    clReleaseProgram(device->program);
+  }
+  if (device->queue) {
+    clReleaseCommandQueue(device->queue);
+  }
+  if (device->context) {
+    clReleaseContext(device->context);
+  }
+  free(device);
+}
+
+// Returns NULL if the device can't run the kernel.
+static OpenClDevice* open_device(cl_device_id id) {
+  OpenClDevice* device = (OpenClDevice*)calloc(1, sizeof(OpenClDevice));
+  if (!device) {
+    return NULL;
+  }
+  const char* source = KERNEL_SOURCE;
+  cl_int error;
+  device->context = clCreateContext(NULL, 1, &id, NULL, NULL, &error);
+  if (error == CL_SUCCESS) {
+    device->queue = clCreateCommandQueue(device->context, id, 0, &error);
+  }
+  if (error == CL_SUCCESS) {
+    device->program = clCreateProgramWithSource(device->context,
+                                                1,
+                                                &source,
+                                                NULL,
+                                                &error);
+  }
+  if (error == CL_SUCCESS) {
+    error = clBuildProgram(device->program, 1, &id, "", NULL, NULL);
+  }
+  if (error == CL_SUCCESS) {
+    device->kernel = clCreateKernel(device->program, "pow_search", &error);
+  }
+  if (error == CL_SUCCESS) {
+    device->hash = clCreateBuffer(device->context,
+                                  CL_MEM_READ_ONLY,
+                                  HASH_SIZE,
+                                  NULL,
+                                  &error);
+  }
+  if (error == CL_SUCCESS) {
+    device->result = clCreateBuffer(device->context,
+                                    CL_MEM_READ_WRITE,
+                                    sizeof(cl_uint),
+                                    NULL,
+                                    &error);
+  }
+  if (error == CL_SUCCESS) {
+    error = clGetKernelWorkGroupInfo(device->kernel,
+                                     id,
+                                     CL_KERNEL_WORK_GROUP_SIZE,
+                                     sizeof(size_t),
+                                     &device->local_size,
+                                     NULL);
+  }
+  if (error == CL_SUCCESS) {
+    error = clSetKernelArg(device->kernel, 0, sizeof(cl_mem), &device->hash);
+  }
+  if (error == CL_SUCCESS) {
+    error = clSetKernelArg(device->kernel,
+                           5,
+                           sizeof(cl_mem),
+                           &device->result);
+  }
+  if (error != CL_SUCCESS || !device->local_size) {
+    close_device(device);
+    return NULL;
+  }
+  if (device->local_size > MAX_LOCAL_SIZE) {
+    device->local_size = MAX_LOCAL_SIZE;
+  }
+  return device;
+}
+
+static int opencl_run(void* ctx,
+                      const uint8_t* initial_hash,
+                      uint64_t target,
+                      uint64_t start,
+                      uint64_t stride,
+                      uint64_t count,
+                      uint64_t* found) {
+  OpenClDevice* device = (OpenClDevice*)ctx;
+  // Kernel takes the hash as big-endian words.
+  cl_ulong words[HASH_SIZE / 8];
+  for (size_t i = 0; i < HASH_SIZE / 8; i++) {
+    words[i] = 0;
+    for (size_t j = 0; j < 8; j++) {
+      words[i] = (words[i] << 8) | initial_hash[i * 8 + j];
+    }
+  }
+  cl_uint result = NO_RESULT;
+  cl_ulong args[] = {target, start, stride, count};
+  size_t local_size = device->local_size;
+  size_t global_size = (count + local_size - 1) / local_size * local_size;
+  cl_int error = clEnqueueWriteBuffer(device->queue,
+                                      device->hash,
+                                      CL_TRUE,
+                                      0,
+                                      sizeof(words),
+                                      words,
+                                      0,
+                                      NULL,
+                                      NULL);
+  if (error == CL_SUCCESS) {
+    error = clEnqueueWriteBuffer(device->queue,
+                                 device->result,
+                                 CL_TRUE,
+                                 0,
+                                 sizeof(result),
+                                 &result,
+                                 0,
+                                 NULL,
+                                 NULL);
+  }
+  for (cl_uint i = 0; i < 4 && error == CL_SUCCESS; i++) {
+    error = clSetKernelArg(device->kernel, i + 1, sizeof(cl_ulong), &args[i]);
+  }
+  if (error == CL_SUCCESS) {
+    error = clEnqueueNDRangeKernel(device->queue,
+                                   device->kernel,
+                                   1,
+                                   NULL,
+                                   &global_size,
+                                   &local_size,
+                                   0,
+                                   NULL,
+                                   NULL);
+  }
+  if (error == CL_SUCCESS) {
+    error = clEnqueueReadBuffer(device->queue,
+                                device->result,
+                                CL_TRUE,
+                                0,
+                                sizeof(result),
+                                &result,
+                                0,
+                                NULL,
+                                NULL);
+  }
+  if (error != CL_SUCCESS) {
+    return RESULT_ERROR;
+  }
+  if (result == NO_RESULT) {
+    return RESULT_NOT_FOUND;
+  }
+  *found = start + result * stride;
+  return RESULT_OK;
+}
+
+#ifdef _WIN32
+#define POW_DEVICE_EXPORT extern "C" __declspec(dllexport)
+#else
+#define POW_DEVICE_EXPORT extern "C" __attribute__((visibility("default")))
+#endif
+
+// Devices live till the process exit, the module is never unloaded.
+POW_DEVICE_EXPORT size_t pow_device_probe(PowDevice* devices,
+                                          size_t max_devices) {
+  cl_uint platform_count = 0;
+  if (clGetPlatformIDs(0, NULL, &platform_count) != CL_SUCCESS ||
+      !platform_count) {
+    return 0;
+  }
+  std::vector<cl_platform_id> platforms(platform_count);
+  if (clGetPlatformIDs(platform_count, &platforms[0], NULL) != CL_SUCCESS) {
+    return 0;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < platforms.size() && n < max_devices; i++) {
+    cl_uint id_count = 0;
+    if (clGetDeviceIDs(platforms[i],
+                       CL_DEVICE_TYPE_GPU,
+                       0,
+                       NULL,
+                       &id_count) != CL_SUCCESS || !id_count) {
+      continue;
+    }
+    std::vector<cl_device_id> ids(id_count);
+    if (clGetDeviceIDs(platforms[i],
+                       CL_DEVICE_TYPE_GPU,
+                       id_count,
+                       &ids[0],
+                       NULL) != CL_SUCCESS) {
+      continue;
+    }
+    for (size_t j = 0; j < ids.size() && n < max_devices; j++) {
+      cl_uint units = 0;
+      if (clGetDeviceInfo(ids[j],
+                          CL_DEVICE_MAX_COMPUTE_UNITS,
+                          sizeof(units),
+                          &units,
+                          NULL) != CL_SUCCESS || !units) {
+        continue;
+      }
+      OpenClDevice* device = open_device(ids[j]);
+      if (!device) {
+        continue;
+      }
+      // Result index is 32-bit.
+      uint64_t group = device->local_size;
+      devices[n].run = opencl_run;
+      devices[n].ctx = device;
+      devices[n].min_batch = group * units * MIN_GROUPS_PER_UNIT;
+      devices[n].max_batch = (UINT32_MAX / group) * group;
+      n++;
+    }
+  }
+  return n;
+}
@@ -1,151 +1,1400 @@
 // Based on <https://github.com/grant-olson/bitmessage-powfaster>
-// fastcpu implementation.
-// TODO(Kagami): Port it to WIN32 (see bitmessage-powfaster for an
-// example).
+// fastcpu implementation. Threads, atomics and clock come from
+// `threads.h` so the pool works on POSIX systems and Windows alike.
 
 #define __STDC_LIMIT_MACROS
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
-#include <arpa/inet.h>
 #include <openssl/sha.h>
 #include "./pow.h"
+#include "./sha512.h"
+#include "./threads.h"
+#include "./topology.h"
 
-enum PowResult {
-  RESULT_OK = 0,
-  RESULT_OVERFLOW = -1,
-  RESULT_ERROR = -2,
-  RESULT_BAD_INPUT = -3,
-  RESULT_NOT_READY = -4
-};
+#define CACHE_LINE 64
 
-// Shared POW parameters.
-typedef struct {
-  const size_t pool_size;
-  const size_t target;
-  const uint8_t* initial_hash;
-  const uint64_t max_nonce;
-  PowResult result;
+#ifdef _MSC_VER
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+#endif
+
+// Threads take nonces by contiguous chunks sized to be searched in
+// about that time, so fast and slow cores don't wait for each other
+// and cursor is touched rarely.
+static const uint64_t CHUNK_NS = 10000000;
+static const uint64_t MIN_CHUNK = 1 << 10;
+static const uint64_t MAX_CHUNK = 1 << 26;
+
+// Statistics of a job slot or a pool thread. Only the owning thread
+// writes it while everyone may read, so plain relaxed atomics are
+// enough. Padded to the cache line so counters of different threads
+// don't share it.
+typedef struct CACHE_ALIGNED {
+  uint64_t trials;
+  // Accumulated busy time and the start of the current run (zero when
+  // idle), in nanoseconds.
+  uint64_t busy;
+  uint64_t since;
+  // Whether the pool thread with this index is running; guarded by the
+  // pool mutex.
+  bool alive;
+  // Range being searched by a job slot, empty if `next >= end`. `next`
+  // is stored after every kernel call, `end` is guarded by the pool
+  // mutex. Unused by thread counters.
+  uint64_t next;
+  uint64_t end;
+} PowCounter;
+
+// POW or generic search job. Fixed parameters are set on creation, the
+// rest is guarded by the pool mutex except `result`, `preempt` and
+// `best` which are also accessed by working threads without the lock.
+struct PowJob {
+  size_t pool_size;
+  uint64_t target;
+  uint64_t max_nonce;
+  int priority;
+  uint64_t deadline;
+  const PowKernel* kernel;
+  PowBlock block;
+  uint8_t initial_hash[HASH_SIZE];
+  // Engines allowed to run the job, see `PowBackend`.
+  int backends;
+  // Searched nonces are `range_start + i * stride` for `i < steps`,
+  // ranges and cursor are counted in `i`.
+  uint64_t range_start;
+  uint64_t stride;
+  uint64_t steps;
+  // Generic search, `check` is NULL for POW jobs.
+  PowSearch search;
+  // Nonces checked at once; ranges are multiples of that.
+  size_t lanes;
+  uint64_t min_chunk;
+  // Lowest match found so far by the `lowest` search, nonces above it
+  // are not handed out anymore. `drained` is set once nothing below it
+  // is left to hand out, so the last leaving thread reports it.
+  uint64_t best;
+  bool drained;
+  // Start of the never handed out nonces. Ranges of threads which left
+  // the job unfinished (preempted or retired) are searched first.
+  uint64_t cursor;
+  PowRange* returned;
+  size_t returned_count;
+  size_t returned_size;
+  // Up to `pool_size` CPU threads and every device work on a job at
+  // once, each one takes a free slot which identifies its stats.
+  // `slots` is the number of ever used ones.
+  size_t slots;
+  size_t* free_slots;
+  size_t free_count;
+  size_t active;
+  size_t cpu_active;
+  PowCounter* counters;
+  uint64_t started;
+  uint64_t finished;
+  int result;
+  int preempt;
   uint64_t nonce;
-  pthread_mutex_t* mutex;
-} PowArgs;
+  PowCallback callback;
+  void* data;
+  PowJob* next;
+};
 
-// Thread-specific arguments.
+// Shared thread pool. Threads are started lazily on the first submit
+// and live until `pow_shutdown`. Queue is ordered by job rank (see
+// `outranks`) and every thread takes the first queued job which still
+// has free slots, so cores are never oversubscribed. Threads of lower
+// ranked jobs are preempted when a better job can't get enough idle
+// threads.
 typedef struct {
-  size_t num;  // Thread number
-  PowArgs* pow_args;
-} ThreadArgs;
+  PowMutex mutex;
+  PowCond work_cond;
+  PowCond exit_cond;
+  size_t threads;
+  size_t busy;
+  size_t size;
+  // Set while there are more threads than `size`, polled without the
+  // lock so extra threads leave their jobs at the next chunk.
+  int shrinking;
+  bool fixed_size;
+  bool shutting_down;
+  PowJob* head;
+  PowCounter counters[MAX_POOL_SIZE];
+  // Thread with counter index `i` is pinned to `cpus[i % cpu_count]`,
+  // not pinned at all if the list is empty. Threads apply changes
+  // themselves once they notice the new `placement` generation.
+  int cpus[MAX_CPUS];
+  size_t cpu_count;
+  int placement;
+  // Every device has its own thread, see `device_thread`.
+  PowDevice devices[MAX_DEVICES];
+  bool device_alive[MAX_DEVICES];
+  size_t device_count;
+  size_t device_threads;
+  // CPU budget: percent of time every pool thread may compute, polled
+  // without the lock. Threads rest after each chunk for as long as it
+  // takes to keep the ratio.
+  int duty;
+} PowPool;
+
+static PowPool pool = {
+  POW_MUTEX_INITIALIZER,
+  POW_COND_INITIALIZER,
+  POW_COND_INITIALIZER,
+  0,
+  0,
+  0,
+  0,
+  false,
+  false,
+  NULL,
+  {},
+  {},
+  0,
+  0,
+  {},
+  {},
+  0,
+  0,
+  100,
+};
 
-#ifndef ntohll
-inline uint64_t ntohll(uint64_t x) {
-  return (
-      ((uint64_t)(ntohl( (unsigned int)((x << 32) >> 32) )) << 32) |
-      ntohl( ((unsigned int)(x >> 32)) )
-  );
+static void counter_start(PowCounter* counter) {
+  pow_store_u64(&counter->since, pow_now_ns());
+}
+
+static void counter_stop(PowCounter* counter) {
+  uint64_t busy = counter->busy + pow_now_ns() - counter->since;
+  pow_store_u64(&counter->since, 0);
+  pow_store_u64(&counter->busy, busy);
 }
-#endif
 
-// Set POW computation result in a thread-safe way.
-void set_result(PowArgs* pow_args, PowResult res, uint64_t nonce) {
-  pthread_mutex_lock(pow_args->mutex);
-  if (pow_args->result == RESULT_NOT_READY) {
-    pow_args->result = res;
-    pow_args->nonce = nonce;
+// Snapshot of the counter. Might be slightly off while the owner is
+// switching jobs.
+static void counter_read(const PowCounter* counter,
+                         uint64_t now,
+                         PowStats* stats) {
+  uint64_t since = pow_load_u64(&counter->since);
+  stats->trials = pow_load_u64(&counter->trials);
+  stats->elapsed = pow_load_u64(&counter->busy);
+  if (since && since < now) {
+    stats->elapsed += now - since;
   }
-  pthread_mutex_unlock(pow_args->mutex);
 }
 
-void* pow_thread(void* arg) {
-  ThreadArgs* thread_args = (ThreadArgs *)arg;
-  PowArgs* pow_args = thread_args->pow_args;
+static inline int load_result(const PowJob* job) {
+  return pow_load_int(&job->result);
+}
+
+// Set POW computation result. Must be called with pool mutex held.
+static void set_result(PowJob* job, int res, uint64_t nonce) {
+  if (job->result == RESULT_NOT_READY) {
+    job->finished = pow_now_ns();
+    job->nonce = nonce;
+    pow_store_int(&job->result, res);
+  }
+}
+
+static inline bool should_stop(PowJob* job) {
+  return load_result(job) != RESULT_NOT_READY ||
+         pow_load_int(&job->preempt);
+}
 
+// Whether job `a` should be served before `b`: higher priority first,
+// then earlier deadline. Jobs without deadline go last. Equal jobs keep
+// the FIFO order.
+static bool outranks(const PowJob* a, const PowJob* b) {
+  if (a->priority != b->priority) {
+    return a->priority > b->priority;
+  }
+  return a->deadline && (!b->deadline || a->deadline < b->deadline);
+}
+
+// Search nonces [*next, end) until the range is exhausted, job gets
+// any result or is preempted. `*next` is set to the first not checked
+// nonce. Trials are counted both for the slot and for the thread.
+static void pow_run(PowJob* job,
+                    uint64_t* next,
+                    uint64_t end,
+                    PowCounter* slot_counter,
+                    PowCounter* thread_counter) {
   // Copy some fixed POW args so compiler can inline them.
-  const size_t pool_size = pow_args->pool_size;
-  const uint64_t target = pow_args->target;
-  const uint64_t max_nonce = pow_args->max_nonce;
-
-  uint64_t i = thread_args->num;
-  uint8_t message[HASH_SIZE+sizeof(uint64_t)];
-  uint8_t digest[HASH_SIZE];
-  uint64_t* be_nonce;
-  uint64_t* be_trial;
-  SHA512_CTX sha;
-
-  memcpy(message+sizeof(uint64_t), pow_args->initial_hash, HASH_SIZE);
-  be_nonce = (uint64_t *)message;
-  be_trial = (uint64_t *)digest;
-
-  while (pow_args->result == RESULT_NOT_READY) {
-    // This is very unlikely to be ever happen but it's better to be
-    // sure anyway.
-    if (i > max_nonce) {
-      set_result(pow_args, RESULT_OVERFLOW, 0);
-      return NULL;
-    }
-    // XXX(Kagami): This and target comparision lines imply that we run
-    // this code on LE architecture while this might not be true.
-    *be_nonce = ntohll(i);
-    SHA512_Init(&sha);
-    SHA512_Update(&sha, message, HASH_SIZE+sizeof(uint64_t));
-    SHA512_Final(digest, &sha);
-    SHA512_Init(&sha);
-    SHA512_Update(&sha, digest, HASH_SIZE);
-    SHA512_Final(digest, &sha);
-    if (ntohll(*be_trial) <= target) {
-      set_result(pow_args, RESULT_OK, i);
-      return NULL;
-    }
-    i += pool_size;
+  const uint64_t target = job->target;
+  const uint64_t max_nonce = job->max_nonce;
+  const uint64_t range_start = job->range_start;
+  const uint64_t stride = job->stride;
+  const PowKernel* kernel = job->kernel;
+  const size_t lanes = kernel->lanes;
+
+  uint64_t i = *next;
+  uint64_t nonces[MAX_LANES];
+  uint64_t trials[MAX_LANES];
+  size_t lane;
+  uint64_t slot_trials = slot_counter->trials;
+  uint64_t thread_trials = thread_counter->trials;
+
+  // Ranges are multiples of the lanes count so all lanes are used.
+  for (; i < end && !should_stop(job); i += lanes) {
+    for (lane = 0; lane < lanes; lane++) {
+      nonces[lane] = range_start + (i + lane) * stride;
+    }
+    kernel->fn(&job->block, nonces, trials);
+    slot_trials += lanes;
+    thread_trials += lanes;
+    pow_store_u64(&slot_counter->trials, slot_trials);
+    pow_store_u64(&thread_counter->trials, thread_trials);
+    pow_store_u64(&slot_counter->next, i + lanes);
+    // Lanes are ordered by nonce so the first match is the lowest one.
+    // The last range of the job may end in the middle of lanes.
+    for (lane = 0; lane < lanes && i + lane < end; lane++) {
+      // This is very unlikely to be ever happen but it's better to be
+      // sure anyway.
+      if (nonces[lane] > max_nonce) {
+        pow_mutex_lock(&pool.mutex);
+        set_result(job, RESULT_OVERFLOW, 0);
+        pow_mutex_unlock(&pool.mutex);
+        *next = i;
+        return;
+      }
+      if (trials[lane] <= target) {
+        pow_mutex_lock(&pool.mutex);
+        set_result(job, RESULT_OK, nonces[lane]);
+        pow_mutex_unlock(&pool.mutex);
+        *next = i;
+        return;
+      }
+    }
+  }
+  *next = i;
+}
+
+// The same as `pow_run` for generic search jobs.
+static void search_run(PowJob* job,
+                       uint64_t* next,
+                       uint64_t end,
+                       PowCounter* slot_counter,
+                       PowCounter* thread_counter) {
+  const PowSearch search = job->search;
+  const uint64_t max_nonce = job->max_nonce;
+
+  uint64_t i = *next;
+  uint64_t found;
+  uint64_t slot_trials = slot_counter->trials;
+  uint64_t thread_trials = thread_counter->trials;
+
+  for (; i < end && !should_stop(job); i += search.batch) {
+    // Candidates above the best match are not needed anymore.
+    if (search.lowest && i >= pow_load_u64(&job->best)) {
+      i = end;
+      break;
+    }
+    if (i + search.batch - 1 > max_nonce) {
+      pow_mutex_lock(&pool.mutex);
+      set_result(job, RESULT_OVERFLOW, 0);
+      pow_mutex_unlock(&pool.mutex);
+      break;
+    }
+    // Only the last batch of a limited range is shorter.
+    size_t count = end - i < search.batch ? (size_t)(end - i) : search.batch;
+    bool matched = search.check(search.ctx, i, count, &found);
+    slot_trials += count;
+    thread_trials += count;
+    pow_store_u64(&slot_counter->trials, slot_trials);
+    pow_store_u64(&thread_counter->trials, thread_trials);
+    pow_store_u64(&slot_counter->next, i + count);
+    if (matched) {
+      pow_mutex_lock(&pool.mutex);
+      if (!search.lowest) {
+        set_result(job, RESULT_OK, found);
+      } else if (found < job->best) {
+        // Rest of the range is above it.
+        pow_store_u64(&job->best, found);
+        i = end;
+      }
+      pow_mutex_unlock(&pool.mutex);
+      break;
+    }
+  }
+  *next = i;
+}
+
+// Return the next range to search, preferring the given back ones, and
+// note it in the slot so checkpoints see it. Ranges are taken under the
+// lock, chunks are long enough for that to be cheap. Fails once the
+// range is over or the `lowest` search has nothing left below its best
+// match.
+static bool take_range(PowJob* job,
+                       PowCounter* slot_counter,
+                       uint64_t chunk,
+                       uint64_t* start,
+                       uint64_t* end) {
+  pow_mutex_lock(&pool.mutex);
+  bool taken = false;
+  while (job->returned_count && !taken) {
+    PowRange range = job->returned[--job->returned_count];
+    *start = range.start;
+    *end = range.end;
+    taken = range.start < job->best;
+  }
+  if (!taken && job->cursor < job->steps) {
+    *start = job->cursor;
+    *end = job->steps - *start > chunk ? *start + chunk : job->steps;
+    job->cursor = *end;
+    taken = *start < job->best;
+  }
+  if (taken) {
+    pow_store_u64(&slot_counter->next, *start);
+    slot_counter->end = *end;
+  }
+  pow_mutex_unlock(&pool.mutex);
+  return taken;
+}
+
+// Give back the unfinished range. Must be called with pool mutex held.
+static bool return_range(PowJob* job, uint64_t start, uint64_t end) {
+  if (start >= end) {
+    return true;
+  }
+  if (job->returned_count == job->returned_size) {
+    size_t size = job->returned_size ? job->returned_size * 2 : 8;
+    PowRange* returned =
+      (PowRange*)realloc(job->returned, size * sizeof(PowRange));
+    if (!returned) {
+      return false;
+    }
+    job->returned = returned;
+    job->returned_size = size;
+  }
+  PowRange range = {start, end};
+  job->drained = false;
+  job->returned[job->returned_count++] = range;
+  return true;
+}
+
+// Scale chunk so it takes about `CHUNK_NS` on this thread, changing it
+// at most twice per step to smooth out noise. Result is a multiple of
+// `step` in [min_chunk, max_chunk].
+static uint64_t scale_chunk(uint64_t chunk,
+                            uint64_t elapsed,
+                            uint64_t min_chunk,
+                            uint64_t max_chunk,
+                            uint64_t step) {
+  uint64_t next;
+  if (elapsed < CHUNK_NS / 2) {
+    next = chunk * 2;
+  } else if (elapsed > CHUNK_NS * 2) {
+    next = chunk / 2;
+  } else {
+    next = (uint64_t)((double)chunk * CHUNK_NS / elapsed);
+  }
+  if (next < min_chunk) {
+    next = min_chunk;
+  } else if (next > max_chunk) {
+    next = max_chunk;
+  }
+  return next - next % step;
+}
+
+static uint64_t adapt_chunk(const PowJob* job,
+                            uint64_t chunk,
+                            uint64_t elapsed) {
+  return scale_chunk(chunk, elapsed, job->min_chunk, MAX_CHUNK, job->lanes);
+}
+
+// Unlink job from the queue. Must be called with pool mutex held.
+static void dequeue(PowJob* job) {
+  PowJob** link = &pool.head;
+  while (*link && *link != job) {
+    link = &(*link)->next;
+  }
+  if (*link) {
+    *link = job->next;
+    job->next = NULL;
+  }
+}
+
+// Insert job after all jobs of not lower rank. Must be called with
+// pool mutex held.
+static void enqueue(PowJob* job) {
+  PowJob** link = &pool.head;
+  while (*link && !outranks(job, *link)) {
+    link = &(*link)->next;
+  }
+  job->next = *link;
+  *link = job;
+}
+
+// Return the first job a free thread can join. Must be called with pool
+// mutex held.
+static PowJob* find_job() {
+  for (PowJob* job = pool.head; job; job = job->next) {
+    if (job->result == RESULT_NOT_READY && (job->backends & BACKEND_CPU) &&
+        job->cpu_active < job->pool_size && !job->drained) {
+      return job;
+    }
+  }
+  return NULL;
+}
+
+// The same as `find_job` for device threads.
+static PowJob* find_device_job() {
+  for (PowJob* job = pool.head; job; job = job->next) {
+    if (job->result == RESULT_NOT_READY &&
+        (job->backends & BACKEND_DEVICE) && !job->drained) {
+      return job;
+    }
+  }
+  return NULL;
+}
+
+// Take a free slot of the job. Must be called with pool mutex held.
+static size_t take_slot(PowJob* job) {
+  if (!job->started) {
+    job->started = pow_now_ns();
+  }
+  size_t slot = job->free_slots[--job->free_count];
+  if (slot >= job->slots) {
+    job->slots = slot + 1;
+  }
+  return slot;
+}
+
+// Ask threads of lower ranked jobs to move to the just queued one if
+// idle threads are not enough for it. Lowest ranked jobs are asked
+// first. Must be called with pool mutex held.
+static void preempt_for(PowJob* job) {
+  if (!(job->backends & BACKEND_CPU)) {
+    return;
+  }
+  size_t wanted = job->pool_size < pool.size ? job->pool_size : pool.size;
+  size_t idle = pool.threads - pool.busy;
+  if (idle >= wanted) {
+    return;
+  }
+  size_t needed = wanted - idle;
+  size_t running = 0;
+  PowJob* lower;
+  for (lower = job->next; lower; lower = lower->next) {
+    running += lower->cpu_active;
+  }
+  for (lower = job->next; lower; lower = lower->next) {
+    if (lower->cpu_active && running - lower->cpu_active < needed) {
+      pow_store_int(&lower->preempt, 1);
+    }
+    running -= lower->cpu_active;
+  }
+}
+
+// Free the slot of the leaving thread and report the job if it was the
+// last one and job is finished. Must be called with pool mutex held,
+// it's released while the callback runs.
+static void leave_job(PowJob* job, size_t slot) {
+  job->free_slots[job->free_count++] = slot;
+  if (--job->active == 0 && job->drained) {
+    // Everything below the best match is searched.
+    if (job->best == UINT64_MAX) {
+      set_result(job, RESULT_NOT_FOUND, 0);
+    } else {
+      set_result(job, RESULT_OK, job->best);
+    }
+  }
+  if (job->active == 0 && job->result != RESULT_NOT_READY) {
+    // The last thread leaving the finished job reports it.
+    dequeue(job);
+    pow_mutex_unlock(&pool.mutex);
+    job->callback(job, job->data);
+    pow_mutex_lock(&pool.mutex);
+  }
+}
+
+// Pin the calling thread according to the current placement if it has
+// changed since `*placement`.
+static void apply_placement(const PowCounter* thread_counter,
+                            int* placement) {
+  if (pow_load_int(&pool.placement) == *placement) {
+    return;
+  }
+  size_t index = thread_counter - pool.counters;
+  pow_mutex_lock(&pool.mutex);
+  int cpu = pool.cpu_count ? pool.cpus[index % pool.cpu_count] : -1;
+  *placement = pool.placement;
+  pow_mutex_unlock(&pool.mutex);
+  pow_pin_thread(cpu);
+}
+
+// Sleep after computing for `busy` nanoseconds to keep the CPU budget.
+// Rest is taken by short naps so the budget change, the job end or
+// preemption takes effect quickly.
+static void rest(PowJob* job, uint64_t busy) {
+  uint64_t slept = 0;
+  while (!should_stop(job) && !pow_load_int(&pool.shrinking)) {
+    int duty = pow_load_int(&pool.duty);
+    uint64_t owed = duty < 100 ? busy * (100 - duty) / duty : 0;
+    if (slept >= owed) {
+      break;
+    }
+    uint64_t nap = owed - slept < CHUNK_NS ? owed - slept : CHUNK_NS;
+    pow_sleep_ns(nap);
+    slept += nap;
+  }
+}
+
+static void* pool_thread(void* arg) {
+  PowCounter* thread_counter = (PowCounter*)arg;
+  // Measured chunk size persists between POW jobs, speed of the core
+  // doesn't depend on them. Searches start from their own minimum.
+  uint64_t pow_chunk = MIN_CHUNK;
+  // Threads start unpinned.
+  int placement = 0;
+  apply_placement(thread_counter, &placement);
+  pow_mutex_lock(&pool.mutex);
+  while (true) {
+    // Retire extra threads.
+    if (pool.shutting_down || pool.threads > pool.size) {
+      break;
+    }
+    PowJob* job = find_job();
+    if (!job) {
+      pow_cond_wait(&pool.work_cond, &pool.mutex);
+      continue;
+    }
+    size_t slot = take_slot(job);
+    job->active++;
+    job->cpu_active++;
+    pool.busy++;
+    pow_mutex_unlock(&pool.mutex);
+
+    PowCounter* slot_counter = &job->counters[slot];
+    counter_start(slot_counter);
+    counter_start(thread_counter);
+    uint64_t chunk = job->search.check ? job->min_chunk : pow_chunk;
+    chunk -= chunk % job->lanes;
+    uint64_t start = 0;
+    uint64_t end = 0;
+    uint64_t taken = 0;
+    while (true) {
+      if (start >= end) {
+        apply_placement(thread_counter, &placement);
+        if (pow_load_int(&pool.shrinking)) {
+          pow_mutex_lock(&pool.mutex);
+          if (pool.threads > pool.size) {
+            break;
+          }
+          pow_mutex_unlock(&pool.mutex);
+        }
+        if (!take_range(job, slot_counter, chunk, &start, &end)) {
+          pow_mutex_lock(&pool.mutex);
+          job->drained = true;
+          break;
+        }
+        taken = pow_now_ns();
+      }
+      if (job->search.check) {
+        search_run(job, &start, end, slot_counter, thread_counter);
+      } else {
+        pow_run(job, &start, end, slot_counter, thread_counter);
+      }
+      if (start >= end) {
+        uint64_t elapsed = pow_now_ns() - taken;
+        chunk = adapt_chunk(job, chunk, elapsed);
+        if (pow_load_int(&pool.duty) < 100) {
+          rest(job, elapsed);
+        }
+        continue;
+      }
+      pow_mutex_lock(&pool.mutex);
+      if (job->result != RESULT_NOT_READY) {
+        break;
+      }
+      // Preempted: leave the job only if there is a better one to join,
+      // otherwise it's not needed anymore.
+      PowJob* better = find_job();
+      if (better && outranks(better, job) && return_range(job, start, end)) {
+        start = end;
+        break;
+      }
+      pow_store_int(&job->preempt, 0);
+      pow_mutex_unlock(&pool.mutex);
+    }
+    counter_stop(slot_counter);
+    counter_stop(thread_counter);
+    // The rest of the range is either given back or not needed.
+    slot_counter->end = 0;
+    if (!job->search.check) {
+      pow_chunk = chunk;
+    }
+
+    job->cpu_active--;
+    pool.busy--;
+    leave_job(job, slot);
+  }
+  thread_counter->alive = false;
+  pool.threads--;
+  if (pool.threads <= pool.size) {
+    pow_store_int(&pool.shrinking, 0);
+  }
+  pow_cond_broadcast(&pool.exit_cond);
+  pow_mutex_unlock(&pool.mutex);
+  return NULL;
+}
+
+// Search steps [start, end) of the job on the device. Device calls
+// can't be interrupted so cancel and preemption take effect after it.
+static void device_run(PowJob* job,
+                       const PowDevice* device,
+                       uint64_t start,
+                       uint64_t end,
+                       PowCounter* slot_counter) {
+  uint64_t first = job->range_start + start * job->stride;
+  uint64_t count = end - start;
+  bool overflow = false;
+  if (first > job->max_nonce) {
+    count = 0;
+    overflow = true;
+  } else if ((job->max_nonce - first) / job->stride < count - 1) {
+    count = (job->max_nonce - first) / job->stride + 1;
+    overflow = true;
+  }
+  uint64_t found = 0;
+  int res = RESULT_NOT_FOUND;
+  if (count) {
+    res = device->run(device->ctx,
+                      job->initial_hash,
+                      job->target,
+                      first,
+                      job->stride,
+                      count,
+                      &found);
+  }
+  pow_store_u64(&slot_counter->trials, slot_counter->trials + count);
+  pow_store_u64(&slot_counter->next, start + count);
+  if (res == RESULT_NOT_FOUND && overflow) {
+    res = RESULT_OVERFLOW;
+  }
+  if (res != RESULT_NOT_FOUND) {
+    pow_mutex_lock(&pool.mutex);
+    set_result(job, res, found);
+    pow_mutex_unlock(&pool.mutex);
+  }
+}
+
+// Drive one device the same way `pool_thread` drives a core. Device
+// threads are not counted in the pool size.
+static void* device_thread(void* arg) {
+  size_t index = (size_t)arg;
+  const PowDevice* device = &pool.devices[index];
+  uint64_t device_chunk = device->min_batch;
+  pow_mutex_lock(&pool.mutex);
+  while (!pool.shutting_down) {
+    PowJob* job = find_device_job();
+    if (!job) {
+      pow_cond_wait(&pool.work_cond, &pool.mutex);
+      continue;
+    }
+    size_t slot = take_slot(job);
+    job->active++;
+    pow_mutex_unlock(&pool.mutex);
+
+    PowCounter* slot_counter = &job->counters[slot];
+    counter_start(slot_counter);
+    uint64_t chunk = device_chunk;
+    uint64_t start;
+    uint64_t end;
+    while (true) {
+      if (!take_range(job, slot_counter, chunk, &start, &end)) {
+        pow_mutex_lock(&pool.mutex);
+        job->drained = true;
+        break;
+      }
+      uint64_t taken = pow_now_ns();
+      device_run(job, device, start, end, slot_counter);
+      chunk = scale_chunk(chunk,
+                          pow_now_ns() - taken,
+                          device->min_batch,
+                          device->max_batch,
+                          1);
+      pow_mutex_lock(&pool.mutex);
+      // Range is finished so there is nothing to give back.
+      PowJob* better = find_device_job();
+      if (job->result != RESULT_NOT_READY ||
+          (better && outranks(better, job))) {
+        break;
+      }
+      pow_mutex_unlock(&pool.mutex);
+    }
+    counter_stop(slot_counter);
+    slot_counter->end = 0;
+    device_chunk = chunk;
+    leave_job(job, slot);
   }
+  pool.device_alive[index] = false;
+  pool.device_threads--;
+  pow_cond_broadcast(&pool.exit_cond);
+  pow_mutex_unlock(&pool.mutex);
   return NULL;
 }
 
+// Start threads of devices which don't have them. Must be called with
+// pool mutex held.
+static int spawn_devices() {
+  for (size_t i = 0; i < pool.device_count; i++) {
+    if (!pool.device_alive[i]) {
+      if (!pow_thread_spawn(device_thread, (void*)i)) {
+        break;
+      }
+      pool.device_alive[i] = true;
+      pool.device_threads++;
+    }
+  }
+  return pool.device_threads ? RESULT_OK : RESULT_ERROR;
+}
+
+// Start missing threads. Must be called with pool mutex held.
+static int spawn_threads() {
+  size_t index = 0;
+  while (pool.threads < pool.size) {
+    // Reuse counters of retired threads.
+    while (pool.counters[index].alive) {
+      index++;
+    }
+    PowCounter* counter = &pool.counters[index];
+    memset(counter, 0, sizeof(PowCounter));
+    if (!pow_thread_spawn(pool_thread, counter)) {
+      break;
+    }
+    counter->alive = true;
+    pool.threads++;
+  }
+  // It's fine to continue with lesser pool if at least one thread is
+  // running.
+  return pool.threads ? RESULT_OK : RESULT_ERROR;
+}
+
+// Allocate job with parameters common to all job kinds.
+static PowJob* job_new(size_t pool_size, uint64_t max_nonce) {
+  if (pool_size < 1 || pool_size > MAX_POOL_SIZE) {
+    return NULL;
+  }
+  PowJob* job = (PowJob*)calloc(1, sizeof(PowJob));
+  if (!job) {
+    return NULL;
+  }
+  // Devices take slots in addition to CPU threads.
+  size_t slots = pool_size + MAX_DEVICES;
+  job->free_slots = (size_t*)malloc(slots * sizeof(size_t));
+  size_t counters_size = slots * sizeof(PowCounter);
+  job->counters = (PowCounter*)pow_aligned_alloc(CACHE_LINE, counters_size);
+  if (job->counters) {
+    memset(job->counters, 0, counters_size);
+  }
+  if (!job->free_slots || !job->counters) {
+    pow_job_free(job);
+    return NULL;
+  }
+  // Lowest slots are taken first.
+  for (size_t i = 0; i < slots; i++) {
+    job->free_slots[i] = slots - 1 - i;
+  }
+  job->free_count = slots;
+  job->pool_size = pool_size;
+  job->backends = BACKEND_CPU;
+  job->max_nonce = max_nonce ? max_nonce : INT64_MAX;
+  job->stride = 1;
+  job->steps = UINT64_MAX;
+  job->best = UINT64_MAX;
+  job->result = RESULT_NOT_READY;
+  return job;
+}
+
+PowJob* pow_job_new(size_t pool_size,
+                    uint64_t target,
+                    const uint8_t* initial_hash,
+                    uint64_t max_nonce) {
+  PowJob* job = job_new(pool_size, max_nonce);
+  if (!job) {
+    return NULL;
+  }
+  job->target = target;
+  job->kernel = pow_kernel_select();
+  job->lanes = job->kernel->lanes;
+  job->min_chunk = MIN_CHUNK;
+  pow_block_init(&job->block, initial_hash);
+  memcpy(job->initial_hash, initial_hash, HASH_SIZE);
+  return job;
+}
+
+PowJob* pow_job_new_search(size_t pool_size,
+                           const PowSearch* search,
+                           uint64_t max_nonce) {
+  if (!search->check || search->batch < 1) {
+    return NULL;
+  }
+  PowJob* job = job_new(pool_size, max_nonce);
+  if (!job) {
+    return NULL;
+  }
+  job->search = *search;
+  job->lanes = search->batch;
+  job->min_chunk = search->batch;
+  return job;
+}
+
+void pow_job_free(PowJob* job) {
+  free(job->returned);
+  free(job->free_slots);
+  pow_aligned_free(job->counters);
+  free(job);
+}
+
+void pow_job_set_priority(PowJob* job, int priority, uint64_t deadline) {
+  job->priority = priority;
+  job->deadline = deadline;
+}
+
+int pow_job_set_range(PowJob* job,
+                      uint64_t start,
+                      uint64_t end,
+                      uint64_t stride) {
+  // Search candidates are not remapped, only their count is limited.
+  if ((job->search.check && (start || stride != 1)) ||
+      start >= end ||
+      stride < 1) {
+    return RESULT_BAD_INPUT;
+  }
+  job->range_start = start;
+  job->stride = stride;
+  job->steps = (end - start - 1) / stride + 1;
+  return RESULT_OK;
+}
+
+int pow_job_set_backends(PowJob* job, int backends) {
+  bool device = (backends & BACKEND_DEVICE) != 0;
+  if (!(backends & BACKEND_HYBRID) ||
+      (device && (job->search.check || !pow_get_device_count()))) {
+    return RESULT_BAD_INPUT;
+  }
+  job->backends = backends & BACKEND_HYBRID;
+  return RESULT_OK;
+}
+
+int pow_job_result(const PowJob* job, uint64_t* nonce) {
+  int result = load_result(job);
+  if (result == RESULT_OK) {
+    *nonce = job->nonce;
+  }
+  return result;
+}
+
+size_t pow_job_stats(const PowJob* job,
+                     PowStats* total,
+                     PowStats* slots,
+                     size_t max_slots) {
+  pow_mutex_lock(&pool.mutex);
+  uint64_t now = pow_now_ns();
+  size_t n = job->slots < max_slots ? job->slots : max_slots;
+  total->trials = 0;
+  for (size_t i = 0; i < job->slots; i++) {
+    PowStats stats;
+    counter_read(&job->counters[i], now, &stats);
+    total->trials += stats.trials;
+    if (i < n) {
+      slots[i] = stats;
+    }
+  }
+  if (!job->started) {
+    total->elapsed = 0;
+  } else if (job->result == RESULT_NOT_READY) {
+    total->elapsed = now - job->started;
+  } else {
+    total->elapsed = job->finished - job->started;
+  }
+  pow_mutex_unlock(&pool.mutex);
+  return n;
+}
+
+size_t pow_job_checkpoint(const PowJob* job,
+                          PowRange* ranges,
+                          size_t max_ranges,
+                          uint64_t* cursor) {
+  pow_mutex_lock(&pool.mutex);
+  size_t n = 0;
+  // Given back ranges are taken from the end.
+  for (size_t i = job->returned_count; i > 0; i--, n++) {
+    if (n < max_ranges) {
+      ranges[n] = job->returned[i - 1];
+    }
+  }
+  for (size_t i = 0; i < job->slots; i++) {
+    const PowCounter* counter = &job->counters[i];
+    uint64_t next = pow_load_u64(&counter->next);
+    if (next < counter->end) {
+      if (n < max_ranges) {
+        PowRange range = {next, counter->end};
+        ranges[n] = range;
+      }
+      n++;
+    }
+  }
+  *cursor = job->cursor;
+  pow_mutex_unlock(&pool.mutex);
+  return n;
+}
+
+int pow_job_restore(PowJob* job,
+                    const PowRange* ranges,
+                    size_t count,
+                    uint64_t cursor) {
+  for (size_t i = 0; i < count; i++) {
+    if (ranges[i].start >= ranges[i].end) {
+      return RESULT_BAD_INPUT;
+    }
+  }
+  pow_mutex_lock(&pool.mutex);
+  job->returned_count = 0;
+  int result = RESULT_OK;
+  for (size_t i = count; i > 0 && result == RESULT_OK; i--) {
+    if (!return_range(job, ranges[i - 1].start, ranges[i - 1].end)) {
+      result = RESULT_ERROR;
+    }
+  }
+  job->cursor = cursor;
+  pow_mutex_unlock(&pool.mutex);
+  return result;
+}
+
+int pow_submit(PowJob* job, PowCallback callback, void* data) {
+  pow_mutex_lock(&pool.mutex);
+  if (pool.shutting_down) {
+    pow_mutex_unlock(&pool.mutex);
+    return RESULT_SHUTDOWN;
+  }
+  int error = RESULT_OK;
+  if (job->backends & BACKEND_CPU) {
+    if (!pool.fixed_size && job->pool_size > pool.size) {
+      pool.size = job->pool_size;
+    }
+    error = spawn_threads();
+  }
+  if (!error && (job->backends & BACKEND_DEVICE)) {
+    error = spawn_devices();
+  }
+  if (error) {
+    pow_mutex_unlock(&pool.mutex);
+    return error;
+  }
+  job->callback = callback;
+  job->data = data;
+  enqueue(job);
+  preempt_for(job);
+  pow_cond_broadcast(&pool.work_cond);
+  pow_mutex_unlock(&pool.mutex);
+  return RESULT_OK;
+}
+
+int pow_cancel(PowJob* job) {
+  pow_mutex_lock(&pool.mutex);
+  if (job->result != RESULT_NOT_READY) {
+    pow_mutex_unlock(&pool.mutex);
+    return RESULT_NOT_READY;
+  }
+  set_result(job, RESULT_CANCELLED, 0);
+  bool idle = job->active == 0;
+  if (idle) {
+    dequeue(job);
+  }
+  pow_mutex_unlock(&pool.mutex);
+  if (idle) {
+    job->callback(job, job->data);
+  }
+  return RESULT_OK;
+}
+
+int pow_set_pool_size(size_t pool_size) {
+  if (pool_size > MAX_POOL_SIZE) {
+    return RESULT_BAD_INPUT;
+  }
+  pow_mutex_lock(&pool.mutex);
+  pool.fixed_size = pool_size != 0;
+  if (pool.fixed_size) {
+    pool.size = pool_size;
+  }
+  int error = RESULT_OK;
+  // Grow right away if there are running threads; otherwise pool will
+  // be started with the new size on the next submit. New threads join
+  // running jobs, extra ones retire after their current chunk leaving
+  // the job to the rest. Switching back to the automatic mode keeps the
+  // current threads.
+  if (pool.threads && pool.size > pool.threads) {
+    error = spawn_threads();
+  }
+  if (pool.threads > pool.size) {
+    pow_store_int(&pool.shrinking, 1);
+  }
+  pow_cond_broadcast(&pool.work_cond);
+  pow_mutex_unlock(&pool.mutex);
+  return error;
+}
+
+int pow_set_affinity(const PowAffinity* affinity) {
+  int cpus[MAX_CPUS];
+  size_t count = pow_placement(pow_topology(), affinity, cpus, MAX_CPUS);
+  if (affinity->pin && !count) {
+    return RESULT_BAD_INPUT;
+  }
+  pow_mutex_lock(&pool.mutex);
+  memcpy(pool.cpus, cpus, count * sizeof(int));
+  pool.cpu_count = count;
+  pow_store_int(&pool.placement, pool.placement + 1);
+  pow_mutex_unlock(&pool.mutex);
+  return RESULT_OK;
+}
+
+int pow_set_budget(int duty) {
+  if (duty < 1 || duty > 100) {
+    return RESULT_BAD_INPUT;
+  }
+  pow_store_int(&pool.duty, duty);
+  return RESULT_OK;
+}
+
+int pow_add_device(const PowDevice* device) {
+  if (!device->run || device->min_batch < 1 ||
+      device->max_batch < device->min_batch) {
+    return RESULT_BAD_INPUT;
+  }
+  pow_mutex_lock(&pool.mutex);
+  int error = RESULT_ERROR;
+  if (pool.device_count < MAX_DEVICES) {
+    pool.devices[pool.device_count++] = *device;
+    error = RESULT_OK;
+  }
+  pow_mutex_unlock(&pool.mutex);
+  return error;
+}
+
+size_t pow_get_device_count() {
+  pow_mutex_lock(&pool.mutex);
+  size_t count = pool.device_count;
+  pow_mutex_unlock(&pool.mutex);
+  return count;
+}
+
+size_t pow_get_pool_size() {
+  pow_mutex_lock(&pool.mutex);
+  size_t threads = pool.threads;
+  pow_mutex_unlock(&pool.mutex);
+  return threads;
+}
+
+size_t pow_thread_stats(PowStats* threads, size_t max_threads) {
+  pow_mutex_lock(&pool.mutex);
+  uint64_t now = pow_now_ns();
+  size_t n = 0;
+  for (size_t i = 0; i < MAX_POOL_SIZE && n < max_threads; i++) {
+    if (pool.counters[i].alive) {
+      counter_read(&pool.counters[i], now, &threads[n++]);
+    }
+  }
+  pow_mutex_unlock(&pool.mutex);
+  return n;
+}
+
+void pow_shutdown() {
+  pow_mutex_lock(&pool.mutex);
+  pool.shutting_down = true;
+  // Stop running jobs and fail queued ones.
+  PowJob* pending = NULL;
+  PowJob* job = pool.head;
+  while (job) {
+    PowJob* next = job->next;
+    set_result(job, RESULT_SHUTDOWN, 0);
+    if (job->active == 0) {
+      dequeue(job);
+      job->next = pending;
+      pending = job;
+    }
+    job = next;
+  }
+  pow_cond_broadcast(&pool.work_cond);
+  while (pool.threads || pool.device_threads) {
+    pow_cond_wait(&pool.exit_cond, &pool.mutex);
+  }
+  pool.shutting_down = false;
+  if (!pool.fixed_size) {
+    pool.size = 0;
+  }
+  pow_mutex_unlock(&pool.mutex);
+
+  while (pending) {
+    job = pending;
+    pending = job->next;
+    job->next = NULL;
+    job->callback(job, job->data);
+  }
+}
+
+// State of blocking `pow` call.
+typedef struct {
+  PowMutex mutex;
+  PowCond cond;
+  bool done;
+} PowWait;
+
+static void on_wait_done(PowJob*, void* data) {
+  PowWait* wait = (PowWait*)data;
+  pow_mutex_lock(&wait->mutex);
+  wait->done = true;
+  pow_cond_signal(&wait->cond);
+  pow_mutex_unlock(&wait->mutex);
+}
+
+int pow_job_wait(PowJob* job, uint64_t* nonce) {
+  PowWait wait;
+  pow_mutex_init(&wait.mutex);
+  pow_cond_init(&wait.cond);
+  wait.done = false;
+
+  int result = pow_submit(job, on_wait_done, &wait);
+  if (result == RESULT_OK) {
+    pow_mutex_lock(&wait.mutex);
+    while (!wait.done) {
+      pow_cond_wait(&wait.cond, &wait.mutex);
+    }
+    pow_mutex_unlock(&wait.mutex);
+    result = pow_job_result(job, nonce);
+  }
+
+  pow_cond_destroy(&wait.cond);
+  pow_mutex_destroy(&wait.mutex);
+  return result;
+}
+
 int pow(size_t pool_size,
         uint64_t target,
         const uint8_t* initial_hash,
         uint64_t max_nonce,
         uint64_t* nonce) {
-  if (pool_size < 1 || pool_size > MAX_POOL_SIZE) {
+  PowJob* job = pow_job_new(pool_size, target, initial_hash, max_nonce);
+  if (!job) {
     return RESULT_BAD_INPUT;
   }
+  int result = pow_job_wait(job, nonce);
+  pow_job_free(job);
+  return result;
+}
+
+// Calibration run length, it must span several quota periods when CPU
+// quota is set, otherwise threads burst through the first period
+// before being throttled.
+#define TUNE_MIN_NS 20000000ULL
+#define TUNE_RUN_NS 60000000ULL
+#define TUNE_MAX_NS 400000000ULL
+#define TUNE_PERIODS 3
+// Thread count must raise the hashrate by this much to be taken.
+#define TUNE_MIN_GAIN 1.05
+
+static size_t tuned_pool_size;
+static PowOnce tune_once = POW_ONCE_INIT;
+
+// Search `count` nonces of the impossible target and return the
+// aggregate hashrate, or zero on error.
+static double measure_hashrate(size_t pool_size, uint64_t count) {
+  uint8_t initial_hash[HASH_SIZE];
+  uint64_t nonce;
+  PowStats total;
+  memset(initial_hash, 0, HASH_SIZE);
+  PowJob* job = pow_job_new(pool_size, 0, initial_hash, UINT64_MAX);
+  if (!job) {
+    return 0;
+  }
+  double hashrate = 0;
+  if (pow_job_set_range(job, 0, count, 1) == RESULT_OK &&
+      pow_job_wait(job, &nonce) == RESULT_NOT_FOUND) {
+    pow_job_stats(job, &total, NULL, 0);
+    if (total.elapsed) {
+      hashrate = (double)total.trials * 1e9 / (double)total.elapsed;
+    }
+  }
+  pow_job_free(job);
+  return hashrate;
+}
+
+static void tune_pool_size() {
+  const PowTopology* topology = pow_topology();
+  size_t max_threads = topology->cores ? topology->cores : 1;
+  uint64_t run_ns = TUNE_RUN_NS;
+  if (topology->quota > 0) {
+    size_t quota_threads = (size_t)topology->quota;
+    quota_threads += topology->quota > (double)quota_threads;
+    if (quota_threads < max_threads) {
+      max_threads = quota_threads;
+    }
+    if (topology->quota_period * TUNE_PERIODS > run_ns) {
+      run_ns = topology->quota_period * TUNE_PERIODS;
+    }
+    if (run_ns > TUNE_MAX_NS) {
+      run_ns = TUNE_MAX_NS;
+    }
+  }
+  if (max_threads > MAX_POOL_SIZE) {
+    max_threads = MAX_POOL_SIZE;
+  }
+  tuned_pool_size = max_threads;
 
-  // Initialize all structures on stack.
-  pthread_mutex_t mutex;
-  pthread_mutex_init(&mutex, NULL);
-  PowArgs pow_args = {
-    pool_size,
-    target,
-    initial_hash,
-    max_nonce ? max_nonce : INT64_MAX,
-    RESULT_NOT_READY,
-    0,
-    &mutex,
-  };
-  ThreadArgs threads_args[pool_size];
-  pthread_t threads[pool_size];
-  size_t i;
-  int error;
-
-  // Spawn threads.
-  for (i = 0; i < pool_size; i++) {
-    ThreadArgs args = {i, &pow_args};
-    threads_args[i] = args;
-    error = pthread_create(&threads[i], NULL, pow_thread, &threads_args[i]);
-    if (error) {
-      set_result(&pow_args, RESULT_ERROR, 0);
+  // Single thread rate sizes the runs, it's measured until the run is
+  // long enough to not be dominated by the thread start.
+  uint64_t count = 65536;
+  double single = 0;
+  for (;;) {
+    single = measure_hashrate(1, count);
+    if (single <= 0 || count / single * 1e9 >= TUNE_MIN_NS) {
+      break;
+    }
+    count *= 2;
+  }
+  if (single <= 0 || max_threads == 1) {
+    return;
+  }
+
+  size_t best = 1;
+  double best_hashrate = single;
+  size_t threads = 2;
+  while (threads <= max_threads) {
+    uint64_t nonces = (uint64_t)(single * threads * run_ns / 1e9);
+    double hashrate = measure_hashrate(threads, nonces);
+    if (hashrate < best_hashrate * TUNE_MIN_GAIN) {
+      break;
+    }
+    best = threads;
+    best_hashrate = hashrate;
+    // Powers of two and then the limit itself.
+    if (threads == max_threads) {
       break;
     }
+    threads = threads * 2 > max_threads ? max_threads : threads * 2;
   }
+  tuned_pool_size = best;
+}
 
-  // Wait for only spawned threads.
-  while (i--) {
-    pthread_join(threads[i], NULL);
+size_t pow_tuned_pool_size() {
+  pow_once(&tune_once, tune_pool_size);
+  return tuned_pool_size;
+}
+
+void pow_initial_hash(const uint8_t* const* chunks,
+                      const size_t* lengths,
+                      size_t count,
+                      uint8_t* initial_hash) {
+  SHA512_CTX ctx;
+  SHA512_Init(&ctx);
+  for (size_t i = 0; i < count; i++) {
+    SHA512_Update(&ctx, chunks[i], lengths[i]);
   }
+  SHA512_Final(initial_hash, &ctx);
+}
+
+bool pow_check(const uint8_t* payload, size_t length, uint64_t target) {
+  if (length < 8) {
+    return false;
+  }
+  uint8_t initial_hash[HASH_SIZE];
+  PowBlock block;
+  SHA512(payload + 8, length - 8, initial_hash);
+  pow_block_init(&block, initial_hash);
+  uint64_t nonce = 0;
+  for (size_t i = 0; i < 8; i++) {
+    nonce = (nonce << 8) | payload[i];
+  }
+  return pow_trial(&block, nonce) <= target;
+}
 
-  // Set resulting nonce, cleanup and exit;
-  if (pow_args.result == RESULT_OK) {
-    *nonce = pow_args.nonce;
+// Unsigned 128-bit integer for `pow_target`, MSVC has no `__int128`.
+typedef struct {
+  uint64_t hi;
+  uint64_t lo;
+} U128;
+
+static U128 mul_64x64(uint64_t a, uint64_t b) {
+  uint64_t a_lo = a & 0xffffffff;
+  uint64_t a_hi = a >> 32;
+  uint64_t b_lo = b & 0xffffffff;
+  uint64_t b_hi = b >> 32;
+  uint64_t p0 = a_lo * b_lo;
+  uint64_t p1 = a_lo * b_hi;
+  uint64_t p2 = a_hi * b_lo;
+  uint64_t mid = (p0 >> 32) + (p1 & 0xffffffff) + (p2 & 0xffffffff);
+  U128 result;
+  result.lo = (mid << 32) | (p0 & 0xffffffff);
+  result.hi = a_hi * b_hi + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+  return result;
+}
+
+// Multiply in place. Returns false on overflow.
+static bool mul_128x64(U128* a, uint64_t b) {
+  U128 lo = mul_64x64(a->lo, b);
+  U128 hi = mul_64x64(a->hi, b);
+  if (hi.hi || lo.hi + hi.lo < lo.hi) {
+    return false;
+  }
+  a->hi = lo.hi + hi.lo;
+  a->lo = lo.lo;
+  return true;
+}
+
+static bool less_128(U128 a, U128 b) {
+  return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+int pow_target(int64_t ttl,
+               uint64_t payload_length,
+               uint64_t trials_per_byte,
+               uint64_t extra_bytes,
+               uint64_t* target) {
+  // Dividend is 2^80.
+  const U128 dividend = {(uint64_t)1 << 16, 0};
+  if (ttl <= -65536 || !trials_per_byte) {
+    return RESULT_BAD_INPUT;
+  }
+  // Length may take 65 bits.
+  uint64_t length = payload_length + extra_bytes;
+  bool length_carry = length < payload_length;
+  if (!length && !length_carry) {
+    return RESULT_BAD_INPUT;
+  }
+  U128 denominator = mul_64x64((uint64_t)ttl + 65536, trials_per_byte);
+  U128 scaled = denominator;
+  bool fits = mul_128x64(&scaled, length);
+  if (fits && length_carry) {
+    fits = denominator.hi == 0 &&
+           scaled.hi + denominator.lo >= scaled.hi;
+    scaled.hi += denominator.lo;
+  }
+  // Any denominator above the dividend gives zero target.
+  if (!fits || less_128(dividend, scaled)) {
+    *target = 0;
+    return RESULT_OK;
+  }
+  // Quotient doesn't fit 64 bits for denominators up to 2^16.
+  if (scaled.hi == 0 && scaled.lo <= ((uint64_t)1 << 16)) {
+    *target = UINT64_MAX;
+    return RESULT_OK;
+  }
+  // Binary long division of 2^80, quotient is below 2^64 here.
+  U128 remainder = {0, 0};
+  uint64_t quotient = 0;
+  for (int bit = 80; bit >= 0; bit--) {
+    remainder.hi = (remainder.hi << 1) | (remainder.lo >> 63);
+    remainder.lo = (remainder.lo << 1) | (bit == 80);
+    if (!less_128(remainder, scaled)) {
+      uint64_t borrow = remainder.lo < scaled.lo;
+      remainder.lo -= scaled.lo;
+      remainder.hi -= scaled.hi + borrow;
+      if (bit < 64) {
+        quotient |= (uint64_t)1 << bit;
+      }
+    }
   }
-  pthread_mutex_destroy(&mutex);
-  return pow_args.result;
+  *target = quotient;
+  return RESULT_OK;
 }
@@ -1,9 +1,255 @@
 #ifndef BITCHAN_BITMESSAGE_POW_H_
 #define BITCHAN_BITMESSAGE_POW_H_
 
+#include <limits.h>
+#include "./topology.h"
+
 static const size_t MAX_POOL_SIZE = 1024;
+static const size_t MAX_DEVICES = 8;
 static const size_t HASH_SIZE = 64;
 
+enum PowResult {
+  RESULT_OK = 0,
+  RESULT_OVERFLOW = -1,
+  RESULT_ERROR = -2,
+  RESULT_BAD_INPUT = -3,
+  RESULT_NOT_READY = -4,
+  RESULT_SHUTDOWN = -5,
+  RESULT_CANCELLED = -6,
+  RESULT_NOT_FOUND = -7
+};
+
+typedef struct PowJob PowJob;
+
+typedef struct {
+  uint64_t trials;
+  // Nanoseconds.
+  uint64_t elapsed;
+} PowStats;
+
+// Nonces [start, end).
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+} PowRange;
+
+// Called from a pool thread (or from `pow_shutdown` caller) once job is
+// finished. Job is already removed from the queue so it's safe to free
+// it here or later.
+typedef void (*PowCallback)(PowJob* job, void* data);
+
+// Check candidates [nonce, nonce + count) of a generic search job.
+// Returns true and sets `found` to the first matching one. Called from
+// several pool threads at once.
+typedef bool (*PowCheckFn)(void* ctx,
+                           uint64_t nonce,
+                           size_t count,
+                           uint64_t* found);
+
+// Generic search run by the pool in place of the POW kernel. Candidates
+// are numbered the same way as nonces and searched by the same chunks,
+// so such jobs are scheduled, preempted and cancelled like POW ones.
+typedef struct {
+  PowCheckFn check;
+  void* ctx;
+  // Candidates passed to `check` at once.
+  size_t batch;
+  // Report the lowest matching candidate instead of the first found
+  // one, for searches which must be deterministic.
+  bool lowest;
+} PowSearch;
+
+// Search nonces `start + i * stride` for `i < count` of the POW with
+// the given initial hash. Returns `RESULT_OK` and sets `found` to the
+// lowest matching nonce, `RESULT_NOT_FOUND` if there is none or any
+// other result on device error which fails the job.
+typedef int (*PowDeviceFn)(void* ctx,
+                           const uint8_t* initial_hash,
+                           uint64_t target,
+                           uint64_t start,
+                           uint64_t stride,
+                           uint64_t count,
+                           uint64_t* found);
+
+// External POW engine such as GPU. Every device is driven by its own
+// pool thread which takes nonce ranges from the same jobs as the CPU
+// threads, sized to take about the same time. Device context is used
+// by that thread only.
+typedef struct {
+  PowDeviceFn run;
+  void* ctx;
+  // Minimal and maximal number of nonces per call.
+  uint64_t min_batch;
+  uint64_t max_batch;
+} PowDevice;
+
+// Device modules are built separately (see binding.gyp) and loaded at
+// runtime. They export `POW_DEVICE_PROBE` function which fills up to
+// `max_devices` available devices and returns their number.
+typedef size_t (*PowDeviceProbeFn)(PowDevice* devices, size_t max_devices);
+static const char POW_DEVICE_PROBE[] = "pow_device_probe";
+
+// Engines a job may run on, see `pow_job_set_backends`.
+enum PowBackend {
+  BACKEND_CPU = 1,
+  BACKEND_DEVICE = 2,
+  BACKEND_HYBRID = BACKEND_CPU | BACKEND_DEVICE
+};
+
+// Create a new POW job. `pool_size` limits the number of pool threads
+// working on this job. Returns NULL on bad input.
+PowJob* pow_job_new(size_t pool_size,
+                    uint64_t target,
+                    const uint8_t* initial_hash,
+                    uint64_t max_nonce);
+
+// Create a new generic search job, see `PowSearch`. Search context must
+// outlive the job. Returns NULL on bad input.
+PowJob* pow_job_new_search(size_t pool_size,
+                           const PowSearch* search,
+                           uint64_t max_nonce);
+
+void pow_job_free(PowJob* job);
+
+// Set scheduling parameters; must be called before `pow_submit`. Jobs
+// with higher `priority` are served first and preempt running lower
+// priority jobs, which are paused keeping their search position. Among
+// equal priorities jobs with earlier `deadline` (any monotonic
+// timestamp, zero for none) go first. Defaults are zero.
+void pow_job_set_priority(PowJob* job, int priority, uint64_t deadline);
+
+// Priority of short searches something else waits for (key search,
+// trial decryption, signature checks), above any POW so they never
+// queue behind one. Not available to POW jobs.
+static const int POW_PRIORITY_URGENT = INT_MAX;
+
+// Search only nonces `start + i * stride` below `end` so one POW can be
+// split between several jobs, processes or hosts; must be called before
+// `pow_submit`. Job fails with `RESULT_NOT_FOUND` once the range is
+// searched. Checkpoint ranges and cursor count steps `i`. Search jobs
+// accept only `[0, end)` with stride 1 which limits their candidates.
+// Returns `RESULT_BAD_INPUT` if range is empty or not supported.
+int pow_job_set_range(PowJob* job,
+                      uint64_t start,
+                      uint64_t end,
+                      uint64_t stride);
+
+// Select engines of the POW job, CPU only by default; must be called
+// before `pow_submit`. Device jobs are cancelled and preempted after
+// the current device call. Returns `RESULT_BAD_INPUT` if there is no
+// engine to run the job.
+int pow_job_set_backends(PowJob* job, int backends);
+
+// Return job result and set resulting nonce on success.
+int pow_job_result(const PowJob* job, uint64_t* nonce);
+
+// Fill job statistics: `total` gets all trials and wall time since the
+// first thread joined till the result; `slots` gets trials and busy
+// time of each thread slot, up to `max_slots`. Returns the number of
+// filled slots. Safe to call from any thread at any time before
+// `pow_job_free`.
+size_t pow_job_stats(const PowJob* job,
+                     PowStats* total,
+                     PowStats* slots,
+                     size_t max_slots);
+
+// Save search progress of the job: the not yet searched nonces are
+// `ranges` plus everything from `cursor`. Ranges being searched are
+// saved up to the last kernel call. Returns the total number of ranges,
+// only the first `max_ranges` are filled. Safe to call from any thread
+// at any time before `pow_job_free`.
+size_t pow_job_checkpoint(const PowJob* job,
+                          PowRange* ranges,
+                          size_t max_ranges,
+                          uint64_t* cursor);
+
+// Continue the search from the saved progress, see
+// `pow_job_checkpoint`; must be called before `pow_submit`. Ranges are
+// searched first, in the given order. Returns `RESULT_BAD_INPUT` if
+// some range is empty.
+int pow_job_restore(PowJob* job,
+                    const PowRange* ranges,
+                    size_t count,
+                    uint64_t cursor);
+
+// Queue job to the shared thread pool, starting it if needed.
+int pow_submit(PowJob* job, PowCallback callback, void* data);
+
+// Stop the job. Queued job is reported right away from the calling
+// thread, running one as soon as its threads notice the flag (next
+// kernel call). Returns `RESULT_NOT_READY` if job has already finished.
+int pow_cancel(PowJob* job);
+
+// Fix the number of pool threads. Zero means the pool grows lazily up
+// to the biggest requested job pool size.
+int pow_set_pool_size(size_t pool_size);
+
+// Pin pool threads to CPUs, see `pow_placement`. Running threads are
+// moved after their current chunk. Returns `RESULT_BAD_INPUT` if no
+// CPU matches.
+int pow_set_affinity(const PowAffinity* affinity);
+
+// Limit CPU time of pool threads to `duty` percent, 100 for no limit.
+// Every thread keeps computing at full speed by chunks and sleeps in
+// between, so all jobs keep their threads and only go slower; e.g. 8
+// threads at 50% use about 4 cores. Changes apply to running jobs
+// within a chunk. Devices are not limited. Returns `RESULT_BAD_INPUT` if
+// `duty` is out of [1, 100].
+int pow_set_budget(int duty);
+
+// Add device to the pool, its thread is started on the next submit.
+// Devices can't be removed. Returns `RESULT_ERROR` if there are
+// `MAX_DEVICES` already and `RESULT_BAD_INPUT` if batch limits are
+// wrong.
+int pow_add_device(const PowDevice* device);
+
+// Return the number of added devices.
+size_t pow_get_device_count();
+
+// Return the current number of pool threads.
+size_t pow_get_pool_size();
+
+// Fill trials and busy time since start of every running pool thread,
+// up to `max_threads`. Returns the number of filled entries.
+size_t pow_thread_stats(PowStats* threads, size_t max_threads);
+
+// Stop all pool threads, failing queued jobs with `RESULT_SHUTDOWN`.
+// Pool will be started again on the next submit. Must not be called
+// from inside a job callback.
+void pow_shutdown();
+
+// Submit the job and wait for its result, see `pow_job_result`.
+int pow_job_wait(PowJob* job, uint64_t* nonce);
+
+// Compute target `2^80 / ((ttl + 2^16) * (payload_length + extra_bytes)
+// * trials_per_byte)` exactly, the same as PyBitmessage does but without
+// precision loss. Result is clamped to 64 bits. Returns
+// `RESULT_BAD_INPUT` if denominator is not positive.
+int pow_target(int64_t ttl,
+               uint64_t payload_length,
+               uint64_t trials_per_byte,
+               uint64_t extra_bytes,
+               uint64_t* target);
+
+// Pick the pool size giving the best aggregate hashrate: POW kernel is
+// run on 1, 2, 4... threads up to the number of cores available to the
+// process, or to its cgroup CPU quota rounded up if that's lower, while
+// hashrate keeps growing. It's done on the first call, which blocks for
+// up to a few seconds, the result is cached.
+size_t pow_tuned_pool_size();
+
+// Compute initial hash of the object data without nonce passed by
+// `count` chunks.
+void pow_initial_hash(const uint8_t* const* chunks,
+                      const size_t* lengths,
+                      size_t count,
+                      uint8_t* initial_hash);
+
+// Check POW of the object payload (nonce followed by the rest of the
+// object) against the target.
+bool pow_check(const uint8_t* payload, size_t length, uint64_t target);
+
+// Blocking POW, for the tools which don't need the queue.
 int pow(size_t pool_size,
         uint64_t target,
         const uint8_t* initial_hash,
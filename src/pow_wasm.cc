@@ -0,0 +1,88 @@
+// WebAssembly POW kernel for Browser workers. It's the same multi-buffer
+// double SHA-512 as native kernels use, with two lanes of SIMD128, and
+// is built freestanding (no libc, no OpenSSL) with `npm run wasm`:
+//
+//   clang++ --target=wasm32 -O3 -msimd128 -nostdlib ...
+//
+// Every Web Worker instantiates its own copy of the module, so there
+// are no threads here; parallelism comes from the worker pool.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <wasm_simd128.h>
+#include "./pow.h"
+#include "./sha512.h"
+#include "./sha512_consts.h"
+
+#define POW_WASM_EXPORT(name) \
+  extern "C" __attribute__((export_name(#name)))
+
+#define LANE_VEC v128_t
+#define LANE_ATTR
+#define LANE_FN kernel_simd128
+#define LANE_SET1(x) wasm_i64x2_splat((int64_t)(x))
+#define LANE_LOAD(p) wasm_v128_load(p)
+#define LANE_STORE(p, v) wasm_v128_store(p, v)
+#define LANE_ADD(a, b) wasm_i64x2_add(a, b)
+#define LANE_XOR(a, b) wasm_v128_xor(a, b)
+#define LANE_SHR(x, n) wasm_u64x2_shr(x, n)
+#define LANE_ROTR(x, n) \
+  wasm_v128_or(wasm_u64x2_shr(x, n), wasm_i64x2_shl(x, 64 - (n)))
+// `e ? f : g` and majority as `a ^ b ? c : a`.
+#define LANE_CH(e, f, g) wasm_v128_bitselect(f, g, e)
+#define LANE_MAJ(a, b, c) wasm_v128_bitselect(c, a, wasm_v128_xor(a, b))
+#include "./sha512_lanes.h"
+
+static const size_t LANES = 2;
+
+static uint8_t initial_hash[HASH_SIZE];
+static PowBlock block;
+
+// Address of the 64-byte buffer to put initial hash of the job into.
+POW_WASM_EXPORT(pow_wasm_hash) uint8_t* pow_wasm_hash() {
+  return initial_hash;
+}
+
+// Search `count` nonces `start + i * stride` of the initial hash put
+// into `pow_wasm_hash()` buffer. Returns the first matching `i` or -1.
+// Nonces are passed as doubles so the caller doesn't need BigInt, they
+// must be below 2^53.
+POW_WASM_EXPORT(pow_wasm_search) int32_t pow_wasm_search(uint32_t target_hi,
+                                                         uint32_t target_lo,
+                                                         double start,
+                                                         double stride,
+                                                         int32_t count) {
+  uint64_t target = ((uint64_t)target_hi << 32) | target_lo;
+  uint64_t nonce = (uint64_t)start;
+  uint64_t step = (uint64_t)stride;
+  uint64_t nonces[LANES] __attribute__((aligned(16)));
+  uint64_t trials[LANES] __attribute__((aligned(16)));
+  size_t i, lane;
+
+  // Only schedule words are used by the lanes kernel.
+  for (i = 0; i < 16; i++) {
+    block.schedule[i] = 0;
+  }
+  for (i = 0; i < 8; i++) {
+    uint64_t word = 0;
+    for (size_t j = 0; j < 8; j++) {
+      word = (word << 8) | initial_hash[i * 8 + j];
+    }
+    block.schedule[i + 1] = word;
+  }
+  block.schedule[9] = 0x8000000000000000ULL;
+  block.schedule[15] = (HASH_SIZE + sizeof(uint64_t)) * 8;
+
+  for (i = 0; i < (size_t)count; i += LANES) {
+    for (lane = 0; lane < LANES; lane++) {
+      nonces[lane] = nonce + (i + lane) * step;
+    }
+    kernel_simd128(&block, nonces, trials);
+    for (lane = 0; lane < LANES && i + lane < (size_t)count; lane++) {
+      if (trials[lane] <= target) {
+        return (int32_t)(i + lane);
+      }
+    }
+  }
+  return -1;
+}
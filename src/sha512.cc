@@ -0,0 +1,424 @@
+// Double SHA-512 kernels used by the POW engine. Every kernel computes
+// trial values for `lanes` nonces per call; the best available one is
+// selected at runtime from CPUID/HWCAP and fixed-layout scalar one is
+// used as the fallback. Portable C kernel and the streaming OpenSSL one
+// are never selected automatically but kept for platforms without
+// OpenSSL assembly and as a reference for benchmarks.
+
+#include <stdint.h>
+#include <string.h>
+#include <openssl/sha.h>
+#include "./pow.h"
+#include "./sha512.h"
+#include "./sha512_consts.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// Target attributes for intrinsics are only usable since GCC 4.9.
+#if defined(__clang__) || __GNUC__ > 4 || \
+    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define POW_HAVE_AVX2
+#endif
+#if defined(__clang__) || __GNUC__ >= 5
+#define POW_HAVE_AVX512
+#endif
+#define POW_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// MSVC allows any intrinsic without target attributes.
+#if defined(_MSC_VER) && !defined(__clang__) && \
+    (defined(_M_X64) || defined(_M_IX86))
+#define POW_HAVE_AVX2
+#define POW_HAVE_AVX512
+#define POW_TARGET(isa)
+#endif
+
+#if (defined(__aarch64__) && defined(__ARM_NEON)) || defined(_M_ARM64)
+#define POW_HAVE_NEON
+#endif
+
+#if defined(POW_HAVE_AVX2) || defined(POW_HAVE_AVX512)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+#ifdef POW_HAVE_NEON
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+static const size_t BLOCK_SIZE = 128;
+static const size_t MESSAGE_SIZE = HASH_SIZE+sizeof(uint64_t);
+
+// Byte order is never assumed: hosts known to be little-endian swap
+// with a builtin, the rest assemble words byte by byte.
+static inline uint64_t load_be64(const uint8_t* p) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return __builtin_bswap64(x);
+#elif defined(_MSC_VER)
+  // Every Windows target is little-endian.
+  uint64_t x;
+  memcpy(&x, p, sizeof(x));
+  return _byteswap_uint64(x);
+#else
+  return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+         ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+         ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+         ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+#endif
+}
+
+static inline void store_be64(uint8_t* p, uint64_t x) {
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && \
+    __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  x = __builtin_bswap64(x);
+  memcpy(p, &x, sizeof(x));
+#elif defined(_MSC_VER)
+  x = _byteswap_uint64(x);
+  memcpy(p, &x, sizeof(x));
+#else
+  for (size_t i = 0; i < 8; i++) {
+    p[i] = (uint8_t)(x >> (56 - i * 8));
+  }
+#endif
+}
+
+void pow_block_init(PowBlock* block, const uint8_t* initial_hash) {
+  memset(block->schedule, 0, sizeof(block->schedule));
+  for (size_t i = 0; i < 8; i++) {
+    block->schedule[i + 1] = load_be64(initial_hash + i * 8);
+  }
+  block->schedule[9] = 0x8000000000000000ULL;
+  block->schedule[15] = MESSAGE_SIZE * 8;
+  for (size_t i = 0; i < 16; i++) {
+    store_be64(block->first_block + i * 8, block->schedule[i]);
+  }
+  for (size_t i = 0; i < 8; i++) {
+    store_be64(block->second_padding + i * 8, DIGEST_BLOCK_PADDING[i]);
+  }
+}
+
+// Reference kernel: the same streaming OpenSSL calls POW used to do.
+static void kernel_openssl(const PowBlock* block,
+                           const uint64_t* nonces,
+                           uint64_t* trials) {
+  uint8_t message[MESSAGE_SIZE];
+  uint8_t digest[HASH_SIZE];
+  SHA512_CTX sha;
+
+  memcpy(message, block->first_block, MESSAGE_SIZE);
+  store_be64(message, nonces[0]);
+  SHA512_Init(&sha);
+  SHA512_Update(&sha, message, MESSAGE_SIZE);
+  SHA512_Final(digest, &sha);
+  SHA512_Init(&sha);
+  SHA512_Update(&sha, digest, HASH_SIZE);
+  SHA512_Final(digest, &sha);
+  trials[0] = load_be64(digest);
+}
+
+// Fixed-layout kernel: two bare OpenSSL compressions over prepared
+// blocks, without context setup, buffering and finalization. This way
+// we still use OpenSSL's assembly implementation of the compression.
+static void kernel_fixed(const PowBlock* block,
+                         const uint64_t* nonces,
+                         uint64_t* trials) {
+  uint8_t first[BLOCK_SIZE];
+  uint8_t second[BLOCK_SIZE];
+  SHA512_CTX sha;
+  size_t i;
+
+  memcpy(first, block->first_block, BLOCK_SIZE);
+  store_be64(first, nonces[0]);
+  memcpy(sha.h, SHA512_IV, sizeof(SHA512_IV));
+  SHA512_Transform(&sha, first);
+
+  for (i = 0; i < 8; i++) {
+    store_be64(second + i * 8, sha.h[i]);
+  }
+  memcpy(second + HASH_SIZE, block->second_padding, BLOCK_SIZE - HASH_SIZE);
+  memcpy(sha.h, SHA512_IV, sizeof(SHA512_IV));
+  SHA512_Transform(&sha, second);
+  trials[0] = sha.h[0];
+}
+
+uint64_t pow_trial(const PowBlock* block, uint64_t nonce) {
+  uint64_t trial;
+  kernel_fixed(block, &nonce, &trial);
+  return trial;
+}
+
+// Portable kernel, the same code as SIMD ones but with one lane.
+#define LANE_VEC uint64_t
+#define LANE_ATTR
+#define LANE_FN kernel_portable
+#define LANE_SET1(x) ((uint64_t)(x))
+#define LANE_LOAD(p) (*(p))
+#define LANE_STORE(p, v) (*(p) = (v))
+#define LANE_ADD(a, b) ((a) + (b))
+#define LANE_XOR(a, b) ((a) ^ (b))
+#define LANE_SHR(x, n) ((x) >> (n))
+#define LANE_ROTR(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+#define LANE_CH(e, f, g) (((e) & (f)) ^ (~(e) & (g)))
+#define LANE_MAJ(a, b, c) (((a) & (b)) | ((c) & ((a) | (b))))
+#include "./sha512_lanes.h"
+#undef LANE_VEC
+#undef LANE_ATTR
+#undef LANE_FN
+#undef LANE_SET1
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef LANE_ADD
+#undef LANE_XOR
+#undef LANE_SHR
+#undef LANE_ROTR
+#undef LANE_CH
+#undef LANE_MAJ
+
+#ifdef POW_HAVE_AVX2
+#define LANE_VEC __m256i
+#define LANE_ATTR POW_TARGET("avx2")
+#define LANE_FN kernel_avx2
+#define LANE_SET1(x) _mm256_set1_epi64x((long long)(x))
+#define LANE_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define LANE_STORE(p, v) _mm256_storeu_si256((__m256i*)(p), v)
+#define LANE_ADD(a, b) _mm256_add_epi64(a, b)
+#define LANE_XOR(a, b) _mm256_xor_si256(a, b)
+#define LANE_SHR(x, n) _mm256_srli_epi64(x, n)
+#define LANE_ROTR(x, n) \
+  _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - (n)))
+#define LANE_CH(e, f, g) \
+  _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g))
+#define LANE_MAJ(a, b, c) \
+  _mm256_or_si256(_mm256_and_si256(a, b), \
+                  _mm256_and_si256(c, _mm256_or_si256(a, b)))
+#include "./sha512_lanes.h"
+#undef LANE_VEC
+#undef LANE_ATTR
+#undef LANE_FN
+#undef LANE_SET1
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef LANE_ADD
+#undef LANE_XOR
+#undef LANE_SHR
+#undef LANE_ROTR
+#undef LANE_CH
+#undef LANE_MAJ
+#endif  // POW_HAVE_AVX2
+
+#ifdef POW_HAVE_AVX512
+// GCC 12 warns about the undefined passthrough value inside its own
+// masked AVX-512 intrinsics, see GCC bug 105593.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#define LANE_VEC __m512i
+#define LANE_ATTR POW_TARGET("avx512f")
+#define LANE_FN kernel_avx512
+#define LANE_SET1(x) _mm512_set1_epi64((long long)(x))
+#define LANE_LOAD(p) _mm512_loadu_si512((const void*)(p))
+#define LANE_STORE(p, v) _mm512_storeu_si512((void*)(p), v)
+#define LANE_ADD(a, b) _mm512_add_epi64(a, b)
+#define LANE_XOR(a, b) _mm512_xor_si512(a, b)
+#define LANE_SHR(x, n) _mm512_srli_epi64(x, n)
+#define LANE_ROTR(x, n) _mm512_ror_epi64(x, n)
+// Truth tables for `e ? f : g` and majority of three.
+#define LANE_CH(e, f, g) _mm512_ternarylogic_epi64(e, f, g, 0xca)
+#define LANE_MAJ(a, b, c) _mm512_ternarylogic_epi64(a, b, c, 0xe8)
+#include "./sha512_lanes.h"
+#undef LANE_VEC
+#undef LANE_ATTR
+#undef LANE_FN
+#undef LANE_SET1
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef LANE_ADD
+#undef LANE_XOR
+#undef LANE_SHR
+#undef LANE_ROTR
+#undef LANE_CH
+#undef LANE_MAJ
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif  // POW_HAVE_AVX512
+
+#ifdef POW_HAVE_NEON
+#define LANE_VEC uint64x2_t
+#define LANE_ATTR
+#define LANE_FN kernel_neon
+#define LANE_SET1(x) vdupq_n_u64(x)
+#define LANE_LOAD(p) vld1q_u64(p)
+#define LANE_STORE(p, v) vst1q_u64(p, v)
+#define LANE_ADD(a, b) vaddq_u64(a, b)
+#define LANE_XOR(a, b) veorq_u64(a, b)
+#define LANE_SHR(x, n) vshrq_n_u64(x, n)
+#define LANE_ROTR(x, n) vorrq_u64(vshrq_n_u64(x, n), vshlq_n_u64(x, 64 - (n)))
+#define LANE_CH(e, f, g) veorq_u64(vandq_u64(e, f), vbicq_u64(g, e))
+#define LANE_MAJ(a, b, c) \
+  vorrq_u64(vandq_u64(a, b), vandq_u64(c, vorrq_u64(a, b)))
+#include "./sha512_lanes.h"
+#undef LANE_VEC
+#undef LANE_ATTR
+#undef LANE_FN
+#undef LANE_SET1
+#undef LANE_LOAD
+#undef LANE_STORE
+#undef LANE_ADD
+#undef LANE_XOR
+#undef LANE_SHR
+#undef LANE_ROTR
+#undef LANE_CH
+#undef LANE_MAJ
+#endif  // POW_HAVE_NEON
+
+#if defined(POW_HAVE_AVX2) || defined(POW_HAVE_AVX512)
+static uint64_t read_xcr0() {
+#ifdef _MSC_VER
+  return _xgetbv(0);
+#else
+  uint32_t eax, edx;
+  __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+#endif
+}
+
+// Fill EAX, EBX, ECX and EDX of the CPUID leaf.
+static void read_cpuid(uint32_t leaf, uint32_t subleaf, uint32_t* regs) {
+#ifdef _MSC_VER
+  int info[4];
+  __cpuidex(info, (int)leaf, (int)subleaf);
+  for (size_t i = 0; i < 4; i++) {
+    regs[i] = (uint32_t)info[i];
+  }
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Check CPU and OS support of the wide registers. `xcr0_mask` is the
+// set of register states OS must save on context switch.
+static bool cpu_supports(uint32_t leaf7_ebx_bit, uint64_t xcr0_mask) {
+  uint32_t regs[4];
+  read_cpuid(0, 0, regs);
+  if (regs[0] < 7) {
+    return false;
+  }
+  read_cpuid(1, 0, regs);
+  // OSXSAVE and AVX.
+  if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0) {
+    return false;
+  }
+  if ((read_xcr0() & xcr0_mask) != xcr0_mask) {
+    return false;
+  }
+  read_cpuid(7, 0, regs);
+  return (regs[1] & leaf7_ebx_bit) != 0;
+}
+#endif
+
+#ifdef POW_HAVE_NEON
+static bool cpu_supports_neon() {
+#if defined(__linux__) && defined(HWCAP_ASIMD)
+  return (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0;
+#else
+  // Advanced SIMD is mandatory on AArch64.
+  return true;
+#endif
+}
+#endif
+
+static const PowKernel KERNEL_FIXED = {"fixed", 1, kernel_fixed};
+static const PowKernel KERNEL_PORTABLE = {"portable", 1, kernel_portable};
+static const PowKernel KERNEL_OPENSSL = {"openssl", 1, kernel_openssl};
+#ifdef POW_HAVE_AVX2
+static const PowKernel KERNEL_AVX2 = {"avx2", 4, kernel_avx2};
+#endif
+#ifdef POW_HAVE_AVX512
+static const PowKernel KERNEL_AVX512 = {"avx512", 8, kernel_avx512};
+#endif
+#ifdef POW_HAVE_NEON
+static const PowKernel KERNEL_NEON = {"neon", 2, kernel_neon};
+#endif
+
+// Return whether the given kernel can be run on this CPU.
+static bool kernel_supported(const PowKernel* kernel) {
+#ifdef POW_HAVE_AVX512
+  if (kernel == &KERNEL_AVX512) {
+    // AVX-512F; XMM, YMM, opmask, ZMM_Hi256 and Hi16_ZMM states.
+    return cpu_supports(1 << 16, 0xe6);
+  }
+#endif
+#ifdef POW_HAVE_AVX2
+  if (kernel == &KERNEL_AVX2) {
+    // AVX2; XMM and YMM states.
+    return cpu_supports(1 << 5, 0x06);
+  }
+#endif
+#ifdef POW_HAVE_NEON
+  if (kernel == &KERNEL_NEON) {
+    return cpu_supports_neon();
+  }
+#endif
+  return (kernel == &KERNEL_FIXED ||
+          kernel == &KERNEL_PORTABLE ||
+          kernel == &KERNEL_OPENSSL);
+}
+
+// All known kernels, fastest first. Last two are always supported so
+// they're never selected automatically.
+static const PowKernel* const KERNELS[] = {
+#ifdef POW_HAVE_AVX512
+  &KERNEL_AVX512,
+#endif
+#ifdef POW_HAVE_AVX2
+  &KERNEL_AVX2,
+#endif
+#ifdef POW_HAVE_NEON
+  &KERNEL_NEON,
+#endif
+  &KERNEL_FIXED,
+  &KERNEL_PORTABLE,
+  &KERNEL_OPENSSL,
+};
+
+static const size_t KERNELS_COUNT = sizeof(KERNELS) / sizeof(KERNELS[0]);
+
+const PowKernel* pow_kernel_select() {
+  for (size_t i = 0; i < KERNELS_COUNT; i++) {
+    if (kernel_supported(KERNELS[i])) {
+      return KERNELS[i];
+    }
+  }
+  return &KERNEL_FIXED;
+}
+
+const PowKernel* pow_kernel_find(const char* name) {
+  for (size_t i = 0; i < KERNELS_COUNT; i++) {
+    if (strcmp(KERNELS[i]->name, name) == 0 && kernel_supported(KERNELS[i])) {
+      return KERNELS[i];
+    }
+  }
+  return NULL;
+}
+
+const PowKernel* pow_kernel_at(size_t i) {
+  for (size_t j = 0; j < KERNELS_COUNT; j++) {
+    if (kernel_supported(KERNELS[j]) && i-- == 0) {
+      return KERNELS[j];
+    }
+  }
+  return NULL;
+}
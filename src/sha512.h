@@ -0,0 +1,48 @@
+#ifndef BITCHAN_BITMESSAGE_SHA512_H_
+#define BITCHAN_BITMESSAGE_SHA512_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of nonces a kernel may process per call.
+static const size_t MAX_LANES = 8;
+
+// Per-job kernel input: complete padded first SHA-512 block, both as
+// bytes and as decoded message words, and padding of the second one,
+// so it's prepared only once per job. Only the first word of the first
+// block depends on the nonce.
+typedef struct {
+  uint8_t first_block[128];
+  uint8_t second_padding[64];
+  uint64_t schedule[16];
+} PowBlock;
+
+// Compute trial values (first 8 bytes of
+// `sha512(sha512(nonce || initial_hash))` as a host integer) for
+// `lanes` nonces at once.
+typedef void (*PowKernelFn)(const PowBlock* block,
+                            const uint64_t* nonces,
+                            uint64_t* trials);
+
+typedef struct {
+  const char* name;
+  size_t lanes;
+  PowKernelFn fn;
+} PowKernel;
+
+void pow_block_init(PowBlock* block, const uint8_t* initial_hash);
+
+// Compute trial value of a single nonce, for checks of other's POW
+// where every object has its own block.
+uint64_t pow_trial(const PowBlock* block, uint64_t nonce);
+
+// Return the fastest kernel supported by the running CPU.
+const PowKernel* pow_kernel_select();
+
+// Return kernel by name or NULL if it's not available on this CPU.
+const PowKernel* pow_kernel_find(const char* name);
+
+// Return i-th kernel available on this CPU (fastest first) or NULL.
+const PowKernel* pow_kernel_at(size_t i);
+
+#endif  // BITCHAN_BITMESSAGE_SHA512_H_
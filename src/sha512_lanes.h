@@ -0,0 +1,104 @@
+// Multi-buffer double SHA-512 kernel body. This file is included by
+// `sha512.cc` once per instruction set with the following macros
+// defined:
+//
+//   LANE_VEC            vector type holding one 64-bit word per lane
+//   LANE_ATTR           function attributes (e.g. target ISA)
+//   LANE_FN             name of the resulting kernel function
+//   LANE_SET1(x)        broadcast constant to all lanes
+//   LANE_LOAD(p)        load lanes from `uint64_t` array
+//   LANE_STORE(p, v)    store lanes to `uint64_t` array
+//   LANE_ADD(a, b)      lane-wise addition modulo 2^64
+//   LANE_XOR(a, b)      lane-wise exclusive or
+//   LANE_ROTR(x, n)     lane-wise right rotation
+//   LANE_SHR(x, n)      lane-wise right shift
+//   LANE_CH(e, f, g)    SHA-2 choose function
+//   LANE_MAJ(a, b, c)   SHA-2 majority function
+//
+// Both messages always fit in one padded block so every nonce costs
+// exactly two bare compressions: first block is taken from the per-job
+// template with only its first word replaced by the nonce, second one
+// consists of the first digest and constant padding.
+
+#define LANE_S0(x) \
+  LANE_XOR(LANE_XOR(LANE_ROTR(x, 28), LANE_ROTR(x, 34)), LANE_ROTR(x, 39))
+#define LANE_S1(x) \
+  LANE_XOR(LANE_XOR(LANE_ROTR(x, 14), LANE_ROTR(x, 18)), LANE_ROTR(x, 41))
+#define LANE_SIG0(x) \
+  LANE_XOR(LANE_XOR(LANE_ROTR(x, 1), LANE_ROTR(x, 8)), LANE_SHR(x, 7))
+#define LANE_SIG1(x) \
+  LANE_XOR(LANE_XOR(LANE_ROTR(x, 19), LANE_ROTR(x, 61)), LANE_SHR(x, 6))
+
+#define LANE_ROUND(a, b, c, d, e, f, g, h, i) do { \
+  size_t j = t + (i); \
+  if (j >= 16) { \
+    w[j & 15] = LANE_ADD( \
+      LANE_ADD(w[j & 15], LANE_SIG1(w[(j - 2) & 15])), \
+      LANE_ADD(w[(j - 7) & 15], LANE_SIG0(w[(j - 15) & 15]))); \
+  } \
+  LANE_VEC t1 = LANE_ADD( \
+    LANE_ADD(h, LANE_S1(e)), \
+    LANE_ADD(LANE_CH(e, f, g), \
+             LANE_ADD(LANE_SET1(SHA512_K[j]), w[j & 15]))); \
+  d = LANE_ADD(d, t1); \
+  h = LANE_ADD(t1, LANE_ADD(LANE_S0(a), LANE_MAJ(a, b, c))); \
+} while (0)
+
+// Run 80 rounds over the message schedule `w` starting from the
+// standard IV. Resulting state (without feed-forward) is left in `s`.
+#define LANE_COMPRESS(w, s) do { \
+  LANE_VEC a = LANE_SET1(SHA512_IV[0]); \
+  LANE_VEC b = LANE_SET1(SHA512_IV[1]); \
+  LANE_VEC c = LANE_SET1(SHA512_IV[2]); \
+  LANE_VEC d = LANE_SET1(SHA512_IV[3]); \
+  LANE_VEC e = LANE_SET1(SHA512_IV[4]); \
+  LANE_VEC f = LANE_SET1(SHA512_IV[5]); \
+  LANE_VEC g = LANE_SET1(SHA512_IV[6]); \
+  LANE_VEC h = LANE_SET1(SHA512_IV[7]); \
+  for (size_t t = 0; t < 80; t += 8) { \
+    LANE_ROUND(a, b, c, d, e, f, g, h, 0); \
+    LANE_ROUND(h, a, b, c, d, e, f, g, 1); \
+    LANE_ROUND(g, h, a, b, c, d, e, f, 2); \
+    LANE_ROUND(f, g, h, a, b, c, d, e, 3); \
+    LANE_ROUND(e, f, g, h, a, b, c, d, 4); \
+    LANE_ROUND(d, e, f, g, h, a, b, c, 5); \
+    LANE_ROUND(c, d, e, f, g, h, a, b, 6); \
+    LANE_ROUND(b, c, d, e, f, g, h, a, 7); \
+  } \
+  s[0] = a; s[1] = b; s[2] = c; s[3] = d; \
+  s[4] = e; s[5] = f; s[6] = g; s[7] = h; \
+} while (0)
+
+LANE_ATTR static void LANE_FN(const PowBlock* block,
+                              const uint64_t* nonces,
+                              uint64_t* trials) {
+  LANE_VEC w[16];
+  LANE_VEC s[8];
+  size_t i;
+
+  // First block: nonce || initial_hash || padding.
+  w[0] = LANE_LOAD(nonces);
+  for (i = 1; i < 16; i++) {
+    w[i] = LANE_SET1(block->schedule[i]);
+  }
+  LANE_COMPRESS(w, s);
+
+  // Second block: first digest || padding.
+  for (i = 0; i < 8; i++) {
+    w[i] = LANE_ADD(s[i], LANE_SET1(SHA512_IV[i]));
+  }
+  for (i = 8; i < 16; i++) {
+    w[i] = LANE_SET1(DIGEST_BLOCK_PADDING[i - 8]);
+  }
+  LANE_COMPRESS(w, s);
+
+  // Only the first word of the final digest is the trial value.
+  LANE_STORE(trials, LANE_ADD(s[0], LANE_SET1(SHA512_IV[0])));
+}
+
+#undef LANE_S0
+#undef LANE_S1
+#undef LANE_SIG0
+#undef LANE_SIG1
+#undef LANE_ROUND
+#undef LANE_COMPRESS
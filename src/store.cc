@@ -0,0 +1,724 @@
+// Memory-mapped object log, see `store.ObjectStore`.
+//
+// File starts with 8-byte magic and 4-byte version. Every record has
+// 48-byte header: type, payload length, expiration time (all
+// big-endian) and inventory vector; payload follows padded to 8 bytes.
+// Records never cross region boundaries, the rest of a region is
+// skipped by a padding record.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "./inventory.h"
+#include "./store.h"
+
+#define REGION_SIZE ((uint64_t)1 << 26)
+#define FILE_HEADER_SIZE 16
+#define FILE_VERSION 1
+#define RECORD_HEADER_SIZE 48
+#define MIN_CAPACITY 1024
+// Objects live up to 28 days plus some slack, longer expiration times
+// share buckets with the earlier ones.
+#define BUCKET_SECONDS 3600
+#define BUCKET_COUNT 768
+
+static const uint8_t FILE_MAGIC[8] = {'B', 'M', 'O', 'B', 'J', 'L', 'O', 'G'};
+
+enum {
+  RECORD_OBJECT = 0x4F424A31,
+  RECORD_DELETE = 0x44454C31,
+  RECORD_PAD = 0x50414431,
+};
+
+struct StoreRegion {
+  uint8_t* data;
+  size_t refs;
+};
+
+// Free slots have zero offset, the file header is there.
+typedef struct {
+  uint8_t vector[INV_VECTOR_SIZE];
+  uint64_t offset;
+  int64_t expires;
+} StoreEntry;
+
+// Offsets of records which expire within the same hour (modulo the
+// number of buckets). Deleted and replaced records are removed lazily.
+typedef struct {
+  uint64_t* offsets;
+  size_t count;
+  size_t capacity;
+  int64_t min_expires;
+} StoreBucket;
+
+struct ObjectStore {
+  InvHashKey key;
+  char* path;
+  int fd;
+  uint64_t end;
+  StoreRegion** regions;
+  size_t region_count;
+  StoreEntry* entries;
+  size_t capacity;
+  size_t size;
+  StoreBucket buckets[BUCKET_COUNT];
+};
+
+static uint32_t read_u32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) |
+         ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) |
+         (uint32_t)p[3];
+}
+
+static void write_u32(uint8_t* p, uint32_t value) {
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+static int64_t read_i64(const uint8_t* p) {
+  return (int64_t)(((uint64_t)read_u32(p) << 32) | read_u32(p + 4));
+}
+
+static void write_i64(uint8_t* p, int64_t value) {
+  write_u32(p, (uint32_t)((uint64_t)value >> 32));
+  write_u32(p + 4, (uint32_t)value);
+}
+
+static uint64_t record_size(size_t length) {
+  return RECORD_HEADER_SIZE + ((length + 7) & ~(size_t)7);
+}
+
+// File access, stubbed out on Windows where `store_open` fails.
+#ifdef _WIN32
+static int file_open(const char*) {
+  return -1;
+}
+
+static void file_close(int) {}
+
+static bool file_size(int, uint64_t*) {
+  return false;
+}
+
+static bool write_all(int, const uint8_t*, size_t, uint64_t) {
+  return false;
+}
+
+static bool file_truncate(int, uint64_t) {
+  return false;
+}
+
+static bool file_sync(int) {
+  return false;
+}
+
+static uint8_t* map_region(int, uint64_t) {
+  return NULL;
+}
+
+static void unmap_region(uint8_t*) {}
+
+static bool file_replace(const char*, const char*) {
+  return false;
+}
+#else
+static int file_open(const char* path) {
+  return open(path, O_RDWR | O_CREAT, 0644);
+}
+
+static void file_close(int fd) {
+  close(fd);
+}
+
+static bool file_size(int fd, uint64_t* size) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+  *size = (uint64_t)st.st_size;
+  return true;
+}
+
+static bool write_all(int fd, const uint8_t* data, size_t length,
+                      uint64_t offset) {
+  while (length) {
+    ssize_t written = pwrite(fd, data, length, (off_t)offset);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += written;
+    length -= (size_t)written;
+    offset += (uint64_t)written;
+  }
+  return true;
+}
+
+static bool file_truncate(int fd, uint64_t size) {
+  return ftruncate(fd, (off_t)size) == 0;
+}
+
+static bool file_sync(int fd) {
+  return fsync(fd) == 0;
+}
+
+// Region may extend past the end of file, only the written part is
+// ever read. Shared mapping so records appended later are seen through
+// it; read-only since payloads are handed out as is.
+static uint8_t* map_region(int fd, uint64_t index) {
+  void* data = mmap(NULL, REGION_SIZE, PROT_READ, MAP_SHARED, fd,
+                    (off_t)(index * REGION_SIZE));
+  return data == MAP_FAILED ? NULL : (uint8_t*)data;
+}
+
+static void unmap_region(uint8_t* data) {
+  munmap(data, REGION_SIZE);
+}
+
+static bool file_replace(const char* from, const char* to) {
+  return rename(from, to) == 0;
+}
+#endif
+
+// Return pointer to the mapped record, mapping its region if needed.
+static const uint8_t* map_record(ObjectStore* store,
+                                 uint64_t offset,
+                                 StoreRegion** out) {
+  size_t index = (size_t)(offset / REGION_SIZE);
+  if (index >= store->region_count) {
+    size_t count = index + 1;
+    StoreRegion** regions = (StoreRegion**)realloc(
+      store->regions, count * sizeof(StoreRegion*));
+    if (!regions) {
+      return NULL;
+    }
+    memset(regions + store->region_count, 0,
+           (count - store->region_count) * sizeof(StoreRegion*));
+    store->regions = regions;
+    store->region_count = count;
+  }
+  if (!store->regions[index]) {
+    StoreRegion* region = (StoreRegion*)malloc(sizeof(StoreRegion));
+    uint8_t* data = region ? map_region(store->fd, index) : NULL;
+    if (!data) {
+      free(region);
+      return NULL;
+    }
+    region->data = data;
+    region->refs = 1;
+    store->regions[index] = region;
+  }
+  if (out) {
+    *out = store->regions[index];
+  }
+  return store->regions[index]->data + offset % REGION_SIZE;
+}
+
+// Keyed so clusters stay short whatever vectors peers send, which
+// keeps both probing and backward shift deletion cheap.
+static size_t home_slot(const ObjectStore* store, const uint8_t* vector) {
+  return (size_t)inv_vector_hash(&store->key, vector) &
+         (store->capacity - 1);
+}
+
+// Return slot of the vector or of the free slot where it belongs.
+static size_t find_slot(const ObjectStore* store, const uint8_t* vector) {
+  size_t mask = store->capacity - 1;
+  size_t i = home_slot(store, vector);
+  while (store->entries[i].offset &&
+         memcmp(store->entries[i].vector, vector, INV_VECTOR_SIZE) != 0) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static bool index_alloc(ObjectStore* store, size_t capacity) {
+  StoreEntry* entries = (StoreEntry*)calloc(capacity, sizeof(StoreEntry));
+  if (!entries) {
+    return false;
+  }
+  store->entries = entries;
+  store->capacity = capacity;
+  return true;
+}
+
+static bool grow(ObjectStore* store) {
+  StoreEntry* old = store->entries;
+  size_t old_capacity = store->capacity;
+  if (!index_alloc(store, old_capacity * 2)) {
+    return false;
+  }
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old[i].offset) {
+      store->entries[find_slot(store, old[i].vector)] = old[i];
+    }
+  }
+  free(old);
+  return true;
+}
+
+// Backward shift deletion keeps probe sequences unbroken without
+// tombstones.
+static void remove_slot(ObjectStore* store, size_t i) {
+  size_t mask = store->capacity - 1;
+  size_t j = i;
+  for (;;) {
+    j = (j + 1) & mask;
+    if (!store->entries[j].offset) {
+      break;
+    }
+    size_t home = home_slot(store, store->entries[j].vector);
+    // Entry stays if its home is cyclically within (i, j].
+    bool stays = i < j ? (home > i && home <= j) : (home > i || home <= j);
+    if (!stays) {
+      store->entries[i] = store->entries[j];
+      i = j;
+    }
+  }
+  store->entries[i].offset = 0;
+  store->size--;
+}
+
+static StoreBucket* get_bucket(ObjectStore* store, int64_t expires) {
+  int64_t hour = expires / BUCKET_SECONDS;
+  int64_t index = hour % BUCKET_COUNT;
+  return &store->buckets[index < 0 ? index + BUCKET_COUNT : index];
+}
+
+static bool bucket_add(ObjectStore* store, uint64_t offset, int64_t expires) {
+  StoreBucket* bucket = get_bucket(store, expires);
+  if (bucket->count == bucket->capacity) {
+    size_t capacity = bucket->capacity ? bucket->capacity * 2 : 16;
+    uint64_t* offsets = (uint64_t*)realloc(bucket->offsets,
+                                           capacity * sizeof(uint64_t));
+    if (!offsets) {
+      return false;
+    }
+    bucket->offsets = offsets;
+    bucket->capacity = capacity;
+  }
+  if (!bucket->count || expires < bucket->min_expires) {
+    bucket->min_expires = expires;
+  }
+  bucket->offsets[bucket->count++] = offset;
+  return true;
+}
+
+// Index the object record, replacing the older one.
+static bool index_put(ObjectStore* store,
+                      const uint8_t* vector,
+                      uint64_t offset,
+                      int64_t expires) {
+  if ((store->size + 1) * 4 > store->capacity * 3 && !grow(store)) {
+    return false;
+  }
+  if (!bucket_add(store, offset, expires)) {
+    return false;
+  }
+  StoreEntry* entry = &store->entries[find_slot(store, vector)];
+  if (!entry->offset) {
+    memcpy(entry->vector, vector, INV_VECTOR_SIZE);
+    store->size++;
+  }
+  entry->offset = offset;
+  entry->expires = expires;
+  return true;
+}
+
+static void index_remove(ObjectStore* store, const uint8_t* vector) {
+  size_t slot = find_slot(store, vector);
+  if (store->entries[slot].offset) {
+    remove_slot(store, slot);
+  }
+}
+
+// Read the index from record headers. Stops at the first record which
+// is malformed or not written completely.
+static int load(ObjectStore* store, int64_t now) {
+  uint64_t size;
+  if (!file_size(store->fd, &size)) {
+    return STORE_IO_ERROR;
+  }
+  if (!size) {
+    uint8_t header[FILE_HEADER_SIZE];
+    memset(header, 0, sizeof(header));
+    memcpy(header, FILE_MAGIC, sizeof(FILE_MAGIC));
+    write_u32(header + sizeof(FILE_MAGIC), FILE_VERSION);
+    if (!write_all(store->fd, header, sizeof(header), 0)) {
+      return STORE_IO_ERROR;
+    }
+    store->end = FILE_HEADER_SIZE;
+    return STORE_OK;
+  }
+  if (size < FILE_HEADER_SIZE) {
+    return STORE_BAD_FILE;
+  }
+  const uint8_t* header = map_record(store, 0, NULL);
+  if (!header) {
+    return STORE_NO_MEMORY;
+  }
+  if (memcmp(header, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 ||
+      read_u32(header + sizeof(FILE_MAGIC)) != FILE_VERSION) {
+    return STORE_BAD_FILE;
+  }
+
+  uint64_t pos = FILE_HEADER_SIZE;
+  for (;;) {
+    uint64_t left = REGION_SIZE - pos % REGION_SIZE;
+    if (left < RECORD_HEADER_SIZE) {
+      pos += left;
+      continue;
+    }
+    if (pos + RECORD_HEADER_SIZE > size) {
+      break;
+    }
+    const uint8_t* record = map_record(store, pos, NULL);
+    if (!record) {
+      return STORE_NO_MEMORY;
+    }
+    uint32_t type = read_u32(record);
+    uint32_t length = read_u32(record + 4);
+    if (type == RECORD_PAD) {
+      pos += left;
+      continue;
+    }
+    if ((type != RECORD_OBJECT && type != RECORD_DELETE) ||
+        length > STORE_MAX_LENGTH ||
+        pos + RECORD_HEADER_SIZE + length > size) {
+      break;
+    }
+    int64_t expires = read_i64(record + 8);
+    const uint8_t* vector = record + 16;
+    if (type == RECORD_DELETE) {
+      index_remove(store, vector);
+    } else if (expires > now) {
+      if (!index_put(store, vector, pos, expires)) {
+        return STORE_NO_MEMORY;
+      }
+    } else {
+      // Expired copy must not shadow the older one.
+      index_remove(store, vector);
+    }
+    pos += record_size(length);
+  }
+  store->end = pos;
+  if (pos < size && !file_truncate(store->fd, pos)) {
+    return STORE_IO_ERROR;
+  }
+  return STORE_OK;
+}
+
+int store_open(const char* path, int64_t now, ObjectStore** out) {
+#ifdef _WIN32
+  (void)path;
+  (void)now;
+  (void)out;
+  return STORE_UNSUPPORTED;
+#else
+  ObjectStore* store = (ObjectStore*)calloc(1, sizeof(ObjectStore));
+  if (!store) {
+    return STORE_NO_MEMORY;
+  }
+  store->fd = -1;
+  store->path = strdup(path);
+  if (!store->path ||
+      !inv_hash_key_new(&store->key) ||
+      !index_alloc(store, MIN_CAPACITY)) {
+    store_close(store);
+    return STORE_NO_MEMORY;
+  }
+  store->fd = file_open(path);
+  int error = store->fd < 0 ? STORE_IO_ERROR : load(store, now);
+  if (error) {
+    store_close(store);
+    return error;
+  }
+  *out = store;
+  return STORE_OK;
+#endif
+}
+
+void store_close(ObjectStore* store) {
+  for (size_t i = 0; i < store->region_count; i++) {
+    if (store->regions[i]) {
+      store_region_release(store->regions[i]);
+    }
+  }
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    free(store->buckets[i].offsets);
+  }
+  if (store->fd >= 0) {
+    file_close(store->fd);
+  }
+  free(store->regions);
+  free(store->entries);
+  free(store->path);
+  free(store);
+}
+
+size_t store_size(const ObjectStore* store) {
+  return store->size;
+}
+
+// Append the record and return its offset. Payload is written before
+// the header so a valid header is never followed by garbage after a
+// crash.
+static int append(ObjectStore* store,
+                  uint32_t type,
+                  const uint8_t* vector,
+                  int64_t expires,
+                  const uint8_t* data,
+                  size_t length,
+                  uint64_t* offset) {
+  static const uint8_t zeros[8] = {0};
+  uint8_t header[RECORD_HEADER_SIZE];
+  uint64_t size = record_size(length);
+  uint64_t pos = store->end;
+  uint64_t left = REGION_SIZE - pos % REGION_SIZE;
+  if (size > left) {
+    if (left >= RECORD_HEADER_SIZE) {
+      memset(header, 0, sizeof(header));
+      write_u32(header, RECORD_PAD);
+      if (!write_all(store->fd, header, sizeof(header), pos)) {
+        return STORE_IO_ERROR;
+      }
+    }
+    pos += left;
+  }
+  memset(header, 0, sizeof(header));
+  write_u32(header, type);
+  write_u32(header + 4, (uint32_t)length);
+  write_i64(header + 8, expires);
+  memcpy(header + 16, vector, INV_VECTOR_SIZE);
+  size_t padding = (size_t)(size - RECORD_HEADER_SIZE - length);
+  if ((length &&
+       !write_all(store->fd, data, length, pos + RECORD_HEADER_SIZE)) ||
+      (padding &&
+       !write_all(store->fd, zeros, padding,
+                  pos + RECORD_HEADER_SIZE + length)) ||
+      !write_all(store->fd, header, sizeof(header), pos)) {
+    return STORE_IO_ERROR;
+  }
+  store->end = pos + size;
+  *offset = pos;
+  return STORE_OK;
+}
+
+int store_put(ObjectStore* store,
+              const uint8_t* vector,
+              int64_t expires,
+              const uint8_t* data,
+              size_t length,
+              bool* added) {
+  *added = false;
+  if (length > STORE_MAX_LENGTH) {
+    return STORE_TOO_LARGE;
+  }
+  if (store_contains(store, vector)) {
+    return STORE_OK;
+  }
+  uint64_t offset;
+  int error = append(store, RECORD_OBJECT, vector, expires, data, length,
+                     &offset);
+  if (error) {
+    return error;
+  }
+  if (!index_put(store, vector, offset, expires)) {
+    return STORE_NO_MEMORY;
+  }
+  *added = true;
+  return STORE_OK;
+}
+
+bool store_get(ObjectStore* store,
+               const uint8_t* vector,
+               const uint8_t** data,
+               size_t* length,
+               int64_t* expires,
+               StoreRegion** region) {
+  const StoreEntry* entry = &store->entries[find_slot(store, vector)];
+  if (!entry->offset) {
+    return false;
+  }
+  const uint8_t* record = map_record(store, entry->offset, region);
+  if (!record) {
+    return false;
+  }
+  (*region)->refs++;
+  *data = record + RECORD_HEADER_SIZE;
+  *length = read_u32(record + 4);
+  *expires = entry->expires;
+  return true;
+}
+
+void store_region_release(StoreRegion* region) {
+  if (--region->refs == 0) {
+    unmap_region(region->data);
+    free(region);
+  }
+}
+
+bool store_contains(const ObjectStore* store, const uint8_t* vector) {
+  return store->entries[find_slot(store, vector)].offset != 0;
+}
+
+int store_delete(ObjectStore* store, const uint8_t* vector, bool* deleted) {
+  *deleted = false;
+  size_t slot = find_slot(store, vector);
+  if (!store->entries[slot].offset) {
+    return STORE_OK;
+  }
+  uint64_t offset;
+  int error = append(store, RECORD_DELETE, vector, 0, NULL, 0, &offset);
+  if (error) {
+    return error;
+  }
+  remove_slot(store, slot);
+  *deleted = true;
+  return STORE_OK;
+}
+
+size_t store_prune(ObjectStore* store, int64_t now) {
+  size_t pruned = 0;
+  for (size_t i = 0; i < BUCKET_COUNT; i++) {
+    StoreBucket* bucket = &store->buckets[i];
+    if (!bucket->count || bucket->min_expires > now) {
+      continue;
+    }
+    size_t kept = 0;
+    int64_t min_expires = INT64_MAX;
+    for (size_t j = 0; j < bucket->count; j++) {
+      uint64_t offset = bucket->offsets[j];
+      const uint8_t* record = map_record(store, offset, NULL);
+      if (!record) {
+        // Try again on the next prune.
+        bucket->offsets[kept++] = offset;
+        min_expires = INT64_MIN;
+        continue;
+      }
+      size_t slot = find_slot(store, record + 16);
+      const StoreEntry* entry = &store->entries[slot];
+      // Deleted or replaced.
+      if (entry->offset != offset) {
+        continue;
+      }
+      if (entry->expires <= now) {
+        remove_slot(store, slot);
+        pruned++;
+        continue;
+      }
+      if (entry->expires < min_expires) {
+        min_expires = entry->expires;
+      }
+      bucket->offsets[kept++] = offset;
+    }
+    bucket->count = kept;
+    bucket->min_expires = min_expires;
+  }
+  return pruned;
+}
+
+size_t store_vectors(const ObjectStore* store, uint8_t* out) {
+  size_t count = 0;
+  for (size_t i = 0; i < store->capacity; i++) {
+    if (store->entries[i].offset) {
+      memcpy(out + count * INV_VECTOR_SIZE, store->entries[i].vector,
+             INV_VECTOR_SIZE);
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t store_diff(const ObjectStore* store,
+                  const uint8_t* vectors,
+                  size_t count,
+                  uint8_t* out) {
+  size_t missing = 0;
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* vector = vectors + i * INV_VECTOR_SIZE;
+    if (!store_contains(store, vector)) {
+      // May overlap if the input is used for output.
+      memmove(out + missing * INV_VECTOR_SIZE, vector, INV_VECTOR_SIZE);
+      missing++;
+    }
+  }
+  return missing;
+}
+
+int store_compact(ObjectStore* store, int64_t now) {
+  size_t length = strlen(store->path);
+  char* tmp_path = (char*)malloc(length + 5);
+  if (!tmp_path) {
+    return STORE_NO_MEMORY;
+  }
+  memcpy(tmp_path, store->path, length);
+  memcpy(tmp_path + length, ".tmp", 5);
+  // Leftover of the interrupted compaction.
+  remove(tmp_path);
+  ObjectStore* fresh;
+  int error = store_open(tmp_path, now, &fresh);
+  free(tmp_path);
+  if (error) {
+    return error;
+  }
+  // Live objects are found through the buckets, the same order as
+  // prune visits them.
+  for (size_t i = 0; i < BUCKET_COUNT && !error; i++) {
+    const StoreBucket* bucket = &store->buckets[i];
+    for (size_t j = 0; j < bucket->count && !error; j++) {
+      uint64_t offset = bucket->offsets[j];
+      const uint8_t* record = map_record(store, offset, NULL);
+      if (!record) {
+        error = STORE_NO_MEMORY;
+        break;
+      }
+      const StoreEntry* entry =
+        &store->entries[find_slot(store, record + 16)];
+      bool added;
+      if (entry->offset == offset && entry->expires > now) {
+        error = store_put(fresh, entry->vector, entry->expires,
+                          record + RECORD_HEADER_SIZE,
+                          read_u32(record + 4), &added);
+      }
+    }
+  }
+  if (!error && !file_sync(fresh->fd)) {
+    error = STORE_IO_ERROR;
+  }
+  if (!error && !file_replace(fresh->path, store->path)) {
+    error = STORE_IO_ERROR;
+  }
+  if (error) {
+    remove(fresh->path);
+    store_close(fresh);
+    return error;
+  }
+  // Take over the new log keeping the original path; the old one is
+  // unmapped once its payloads are released.
+  ObjectStore old = *store;
+  *store = *fresh;
+  *fresh = old;
+  free(store->path);
+  store->path = old.path;
+  fresh->path = NULL;
+  store_close(fresh);
+  return STORE_OK;
+}
+
+int store_sync(ObjectStore* store) {
+  return file_sync(store->fd) ? STORE_OK : STORE_IO_ERROR;
+}
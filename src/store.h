@@ -0,0 +1,95 @@
+#ifndef BITCHAN_BITMESSAGE_STORE_H_
+#define BITCHAN_BITMESSAGE_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./inventory.h"
+
+// Append-only object log indexed by inventory vector. Records are
+// appended with plain writes and read through mappings of fixed-size
+// regions of the file, so returned payloads point straight into the
+// page cache. Mappings are read-only, writing to a payload crashes the
+// process. Opening the log scans record headers only. Deleted and
+// expired objects are dropped from the index and their space is
+// reclaimed by `store_compact`. Not supported on Windows.
+typedef struct ObjectStore ObjectStore;
+
+// Mapping of one region of the log, referenced by the store and by
+// every returned payload. Unmapped once the last reference is gone so
+// payloads stay valid even after the store is closed or compacted.
+typedef struct StoreRegion StoreRegion;
+
+// The same limit as for message payloads, see framer.h.
+static const size_t STORE_MAX_LENGTH = 1600003;
+
+enum {
+  STORE_OK = 0,
+  STORE_IO_ERROR = -1,
+  STORE_BAD_FILE = -2,
+  STORE_NO_MEMORY = -3,
+  STORE_TOO_LARGE = -4,
+  STORE_UNSUPPORTED = -5,
+};
+
+// Open or create the log and load its index. Objects which expire at or
+// before `now` are skipped. A torn record at the end of the log is cut
+// off.
+int store_open(const char* path, int64_t now, ObjectStore** store);
+
+void store_close(ObjectStore* store);
+
+// Return the number of indexed objects.
+size_t store_size(const ObjectStore* store);
+
+// Append the object unless it's already stored, `added` tells which
+// one happened.
+int store_put(ObjectStore* store,
+              const uint8_t* vector,
+              int64_t expires,
+              const uint8_t* data,
+              size_t length,
+              bool* added);
+
+// Find the object. On success `region` is referenced for the caller
+// which must release it once `data` is not needed anymore. Returns
+// false if there is no such object or it can't be mapped.
+bool store_get(ObjectStore* store,
+               const uint8_t* vector,
+               const uint8_t** data,
+               size_t* length,
+               int64_t* expires,
+               StoreRegion** region);
+
+void store_region_release(StoreRegion* region);
+
+bool store_contains(const ObjectStore* store, const uint8_t* vector);
+
+// Remove the object logging its deletion, `deleted` is false if there
+// was no such object.
+int store_delete(ObjectStore* store, const uint8_t* vector, bool* deleted);
+
+// Drop objects which expire at or before `now` from the index and
+// return their number. Only expiry buckets which may hold such objects
+// are visited.
+size_t store_prune(ObjectStore* store, int64_t now);
+
+// Copy vectors of all objects into `out`, which must fit
+// `store_size` of them. Returns their number.
+size_t store_vectors(const ObjectStore* store, uint8_t* out);
+
+// The same as `inv_set_diff`: copy vectors missing from the store into
+// `out` and return their number.
+size_t store_diff(const ObjectStore* store,
+                  const uint8_t* vectors,
+                  size_t count,
+                  uint8_t* out);
+
+// Rewrite the log with the objects which expire after `now` only. New
+// log is written next to the old one and replaces it atomically; the
+// store is unchanged on failure.
+int store_compact(ObjectStore* store, int64_t now);
+
+// Flush appended records to disk.
+int store_sync(ObjectStore* store);
+
+#endif  // BITCHAN_BITMESSAGE_STORE_H_
@@ -0,0 +1,262 @@
+// Minimal threading layer of the native engine: mutexes, condition
+// variables, detached threads, one-time initialization, relaxed atomics,
+// aligned allocation and monotonic clock over pthreads or Win32.
+
+#ifndef BITCHAN_BITMESSAGE_THREADS_H_
+#define BITCHAN_BITMESSAGE_THREADS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <malloc.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+typedef SRWLOCK PowMutex;
+typedef CONDITION_VARIABLE PowCond;
+typedef INIT_ONCE PowOnce;
+#define POW_MUTEX_INITIALIZER SRWLOCK_INIT
+#define POW_COND_INITIALIZER CONDITION_VARIABLE_INIT
+#define POW_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_mutex_t PowMutex;
+typedef pthread_cond_t PowCond;
+typedef pthread_once_t PowOnce;
+#define POW_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define POW_COND_INITIALIZER PTHREAD_COND_INITIALIZER
+#define POW_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+typedef void* (*PowThreadFn)(void* arg);
+
+#ifdef _WIN32
+static inline void pow_mutex_init(PowMutex* mutex) {
+  InitializeSRWLock(mutex);
+}
+
+// SRW locks don't need to be destroyed.
+static inline void pow_mutex_destroy(PowMutex*) {}
+
+static inline void pow_mutex_lock(PowMutex* mutex) {
+  AcquireSRWLockExclusive(mutex);
+}
+
+static inline void pow_mutex_unlock(PowMutex* mutex) {
+  ReleaseSRWLockExclusive(mutex);
+}
+
+static inline void pow_cond_init(PowCond* cond) {
+  InitializeConditionVariable(cond);
+}
+
+static inline void pow_cond_destroy(PowCond*) {}
+
+static inline void pow_cond_wait(PowCond* cond, PowMutex* mutex) {
+  SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+}
+
+static inline void pow_cond_signal(PowCond* cond) {
+  WakeConditionVariable(cond);
+}
+
+static inline void pow_cond_broadcast(PowCond* cond) {
+  WakeAllConditionVariable(cond);
+}
+
+typedef struct {
+  PowThreadFn fn;
+  void* arg;
+} PowThreadStart;
+
+static unsigned __stdcall pow_thread_start(void* data) {
+  PowThreadStart start = *(PowThreadStart*)data;
+  free(data);
+  start.fn(start.arg);
+  return 0;
+}
+
+// Start detached thread. Returns false on failure.
+static inline bool pow_thread_spawn(PowThreadFn fn, void* arg) {
+  PowThreadStart* start = (PowThreadStart*)malloc(sizeof(PowThreadStart));
+  if (!start) {
+    return false;
+  }
+  start->fn = fn;
+  start->arg = arg;
+  uintptr_t handle = _beginthreadex(NULL, 0, pow_thread_start, start, 0, NULL);
+  if (!handle) {
+    free(start);
+    return false;
+  }
+  CloseHandle((HANDLE)handle);
+  return true;
+}
+
+static BOOL CALLBACK pow_once_start(PINIT_ONCE, PVOID fn, PVOID*) {
+  ((void (*)())fn)();
+  return TRUE;
+}
+
+static inline void pow_once(PowOnce* once, void (*fn)()) {
+  InitOnceExecuteOnce(once, pow_once_start, (PVOID)fn, NULL);
+}
+
+static inline uint64_t pow_now_ns() {
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  uint64_t freq = (uint64_t)frequency.QuadPart;
+  uint64_t ticks = (uint64_t)counter.QuadPart;
+  return ticks / freq * 1000000000 + ticks % freq * 1000000000 / freq;
+}
+
+static inline void pow_sleep_ns(uint64_t ns) {
+  Sleep((DWORD)(ns / 1000000));
+}
+
+// Returns NULL on failure. Must be released with `pow_aligned_free`.
+static inline void* pow_aligned_alloc(size_t alignment, size_t size) {
+  return _aligned_malloc(size, alignment);
+}
+
+static inline void pow_aligned_free(void* p) {
+  _aligned_free(p);
+}
+#else
+static inline void pow_mutex_init(PowMutex* mutex) {
+  pthread_mutex_init(mutex, NULL);
+}
+
+static inline void pow_mutex_destroy(PowMutex* mutex) {
+  pthread_mutex_destroy(mutex);
+}
+
+static inline void pow_mutex_lock(PowMutex* mutex) {
+  pthread_mutex_lock(mutex);
+}
+
+static inline void pow_mutex_unlock(PowMutex* mutex) {
+  pthread_mutex_unlock(mutex);
+}
+
+static inline void pow_cond_init(PowCond* cond) {
+  pthread_cond_init(cond, NULL);
+}
+
+static inline void pow_cond_destroy(PowCond* cond) {
+  pthread_cond_destroy(cond);
+}
+
+static inline void pow_cond_wait(PowCond* cond, PowMutex* mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+
+static inline void pow_cond_signal(PowCond* cond) {
+  pthread_cond_signal(cond);
+}
+
+static inline void pow_cond_broadcast(PowCond* cond) {
+  pthread_cond_broadcast(cond);
+}
+
+// Start detached thread. Returns false on failure.
+static inline bool pow_thread_spawn(PowThreadFn fn, void* arg) {
+  pthread_attr_t attr;
+  pthread_t thread;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int error = pthread_create(&thread, &attr, fn, arg);
+  pthread_attr_destroy(&attr);
+  return error == 0;
+}
+
+static inline void pow_once(PowOnce* once, void (*fn)()) {
+  pthread_once(once, fn);
+}
+
+static inline uint64_t pow_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void pow_sleep_ns(uint64_t ns) {
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ns / 1000000000);
+  ts.tv_nsec = (long)(ns % 1000000000);
+  nanosleep(&ts, NULL);
+}
+
+// Returns NULL on failure. Must be released with `pow_aligned_free`.
+static inline void* pow_aligned_alloc(size_t alignment, size_t size) {
+  void* p;
+  return posix_memalign(&p, alignment, size) == 0 ? p : NULL;
+}
+
+static inline void pow_aligned_free(void* p) {
+  free(p);
+}
+#endif
+
+// Relaxed atomics. Values are only published and polled, ordering is
+// provided by the pool mutex.
+#if defined(__GNUC__)
+static inline int pow_load_int(const int* p) {
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline void pow_store_int(int* p, int value) {
+  __atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t pow_load_u64(const uint64_t* p) {
+  return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline void pow_store_u64(uint64_t* p, uint64_t value) {
+  __atomic_store_n(p, value, __ATOMIC_RELAXED);
+}
+#elif defined(_MSC_VER)
+// Aligned volatile accesses are atomic on every Windows target except
+// 64-bit values on 32-bit x86.
+static inline int pow_load_int(const int* p) {
+  return *(const volatile int*)p;
+}
+
+static inline void pow_store_int(int* p, int value) {
+  *(volatile int*)p = value;
+}
+
+static inline uint64_t pow_load_u64(const uint64_t* p) {
+#ifdef _WIN64
+  return *(const volatile uint64_t*)p;
+#else
+  return (uint64_t)InterlockedCompareExchange64(
+    (volatile LONG64*)p, 0, 0);
+#endif
+}
+
+static inline void pow_store_u64(uint64_t* p, uint64_t value) {
+#ifdef _WIN64
+  *(volatile uint64_t*)p = value;
+#else
+  InterlockedExchange64((volatile LONG64*)p, (LONG64)value);
+#endif
+}
+#else
+#error "Atomics are not implemented for this compiler"
+#endif
+
+#endif  // BITCHAN_BITMESSAGE_THREADS_H_
@@ -0,0 +1,472 @@
+// CPU topology detection and thread placement.
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+#ifdef __APPLE__
+#include <sys/types.h>
+#include <sys/sysctl.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#include "./threads.h"
+#include "./topology.h"
+
+static PowTopology topology;
+static PowOnce topology_once = POW_ONCE_INIT;
+
+#ifdef __linux__
+static int read_int(const char* path, int fallback) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return fallback;
+  }
+  int value;
+  if (fscanf(f, "%d", &value) != 1) {
+    value = fallback;
+  }
+  fclose(f);
+  return value;
+}
+
+// Parse list like "0-3,8-11" and set `node` of the matching CPUs.
+static void read_node_cpus(const char* path, int node, int* nodes) {
+  FILE* f = fopen(path, "r");
+  if (!f) {
+    return;
+  }
+  char list[4096];
+  if (fgets(list, sizeof(list), f)) {
+    char* p = list;
+    while (*p && *p != '\n') {
+      char* end;
+      long first = strtol(p, &end, 10);
+      if (end == p) {
+        break;
+      }
+      long last = first;
+      p = end;
+      if (*p == '-') {
+        last = strtol(p + 1, &end, 10);
+        p = end;
+      }
+      for (long i = first; i <= last && i < (long)MAX_CPUS; i++) {
+        if (i >= 0) {
+          nodes[i] = node;
+        }
+      }
+      if (*p == ',') {
+        p++;
+      }
+    }
+  }
+  fclose(f);
+}
+
+// Read bandwidth limit of the cgroup directory, either cgroup v2
+// `cpu.max` ("max 100000" or "150000 100000") or v1 CFS files. Returns
+// false if there is none.
+static bool read_cgroup_limit(const char* dir,
+                              bool v2,
+                              double* quota,
+                              uint64_t* period) {
+  char path[4096 + 32];
+  long long quota_us = -1;
+  long long period_us = 0;
+  if (v2) {
+    snprintf(path, sizeof(path), "%s/cpu.max", dir);
+    FILE* f = fopen(path, "r");
+    if (!f) {
+      return false;
+    }
+    if (fscanf(f, "%lld %lld", &quota_us, &period_us) != 2) {
+      quota_us = -1;
+    }
+    fclose(f);
+  } else {
+    snprintf(path, sizeof(path), "%s/cpu.cfs_quota_us", dir);
+    quota_us = read_int(path, -1);
+    snprintf(path, sizeof(path), "%s/cpu.cfs_period_us", dir);
+    period_us = read_int(path, 0);
+  }
+  if (quota_us <= 0 || period_us <= 0) {
+    return false;
+  }
+  *quota = (double)quota_us / (double)period_us;
+  *period = (uint64_t)period_us * 1000;
+  return true;
+}
+
+// Limits are hierarchical so the strictest one of the cgroup and its
+// ancestors applies. Path is relative to the mount point and is just
+// "/" inside of a container with its own cgroup namespace.
+static void read_cgroup_quota(const char* mount,
+                              const char* cgroup,
+                              bool v2) {
+  char dir[4096];
+  snprintf(dir, sizeof(dir), "%s%s", mount, cgroup);
+  size_t root_length = strlen(mount);
+  for (;;) {
+    double quota;
+    uint64_t period;
+    if (read_cgroup_limit(dir, v2, &quota, &period) &&
+        (!topology.quota || quota < topology.quota)) {
+      topology.quota = quota;
+      topology.quota_period = period;
+    }
+    char* slash = strrchr(dir + root_length, '/');
+    if (!slash) {
+      break;
+    }
+    *slash = 0;
+  }
+}
+
+// Parse "/proc/self/cgroup" lines like "0::/user.slice" (v2) or
+// "4:cpu,cpuacct:/docker/abc" (v1).
+static void read_quota() {
+  FILE* f = fopen("/proc/self/cgroup", "r");
+  if (!f) {
+    return;
+  }
+  char line[4096];
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\n")] = 0;
+    char* controllers = strchr(line, ':');
+    char* cgroup = controllers ? strchr(controllers + 1, ':') : NULL;
+    if (!cgroup) {
+      continue;
+    }
+    *cgroup++ = 0;
+    controllers++;
+    if (!*controllers) {
+      read_cgroup_quota("/sys/fs/cgroup", cgroup, true);
+      continue;
+    }
+    bool has_cpu = false;
+    char* saveptr = NULL;
+    for (char* name = strtok_r(controllers, ",", &saveptr); name;
+         name = strtok_r(NULL, ",", &saveptr)) {
+      has_cpu = has_cpu || strcmp(name, "cpu") == 0;
+    }
+    if (has_cpu) {
+      read_cgroup_quota("/sys/fs/cgroup/cpu", cgroup, false);
+    }
+  }
+  fclose(f);
+}
+
+static void read_nodes(int* nodes) {
+  DIR* dir = opendir("/sys/devices/system/node");
+  if (!dir) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    int node;
+    char rest;
+    if (sscanf(entry->d_name, "node%d%c", &node, &rest) != 1) {
+      continue;
+    }
+    char path[512];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/node/%s/cpulist", entry->d_name);
+    read_node_cpus(path, node, nodes);
+  }
+  closedir(dir);
+}
+#endif
+
+#ifdef _WIN32
+// Only the first processor group (up to 64 CPUs) is visible to threads
+// which don't set their group explicitly, so the rest is ignored.
+static void read_windows_topology(bool* allowed,
+                                  int* packages,
+                                  int* cores,
+                                  int* nodes) {
+  size_t i;
+  size_t bits = sizeof(ULONG_PTR) * 8;
+  DWORD_PTR process_mask;
+  DWORD_PTR system_mask;
+  if (GetProcessAffinityMask(GetCurrentProcess(),
+                             &process_mask,
+                             &system_mask)) {
+    for (i = 0; i < bits && i < MAX_CPUS; i++) {
+      allowed[i] = (process_mask >> i) & 1;
+    }
+  }
+  DWORD length = 0;
+  if (GetLogicalProcessorInformation(NULL, &length) ||
+      GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+    return;
+  }
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info =
+    (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(length);
+  if (!info) {
+    return;
+  }
+  if (GetLogicalProcessorInformation(info, &length)) {
+    size_t count = length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+    int core = 0;
+    int package = 0;
+    for (size_t j = 0; j < count; j++) {
+      LOGICAL_PROCESSOR_RELATIONSHIP relation = info[j].Relationship;
+      for (i = 0; i < bits && i < MAX_CPUS; i++) {
+        if (((info[j].ProcessorMask >> i) & 1) == 0) {
+          continue;
+        }
+        if (relation == RelationProcessorCore) {
+          cores[i] = core;
+        } else if (relation == RelationProcessorPackage) {
+          packages[i] = package;
+        } else if (relation == RelationNumaNode) {
+          nodes[i] = (int)info[j].NumaNode.NodeNumber;
+        }
+      }
+      core += relation == RelationProcessorCore;
+      package += relation == RelationProcessorPackage;
+    }
+  }
+  free(info);
+}
+#endif
+
+#ifdef __APPLE__
+// There is no per-CPU topology on macOS, but SMT siblings are numbered
+// consecutively.
+static void read_apple_cores(int* cores) {
+  int physical = 0;
+  int logical = 0;
+  size_t size = sizeof(int);
+  if (sysctlbyname("hw.physicalcpu", &physical, &size, NULL, 0) != 0 ||
+      sysctlbyname("hw.logicalcpu", &logical, &size, NULL, 0) != 0 ||
+      physical <= 0 || logical < physical) {
+    return;
+  }
+  int siblings = logical / physical;
+  for (size_t i = 0; i < MAX_CPUS; i++) {
+    cores[i] = (int)i / siblings;
+  }
+}
+#endif
+
+static long online_cpus() {
+#ifdef _WIN32
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (long)info.dwNumberOfProcessors;
+#else
+  return sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+}
+
+static void detect_topology() {
+  static bool allowed[MAX_CPUS];
+  static int packages[MAX_CPUS];
+  static int cores[MAX_CPUS];
+  static int nodes[MAX_CPUS];
+  size_t i;
+  for (i = 0; i < MAX_CPUS; i++) {
+    packages[i] = 0;
+    cores[i] = (int)i;
+    nodes[i] = 0;
+  }
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (i = 0; i < MAX_CPUS && i < CPU_SETSIZE; i++) {
+      allowed[i] = CPU_ISSET(i, &set);
+    }
+  }
+  read_nodes(nodes);
+  read_quota();
+#elif defined(_WIN32)
+  read_windows_topology(allowed, packages, cores, nodes);
+#elif defined(__APPLE__)
+  read_apple_cores(cores);
+#endif
+  size_t j;
+  size_t count = 0;
+  for (i = 0; i < MAX_CPUS; i++) {
+    count += allowed[i];
+  }
+  // Affinity is not available, take all online CPUs.
+  if (!count) {
+    long online = online_cpus();
+    for (i = 0; i < MAX_CPUS && (long)i < (online > 0 ? online : 1); i++) {
+      allowed[i] = true;
+    }
+  }
+
+  for (i = 0; i < MAX_CPUS; i++) {
+    if (!allowed[i]) {
+      continue;
+    }
+    PowCpu* cpu = &topology.cpus[topology.count++];
+    cpu->id = (int)i;
+    cpu->package = packages[i];
+    cpu->core = cores[i];
+    cpu->node = nodes[i];
+#ifdef __linux__
+    char path[256];
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%zu/topology/physical_package_id",
+             i);
+    cpu->package = read_int(path, 0);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu%zu/topology/core_id", i);
+    cpu->core = read_int(path, (int)i);
+#endif
+  }
+
+  for (i = 0; i < topology.count; i++) {
+    PowCpu* cpu = &topology.cpus[i];
+    bool new_package = true;
+    bool new_node = true;
+    for (j = 0; j < i; j++) {
+      const PowCpu* prev = &topology.cpus[j];
+      if (prev->package == cpu->package && prev->core == cpu->core) {
+        cpu->thread++;
+      }
+      new_package = new_package && prev->package != cpu->package;
+      new_node = new_node && prev->node != cpu->node;
+    }
+    topology.cores += cpu->thread == 0;
+    topology.packages += new_package;
+    topology.nodes += new_node;
+  }
+}
+
+const PowTopology* pow_topology() {
+  pow_once(&topology_once, detect_topology);
+  return &topology;
+}
+
+typedef struct {
+  int id;
+  int thread;
+  // Index of the core inside its package.
+  size_t core_rank;
+  int package;
+} PowCandidate;
+
+static int compare_candidates(const void* a, const void* b) {
+  const PowCandidate* x = (const PowCandidate*)a;
+  const PowCandidate* y = (const PowCandidate*)b;
+  if (x->thread != y->thread) {
+    return x->thread - y->thread;
+  }
+  if (x->core_rank != y->core_rank) {
+    return x->core_rank < y->core_rank ? -1 : 1;
+  }
+  if (x->package != y->package) {
+    return x->package - y->package;
+  }
+  return x->id - y->id;
+}
+
+size_t pow_placement(const PowTopology* topology,
+                     const PowAffinity* affinity,
+                     int* cpus,
+                     size_t max_cpus) {
+  size_t i;
+  size_t j;
+  size_t count = 0;
+  if (!affinity->pin) {
+    return 0;
+  }
+  if (affinity->cpu_count) {
+    // Keep the given order, skip CPUs we can't run on.
+    for (i = 0; i < affinity->cpu_count && count < max_cpus; i++) {
+      for (j = 0; j < topology->count; j++) {
+        if (topology->cpus[j].id == affinity->cpus[i]) {
+          cpus[count++] = affinity->cpus[i];
+          break;
+        }
+      }
+    }
+    return count;
+  }
+
+  PowCandidate* candidates =
+    (PowCandidate*)malloc(topology->count * sizeof(PowCandidate));
+  if (!candidates) {
+    return 0;
+  }
+  for (i = 0; i < topology->count; i++) {
+    const PowCpu* cpu = &topology->cpus[i];
+    if ((affinity->physical_only && cpu->thread) ||
+        (affinity->node >= 0 && cpu->node != affinity->node)) {
+      continue;
+    }
+    // Cores are ranked by ID of their first sibling. CPUs are sorted so
+    // the first one with the same core ID is it.
+    int first = cpu->id;
+    for (j = 0; j < i; j++) {
+      const PowCpu* other = &topology->cpus[j];
+      if (other->package == cpu->package && other->core == cpu->core) {
+        first = other->id;
+        break;
+      }
+    }
+    size_t core_rank = 0;
+    for (j = 0; j < topology->count; j++) {
+      const PowCpu* other = &topology->cpus[j];
+      if (other->package == cpu->package && other->thread == 0 &&
+          other->id < first) {
+        core_rank++;
+      }
+    }
+    PowCandidate candidate = {cpu->id, cpu->thread, core_rank, cpu->package};
+    candidates[count++] = candidate;
+  }
+  qsort(candidates, count, sizeof(PowCandidate), compare_candidates);
+  if (count > max_cpus) {
+    count = max_cpus;
+  }
+  for (i = 0; i < count; i++) {
+    cpus[i] = candidates[i].id;
+  }
+  free(candidates);
+  return count;
+}
+
+bool pow_pin_thread(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (cpu < 0) {
+    const PowTopology* topology = pow_topology();
+    for (size_t i = 0; i < topology->count; i++) {
+      CPU_SET(topology->cpus[i].id, &set);
+    }
+  } else {
+    CPU_SET(cpu, &set);
+  }
+  // Zero PID is the calling thread.
+  return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+  DWORD_PTR mask = 0;
+  size_t bits = sizeof(DWORD_PTR) * 8;
+  if (cpu < 0) {
+    const PowTopology* topology = pow_topology();
+    for (size_t i = 0; i < topology->count; i++) {
+      if ((size_t)topology->cpus[i].id < bits) {
+        mask |= (DWORD_PTR)1 << topology->cpus[i].id;
+      }
+    }
+  } else if ((size_t)cpu < bits) {
+    mask = (DWORD_PTR)1 << cpu;
+  }
+  return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
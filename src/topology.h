@@ -0,0 +1,65 @@
+#ifndef BITCHAN_BITMESSAGE_TOPOLOGY_H_
+#define BITCHAN_BITMESSAGE_TOPOLOGY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+static const size_t MAX_CPUS = 1024;
+
+// Logical CPU available to the process.
+typedef struct {
+  int id;
+  int package;
+  // Core ID, unique only inside the package.
+  int core;
+  int node;
+  // Index among SMT siblings of the core, 0 for the first one.
+  int thread;
+} PowCpu;
+
+typedef struct {
+  size_t count;
+  // Sorted by ID.
+  PowCpu cpus[MAX_CPUS];
+  size_t cores;
+  size_t packages;
+  size_t nodes;
+  // CPU time the process may use per wall second because of cgroup
+  // bandwidth limit (e.g. 1.5 CPUs), zero if unlimited. Quota is
+  // enforced once per `quota_period` nanoseconds.
+  double quota;
+  uint64_t quota_period;
+} PowTopology;
+
+// Which CPUs pool threads are pinned to.
+typedef struct {
+  bool pin;
+  // Use only the first SMT sibling of every core.
+  bool physical_only;
+  // Use only CPUs of that NUMA node, -1 for any.
+  int node;
+  // Explicit CPU list, overrides the above options if not empty.
+  size_t cpu_count;
+  const int* cpus;
+} PowAffinity;
+
+// Return topology of CPUs the process is allowed to run on. Detected
+// once from sysfs on Linux and from system calls on Windows and macOS;
+// elsewhere every CPU is treated as a separate core. CPU quota is read
+// from cgroup v2 and v1 hierarchies on Linux only.
+const PowTopology* pow_topology();
+
+// Fill CPUs to pin threads to, in the order threads should take them:
+// one thread per core spread across packages first, then SMT siblings.
+// Returns their number, zero if nothing matches or pinning is
+// disabled.
+size_t pow_placement(const PowTopology* topology,
+                     const PowAffinity* affinity,
+                     int* cpus,
+                     size_t max_cpus);
+
+// Pin the calling thread to the given CPU, or allow it to run on every
+// available CPU if `cpu` is negative. Returns false if not supported.
+bool pow_pin_thread(int cpu);
+
+#endif  // BITCHAN_BITMESSAGE_TOPOLOGY_H_
@@ -0,0 +1,170 @@
+// Parallel signature verification, see `crypto.verify` for the JS
+// version. Signed data is hashed with SHA-1 and the digest is used as
+// is, which is the same as eccrypto's zero padding to 32 bytes.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+#include <openssl/sha.h>
+#include "./pow.h"
+#include "./verify.h"
+
+// Items checked per call, so the key is not allocated for every one of
+// them.
+#define VERIFY_BATCH 8
+
+struct VerifyBatch {
+  EC_GROUP* group;
+  uint8_t* keys;
+  // Messages and signatures of all items, item `i` takes
+  // `[ends[i - 1], ends[i])` of them.
+  uint8_t* messages;
+  size_t* message_ends;
+  uint8_t* sigs;
+  size_t* sig_ends;
+  size_t count;
+  // One byte per item so threads never write the same memory.
+  uint8_t* valid;
+};
+
+static bool verify_item(const VerifyBatch* batch,
+                        EC_KEY* key,
+                        EC_POINT* point,
+                        size_t i) {
+  uint8_t hash[SHA_DIGEST_LENGTH];
+  size_t message_start = i ? batch->message_ends[i - 1] : 0;
+  size_t sig_start = i ? batch->sig_ends[i - 1] : 0;
+  // Point is validated to be on the curve.
+  if (!EC_POINT_oct2point(batch->group, point,
+                          batch->keys + i * VERIFY_KEY_SIZE,
+                          VERIFY_KEY_SIZE, NULL) ||
+      !EC_KEY_set_public_key(key, point)) {
+    return false;
+  }
+  SHA1(batch->messages + message_start,
+       batch->message_ends[i] - message_start,
+       hash);
+  return ECDSA_verify(0, hash, SHA_DIGEST_LENGTH,
+                      batch->sigs + sig_start,
+                      (int)(batch->sig_ends[i] - sig_start),
+                      key) == 1;
+}
+
+static bool check_items(void* ctx,
+                        uint64_t nonce,
+                        size_t count,
+                        uint64_t*) {
+  VerifyBatch* batch = (VerifyBatch*)ctx;
+  EC_KEY* key = EC_KEY_new();
+  EC_POINT* point = EC_POINT_new(batch->group);
+  if (key && point && EC_KEY_set_group(key, batch->group)) {
+    for (uint64_t i = nonce; i < nonce + count && i < batch->count; i++) {
+      batch->valid[i] = verify_item(batch, key, point, (size_t)i);
+    }
+  }
+  EC_POINT_free(point);
+  EC_KEY_free(key);
+  return false;
+}
+
+// Copy items into one arena, storing their end offsets.
+static uint8_t* pack_items(const uint8_t* const* items,
+                           const size_t* lengths,
+                           size_t count,
+                           size_t* ends) {
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    total += lengths[i];
+    ends[i] = total;
+  }
+  // Every item may be empty.
+  uint8_t* data = (uint8_t*)malloc(total + 1);
+  if (!data) {
+    return NULL;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (lengths[i]) {
+      memcpy(data + ends[i] - lengths[i], items[i], lengths[i]);
+    }
+  }
+  return data;
+}
+
+VerifyBatch* verify_batch_new(const uint8_t* public_keys,
+                              const uint8_t* const* messages,
+                              const size_t* message_lengths,
+                              const uint8_t* const* sigs,
+                              const size_t* sig_lengths,
+                              size_t count) {
+  if (!count) {
+    return NULL;
+  }
+  VerifyBatch* batch = (VerifyBatch*)calloc(1, sizeof(VerifyBatch));
+  if (!batch) {
+    return NULL;
+  }
+  batch->count = count;
+  batch->group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+  batch->keys = (uint8_t*)malloc(count * VERIFY_KEY_SIZE);
+  batch->message_ends = (size_t*)malloc(count * sizeof(size_t));
+  batch->sig_ends = (size_t*)malloc(count * sizeof(size_t));
+  batch->valid = (uint8_t*)calloc(count, 1);
+  bool ok = batch->group &&
+            batch->keys &&
+            batch->message_ends &&
+            batch->sig_ends &&
+            batch->valid;
+  if (ok) {
+    memcpy(batch->keys, public_keys, count * VERIFY_KEY_SIZE);
+    batch->messages = pack_items(messages, message_lengths, count,
+                                 batch->message_ends);
+    batch->sigs = pack_items(sigs, sig_lengths, count, batch->sig_ends);
+    ok = batch->messages && batch->sigs;
+  }
+  if (!ok) {
+    verify_batch_free(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+void verify_batch_free(VerifyBatch* batch) {
+  EC_GROUP_free(batch->group);
+  free(batch->keys);
+  free(batch->messages);
+  free(batch->message_ends);
+  free(batch->sigs);
+  free(batch->sig_ends);
+  free(batch->valid);
+  free(batch);
+}
+
+PowJob* verify_batch_job(VerifyBatch* batch, size_t pool_size) {
+  PowSearch search;
+  search.check = check_items;
+  search.ctx = batch;
+  search.batch = VERIFY_BATCH;
+  search.lowest = false;
+  PowJob* job = pow_job_new_search(pool_size, &search, 0);
+  if (job && pow_job_set_range(job, 0, batch->count, 1)) {
+    pow_job_free(job);
+    return NULL;
+  }
+  if (job) {
+    // Object decoding waits for it.
+    pow_job_set_priority(job, POW_PRIORITY_URGENT, 0);
+  }
+  return job;
+}
+
+void verify_batch_results(const VerifyBatch* batch, uint8_t* bitmap) {
+  memset(bitmap, 0, (batch->count + 7) / 8);
+  for (size_t i = 0; i < batch->count; i++) {
+    if (batch->valid[i]) {
+      bitmap[i / 8] |= 1 << (i % 8);
+    }
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef BITCHAN_BITMESSAGE_VERIFY_H_
+#define BITCHAN_BITMESSAGE_VERIFY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./pow.h"
+
+static const size_t VERIFY_KEY_SIZE = 65;
+
+// Batch of ecdsa-with-sha1 signatures over secp256k1 (see
+// `crypto.verify`), every candidate is an item index. Verification
+// follows OpenSSL (and so PyBitmessage): DER must be canonical, high S
+// values are accepted.
+typedef struct VerifyBatch VerifyBatch;
+
+// Copies `count` packed 65-byte uncompressed public keys, messages and
+// DER signatures. Returns NULL if out of memory or there are no items.
+VerifyBatch* verify_batch_new(const uint8_t* public_keys,
+                              const uint8_t* const* messages,
+                              const size_t* message_lengths,
+                              const uint8_t* const* sigs,
+                              const size_t* sig_lengths,
+                              size_t count);
+
+void verify_batch_free(VerifyBatch* batch);
+
+// Create pool job verifying all items. Job never finds anything and
+// fails with `RESULT_NOT_FOUND` once every item is checked, results are
+// in `verify_batch_results` then. Batch must outlive the job.
+PowJob* verify_batch_job(VerifyBatch* batch, size_t pool_size);
+
+// Fill bitmap of `(count + 7) / 8` bytes with bit `i % 8` of byte
+// `i / 8` set for every valid signature, the same layout as
+// `powCheckBatch` results have.
+void verify_batch_results(const VerifyBatch* batch, uint8_t* bitmap);
+
+#endif  // BITCHAN_BITMESSAGE_VERIFY_H_
@@ -1,6 +1,24 @@
+#define __STDC_LIMIT_MACROS
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include <node.h>
 #include <nan.h>
+// After node's headers which include winsock2.h first.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+#include "./addrgen.h"
+#include "./codecs.h"
+#include "./decrypt.h"
+#include "./framer.h"
+#include "./inventory.h"
 #include "./pow.h"
+#include "./store.h"
+#include "./verify.h"
 
 using v8::Handle;
 using v8::Local;
@@ -10,88 +28,2115 @@ using v8::Value;
 using v8::Object;
 using v8::String;
 using v8::Number;
+using v8::ObjectTemplate;
 
 static const uint64_t MAX_SAFE_INTEGER = 9007199254740991ULL;
 
-class PowWorker : public Nan::AsyncWorker {
+// BigInt API appeared in V8 6.7 (Node 10.4).
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+#define POW_HAVE_BIGINT
+#endif
+
+// Template of job handles returned to JS. Its only internal field
+// points to the task while job is running.
+static Nan::Persistent<ObjectTemplate> job_template;
+
+// Get error object for the given POW result.
+static Local<Value> PowError(int error) {
+  if (error == RESULT_OVERFLOW) {
+    return Nan::Error("Max safe integer overflow");
+  } else if (error == RESULT_SHUTDOWN) {
+    return Nan::Error("POW pool is shut down");
+  } else if (error == RESULT_CANCELLED) {
+    return Nan::Error("POW cancelled");
+  } else if (error == RESULT_NOT_FOUND) {
+    return Nan::Error("Nonce range is exhausted");
+  } else {
+    return Nan::Error("Internal error");
+  }
+}
+
+static uint64_t ReadUInt64BE(const uint8_t* buf) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < 8; i++) {
+    value = (value << 8) | buf[i];
+  }
+  return value;
+}
+
+static void WriteUInt64BE(uint8_t* buf, uint64_t value) {
+  for (size_t i = 0; i < 8; i++) {
+    buf[i] = static_cast<uint8_t>(value >> (56 - i * 8));
+  }
+}
+
+// Parse 64-bit unsigned value given as a number, BigInt or 8-byte
+// big-endian Buffer.
+static bool GetUInt64(Local<Value> value, uint64_t* result) {
+  if (value->IsNumber()) {
+    double number = value->NumberValue();
+    if (!(number >= 0 && number < 18446744073709551616.0)) {
+      return false;
+    }
+    *result = static_cast<uint64_t>(number);
+    return true;
+  }
+#ifdef POW_HAVE_BIGINT
+  if (value->IsBigInt()) {
+    bool lossless;
+    *result = value.As<v8::BigInt>()->Uint64Value(&lossless);
+    return lossless;
+  }
+#endif
+  if (node::Buffer::HasInstance(value) && node::Buffer::Length(value) == 8) {
+    *result = ReadUInt64BE(
+      reinterpret_cast<const uint8_t*>(node::Buffer::Data(value)));
+    return true;
+  }
+  return false;
+}
+
+static Local<Value> NewUInt64Buffer(uint64_t value) {
+  uint8_t buf[8];
+  WriteUInt64BE(buf, value);
+  return Nan::CopyBuffer(reinterpret_cast<char*>(buf), sizeof(buf))
+    .ToLocalChecked();
+}
+
+// Convert 64-bit unsigned value to number if it's safe, otherwise to
+// BigInt or to 8-byte big-endian Buffer if there is no BigInt.
+static Local<Value> NewUInt64(uint64_t value) {
+  if (value <= MAX_SAFE_INTEGER) {
+    return Nan::New<Number>(static_cast<double>(value));
+  }
+#ifdef POW_HAVE_BIGINT
+  return v8::BigInt::NewFromUnsigned(v8::Isolate::GetCurrent(), value);
+#else
+  return NewUInt64Buffer(value);
+#endif
+}
+
+// How found nonces are returned to JS. Numbers limit the search to
+// 2^53, other types allow the full 64-bit space.
+enum NonceType {
+  NONCE_NUMBER = 0,
+  NONCE_BIGINT = 1,
+  NONCE_BUFFER = 2
+};
+
+// Parse optional nonce type, number by default.
+static bool GetNonceType(Local<Value> value, int* type) {
+  *type = NONCE_NUMBER;
+  if (value->IsUndefined()) {
+    return true;
+  }
+  if (!value->IsNumber()) {
+    return false;
+  }
+  *type = value->Int32Value();
+#ifndef POW_HAVE_BIGINT
+  if (*type == NONCE_BIGINT) {
+    return false;
+  }
+#endif
+  return *type == NONCE_NUMBER ||
+         *type == NONCE_BIGINT ||
+         *type == NONCE_BUFFER;
+}
+
+// Parse optional engines of the job, see `PowBackend`. CPU by default.
+static bool GetBackends(Local<Value> value, int* backends) {
+  *backends = BACKEND_CPU;
+  if (value->IsUndefined()) {
+    return true;
+  }
+  if (!value->IsNumber()) {
+    return false;
+  }
+  *backends = value->Int32Value();
+  return *backends == BACKEND_CPU ||
+         *backends == BACKEND_DEVICE ||
+         *backends == BACKEND_HYBRID;
+}
+
+static uint64_t GetMaxNonce(int type) {
+  return type == NONCE_NUMBER ? MAX_SAFE_INTEGER : UINT64_MAX;
+}
+
+static Local<Value> NewNonce(uint64_t nonce, int type) {
+#ifdef POW_HAVE_BIGINT
+  if (type == NONCE_BIGINT) {
+    return v8::BigInt::NewFromUnsigned(v8::Isolate::GetCurrent(), nonce);
+  }
+#endif
+  if (type == NONCE_BUFFER) {
+    return NewUInt64Buffer(nonce);
+  }
+  return Nan::New<Number>(static_cast<double>(nonce));
+}
+
+// Nonces `start + i * stride` below `end`, see `pow_job_set_range`.
+struct NonceRange {
+  uint64_t start;
+  uint64_t end;
+  uint64_t stride;
+};
+
+// Parse optional `{start, end, stride}` object, `given` is false if
+// there is none. Missing fields default to the whole nonce space.
+static bool GetRange(Local<Value> value,
+                     uint64_t max_nonce,
+                     NonceRange* range,
+                     bool* given) {
+  *given = !value->IsUndefined();
+  if (!*given) {
+    return true;
+  }
+  if (!value->IsObject()) {
+    return false;
+  }
+  Local<Object> obj = value.As<Object>();
+  Local<Value> start =
+    Nan::Get(obj, Nan::New<String>("start").ToLocalChecked())
+    .ToLocalChecked();
+  Local<Value> end =
+    Nan::Get(obj, Nan::New<String>("end").ToLocalChecked())
+    .ToLocalChecked();
+  Local<Value> stride =
+    Nan::Get(obj, Nan::New<String>("stride").ToLocalChecked())
+    .ToLocalChecked();
+  range->start = 0;
+  range->end = max_nonce;
+  range->stride = 1;
+  return (start->IsUndefined() || GetUInt64(start, &range->start)) &&
+         (end->IsUndefined() || GetUInt64(end, &range->end)) &&
+         (stride->IsUndefined() || GetUInt64(stride, &range->stride)) &&
+         range->start < range->end &&
+         range->stride >= 1;
+}
+
+// Search progress saved by `pow_job_checkpoint`. Serialized as 8-byte
+// cursor followed by 16-byte `[start, end)` pairs, all big-endian.
+struct Checkpoint {
+  std::vector<PowRange> ranges;
+  uint64_t cursor;
+};
+
+static const size_t CURSOR_SIZE = 8;
+static const size_t RANGE_SIZE = 16;
+
+// Parse optional checkpoint, `given` is false if there is none.
+static bool GetCheckpoint(Local<Value> value,
+                          Checkpoint* checkpoint,
+                          bool* given) {
+  *given = !value->IsUndefined();
+  if (!*given) {
+    return true;
+  }
+  if (!node::Buffer::HasInstance(value)) {
+    return false;
+  }
+  const uint8_t* buf =
+    reinterpret_cast<const uint8_t*>(node::Buffer::Data(value));
+  size_t length = node::Buffer::Length(value);
+  if (length < CURSOR_SIZE || (length - CURSOR_SIZE) % RANGE_SIZE) {
+    return false;
+  }
+  checkpoint->cursor = ReadUInt64BE(buf);
+  checkpoint->ranges.clear();
+  for (size_t i = CURSOR_SIZE; i < length; i += RANGE_SIZE) {
+    PowRange range = {ReadUInt64BE(buf + i), ReadUInt64BE(buf + i + 8)};
+    if (range.start >= range.end) {
+      return false;
+    }
+    checkpoint->ranges.push_back(range);
+  }
+  return true;
+}
+
+static bool RestoreCheckpoint(PowJob* job, const Checkpoint& checkpoint) {
+  const PowRange* ranges =
+    checkpoint.ranges.empty() ? NULL : &checkpoint.ranges[0];
+  return pow_job_restore(job,
+                         ranges,
+                         checkpoint.ranges.size(),
+                         checkpoint.cursor) == RESULT_OK;
+}
+
+static Local<Value> NewCheckpoint(const PowJob* job) {
+  Checkpoint checkpoint;
+  // Ranges may be given back between the calls.
+  size_t count = pow_job_checkpoint(job, NULL, 0, &checkpoint.cursor);
+  do {
+    checkpoint.ranges.resize(count + 1);
+    count = pow_job_checkpoint(job,
+                               &checkpoint.ranges[0],
+                               checkpoint.ranges.size(),
+                               &checkpoint.cursor);
+  } while (count > checkpoint.ranges.size());
+  std::vector<uint8_t> buf(CURSOR_SIZE + count * RANGE_SIZE);
+  WriteUInt64BE(&buf[0], checkpoint.cursor);
+  for (size_t i = 0; i < count; i++) {
+    uint8_t* p = &buf[CURSOR_SIZE + i * RANGE_SIZE];
+    WriteUInt64BE(p, checkpoint.ranges[i].start);
+    WriteUInt64BE(p + 8, checkpoint.ranges[i].end);
+  }
+  return Nan::CopyBuffer(reinterpret_cast<char*>(&buf[0]), buf.size())
+    .ToLocalChecked();
+}
+
+// Convert stats to `{trials, elapsed, hashrate}` where elapsed is in
+// milliseconds and hashrate in trials per second.
+static Local<Object> NewStats(const PowStats& stats) {
+  Local<Object> obj = Nan::New<Object>();
+  double trials = static_cast<double>(stats.trials);
+  double elapsed = static_cast<double>(stats.elapsed) / 1e6;
+  Nan::Set(obj, Nan::New<String>("trials").ToLocalChecked(),
+    Nan::New<Number>(trials));
+  Nan::Set(obj, Nan::New<String>("elapsed").ToLocalChecked(),
+    Nan::New<Number>(elapsed));
+  Nan::Set(obj, Nan::New<String>("hashrate").ToLocalChecked(),
+    Nan::New<Number>(elapsed > 0 ? trials * 1000 / elapsed : 0));
+  return obj;
+}
+
+// Convert per-thread stats array and add it as `threads` to `obj`.
+static void SetThreadStats(Local<Object> obj,
+                           const std::vector<PowStats>& threads) {
+  Local<v8::Array> list = Nan::New<v8::Array>(threads.size());
+  for (size_t i = 0; i < threads.size(); i++) {
+    Nan::Set(list, i, NewStats(threads[i]));
+  }
+  Nan::Set(obj, Nan::New<String>("threads").ToLocalChecked(), list);
+}
+
+// POW jobs submitted to the shared native pool. Pool threads only touch
+// `jobs` and wake up the event loop via `async` once each of them is
+// finished, so no libuv worker is occupied while nonces are being
+// searched. Single job reports as `cb(err, nonce)`, batch as
+// `cb(err, index, nonce)` per job, nonces are converted according to
+// `nonce_type`. Subclasses may report something else in place of nonce.
+class PowTask {
  public:
-  PowWorker(Nan::Callback* callback,
-            size_t pool_size,
-            uint64_t target,
-            uint8_t* initial_hash)
-      : Nan::AsyncWorker(callback),
-        pool_size(pool_size),
-        target(target),
-        initial_hash(initial_hash) {}
+  PowTask(Nan::Callback* callback, bool batch, int nonce_type)
+      : callback(callback),
+        batch(batch),
+        nonce_type(nonce_type),
+        submitted(0),
+        reported(0) {
+    uv_mutex_init(&mutex);
+    async.data = this;
+    uv_async_init(uv_default_loop(), &async, OnDone);
+  }
+
+  virtual ~PowTask() {
+    if (!handle.IsEmpty()) {
+      Nan::HandleScope scope;
+      Nan::SetInternalFieldPointer(Nan::New(handle), 0, NULL);
+      handle.Reset();
+    }
+    for (size_t i = 0; i < entries.size(); i++) {
+      pow_job_free(entries[i].job);
+    }
+    uv_mutex_destroy(&mutex);
+    delete callback;
+  }
+
+  void AddJob(PowJob* job) {
+    Entry entry = {this, entries.size(), job};
+    entries.push_back(entry);
+  }
+
+  // Queue all jobs. Jobs which were already queued stay running even
+  // if some failed to queue, so the task is always finished via
+  // callbacks unless nothing was submitted.
+  int Submit() {
+    // Entries must not be reallocated from now on.
+    for (; submitted < entries.size(); submitted++) {
+      Entry* entry = &entries[submitted];
+      int error = pow_submit(entry->job, OnJobDone, entry);
+      if (error) {
+        return error;
+      }
+    }
+    return RESULT_OK;
+  }
+
+  bool IsSubmitted() const {
+    return submitted > 0;
+  }
+
+  // Return JS object which allows to cancel the jobs and to get their
+  // stats.
+  Local<Object> NewHandle() {
+    Local<Object> obj =
+      Nan::NewInstance(Nan::New(job_template)).ToLocalChecked();
+    Nan::SetInternalFieldPointer(obj, 0, this);
+    Local<Function> cancel = Nan::GetFunction(
+      Nan::New<FunctionTemplate>(CancelPow, obj)).ToLocalChecked();
+    Nan::Set(obj, Nan::New<String>("cancel").ToLocalChecked(), cancel);
+    Local<Function> get_stats = Nan::GetFunction(
+      Nan::New<FunctionTemplate>(GetPowStats, obj)).ToLocalChecked();
+    Nan::Set(obj, Nan::New<String>("getStats").ToLocalChecked(), get_stats);
+    Local<Function> checkpoint = Nan::GetFunction(
+      Nan::New<FunctionTemplate>(GetPowCheckpoint, obj)).ToLocalChecked();
+    Nan::Set(obj, Nan::New<String>("checkpoint").ToLocalChecked(),
+             checkpoint);
+    handle.Reset(obj);
+    return obj;
+  }
 
-  ~PowWorker() {
-    delete[] initial_hash;
+  // Cancel the given job or all of them. Return whether anything was
+  // running.
+  bool Cancel(size_t index) {
+    bool cancelled = false;
+    for (size_t i = 0; i < submitted; i++) {
+      if (index == ALL_JOBS || index == i) {
+        cancelled |= pow_cancel(entries[i].job) == RESULT_OK;
+      }
+    }
+    return cancelled;
+  }
+
+  // Return stats of the given job or undefined if there is no such job.
+  Local<Value> GetStats(size_t index) {
+    if (index >= entries.size()) {
+      return Nan::Undefined();
+    }
+    PowJob* job = entries[index].job;
+    PowStats total;
+    std::vector<PowStats> slots(MAX_POOL_SIZE);
+    slots.resize(pow_job_stats(job, &total, &slots[0], slots.size()));
+    Local<Object> obj = NewStats(total);
+    SetThreadStats(obj, slots);
+    return obj;
+  }
+
+  // Return search progress of the given job as Buffer or undefined if
+  // there is no such job.
+  Local<Value> SaveCheckpoint(size_t index) {
+    if (index >= entries.size()) {
+      return Nan::Undefined();
+    }
+    return NewCheckpoint(entries[index].job);
   }
 
-  // Executed inside the worker-thread.
-  // It is not safe to access V8, or V8 data structures
-  // here, so everything we need for input and output
-  // should go on `this`.
-  void Execute () {
-    error = pow(pool_size, target, initial_hash, MAX_SAFE_INTEGER, &nonce);
+  // Release the task without running the callback.
+  void Abort() {
+    // Pool threads send under the mutex, so none of them touches
+    // `async` past this point once every job is reported.
+    uv_mutex_lock(&mutex);
+    uv_mutex_unlock(&mutex);
+    uv_close(reinterpret_cast<uv_handle_t*>(&async), OnClose);
+  }
+
+  static const size_t ALL_JOBS = SIZE_MAX;
+
+ protected:
+  // Convert result of the successfully finished job to JS value.
+  virtual Local<Value> NewResult(size_t, uint64_t nonce) {
+    return NewNonce(nonce, nonce_type);
+  }
+
+  // Return result of the finished job, see `pow_job_result`.
+  virtual int GetResult(size_t index, uint64_t* nonce) {
+    return pow_job_result(entries[index].job, nonce);
+  }
+
+ private:
+  struct Entry {
+    PowTask* task;
+    size_t index;
+    PowJob* job;
+  };
+
+  // Executed inside the pool thread.
+  static void OnJobDone(PowJob*, void* data) {
+    Entry* entry = static_cast<Entry*>(data);
+    PowTask* task = entry->task;
+    uv_mutex_lock(&task->mutex);
+    task->finished.push_back(entry->index);
+    // Still under the mutex, otherwise the loop may report the entry
+    // and free the task before the send.
+    uv_async_send(&task->async);
+    uv_mutex_unlock(&task->mutex);
   }
 
-  // Executed when the async work is complete
+  // Executed when some jobs are complete
   // this function will be run inside the main event loop
   // so it is safe to use V8 again
-  void HandleOKCallback () {
-    if (error) {
-      Local<Value> argv[1];
-      if (error == -1) {
-        argv[0] = Nan::Error("Max safe integer overflow");
-      } else {
-        argv[0] = Nan::Error("Internal error");
-      }
+  static NAUV_WORK_CB(OnDone) {
+    Nan::HandleScope scope;
+    PowTask* task = static_cast<PowTask*>(async->data);
+    // Several sends may be coalesced into one call.
+    std::vector<size_t> finished;
+    uv_mutex_lock(&task->mutex);
+    finished.swap(task->finished);
+    uv_mutex_unlock(&task->mutex);
+
+    for (size_t i = 0; i < finished.size(); i++) {
+      task->Report(finished[i]);
+    }
+    if (task->reported == task->submitted) {
+      task->Abort();
+    }
+  }
+
+  void Report(size_t index) {
+    uint64_t nonce;
+    int error = GetResult(index, &nonce);
+    Local<Value> err = error ? PowError(error) : Local<Value>(Nan::Null());
+    Local<Value> value = error ?
+      Local<Value>(Nan::New<Number>(0)) :
+      NewResult(index, nonce);
+    reported++;
+    if (batch) {
+      Local<Value> argv[] = {err, Nan::New<Number>(index), value};
+      callback->Call(3, argv);
+    } else if (error) {
+      Local<Value> argv[] = {err};
       callback->Call(1, argv);
     } else {
-      Local<Value> argv[] = {Nan::Null(), Nan::New<Number>(nonce)};
+      Local<Value> argv[] = {err, value};
       callback->Call(2, argv);
     }
   }
 
+  static void OnClose(uv_handle_t* handle) {
+    delete static_cast<PowTask*>(handle->data);
+  }
+
+  // Accepts optional job index in case of batch. Returns whether
+  // anything was running at the moment of call. Handle is bound to the
+  // function so it may be called detached.
+  static NAN_METHOD(CancelPow) {
+    Local<Object> obj = info.Data().As<Object>();
+    PowTask* task =
+      static_cast<PowTask*>(Nan::GetInternalFieldPointer(obj, 0));
+    size_t index = ALL_JOBS;
+    if (info.Length() > 0 && info[0]->IsNumber()) {
+      index = Nan::To<uint32_t>(info[0]).FromJust();
+    }
+    bool cancelled = task && task->Cancel(index);
+    info.GetReturnValue().Set(Nan::New<v8::Boolean>(cancelled));
+  }
+
+  // Accepts optional job index in case of batch. Returns undefined once
+  // the job was reported.
+  static NAN_METHOD(GetPowStats) {
+    Local<Object> obj = info.Data().As<Object>();
+    PowTask* task =
+      static_cast<PowTask*>(Nan::GetInternalFieldPointer(obj, 0));
+    size_t index = 0;
+    if (info.Length() > 0 && info[0]->IsNumber()) {
+      index = Nan::To<uint32_t>(info[0]).FromJust();
+    }
+    if (task) {
+      info.GetReturnValue().Set(task->GetStats(index));
+    }
+  }
+
+  // The same as `GetPowStats` for checkpoints.
+  static NAN_METHOD(GetPowCheckpoint) {
+    Local<Object> obj = info.Data().As<Object>();
+    PowTask* task =
+      static_cast<PowTask*>(Nan::GetInternalFieldPointer(obj, 0));
+    size_t index = 0;
+    if (info.Length() > 0 && info[0]->IsNumber()) {
+      index = Nan::To<uint32_t>(info[0]).FromJust();
+    }
+    if (task) {
+      info.GetReturnValue().Set(task->SaveCheckpoint(index));
+    }
+  }
+
+  Nan::Callback* callback;
+  bool batch;
+  int nonce_type;
+  std::vector<Entry> entries;
+  size_t submitted;
+  size_t reported;
+  // Indexes of finished but not yet reported jobs.
+  std::vector<size_t> finished;
+  uv_mutex_t mutex;
+  Nan::Persistent<Object> handle;
+  uv_async_t async;
+};
+
+// Address keys search run by the pool, reports as
+// `cb(err, {signPrivateKey, encPrivateKey})`.
+class KeysTask : public PowTask {
+ public:
+  KeysTask(Nan::Callback* callback, AddrSearch* search)
+      : PowTask(callback, false, NONCE_NUMBER), search(search) {}
+
+  ~KeysTask() {
+    addr_search_free(search);
+  }
+
+ protected:
+  Local<Value> NewResult(size_t, uint64_t nonce) {
+    uint8_t sign_private[PRIVATE_KEY_SIZE];
+    uint8_t enc_private[PRIVATE_KEY_SIZE];
+    if (!addr_search_keys(search, nonce, sign_private, enc_private)) {
+      return Nan::Undefined();
+    }
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New<String>("signPrivateKey").ToLocalChecked(),
+      Nan::CopyBuffer(reinterpret_cast<char*>(sign_private),
+                      PRIVATE_KEY_SIZE).ToLocalChecked());
+    Nan::Set(obj, Nan::New<String>("encPrivateKey").ToLocalChecked(),
+      Nan::CopyBuffer(reinterpret_cast<char*>(enc_private),
+                      PRIVATE_KEY_SIZE).ToLocalChecked());
+    return obj;
+  }
+
  private:
-  size_t pool_size;
-  uint64_t target;
-  uint8_t* initial_hash;
-  uint64_t nonce;
-  int error;
+  AddrSearch* search;
+};
+
+// Trial decryption run by the pool, reports as
+// `cb(err, {index, plaintext})`.
+class DecryptTask : public PowTask {
+ public:
+  DecryptTask(Nan::Callback* callback, DecryptSearch* search)
+      : PowTask(callback, false, NONCE_NUMBER), search(search) {}
+
+  ~DecryptTask() {
+    decrypt_search_free(search);
+  }
+
+ protected:
+  Local<Value> NewResult(size_t, uint64_t index) {
+    uint8_t* plaintext;
+    size_t length;
+    if (!decrypt_search_plaintext(search, index, &plaintext, &length)) {
+      return Nan::Undefined();
+    }
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New<String>("index").ToLocalChecked(),
+      Nan::New<Number>(static_cast<double>(index)));
+    Nan::Set(obj, Nan::New<String>("plaintext").ToLocalChecked(),
+      Nan::CopyBuffer(reinterpret_cast<char*>(plaintext),
+                      length).ToLocalChecked());
+    free(plaintext);
+    return obj;
+  }
+
+ private:
+  DecryptSearch* search;
+};
+
+class VerifyTask : public PowTask {
+ public:
+  VerifyTask(Nan::Callback* callback, VerifyBatch* batch, size_t count)
+      : PowTask(callback, false, NONCE_NUMBER), batch(batch), count(count) {}
+
+  ~VerifyTask() {
+    verify_batch_free(batch);
+  }
+
+ protected:
+  // Job succeeds once every item is checked.
+  int GetResult(size_t index, uint64_t* nonce) {
+    int result = PowTask::GetResult(index, nonce);
+    return result == RESULT_NOT_FOUND ? RESULT_OK : result;
+  }
+
+  Local<Value> NewResult(size_t, uint64_t) {
+    std::vector<uint8_t> bitmap((count + 7) / 8);
+    verify_batch_results(batch, &bitmap[0]);
+    return Nan::CopyBuffer(reinterpret_cast<char*>(&bitmap[0]),
+                           bitmap.size()).ToLocalChecked();
+  }
+
+ private:
+  VerifyBatch* batch;
+  size_t count;
 };
 
+// Parse optional scheduling parameters, see `pow_job_set_priority`.
+static bool GetPriority(Local<Value> priority_value,
+                        Local<Value> deadline_value,
+                        int* priority,
+                        uint64_t* deadline) {
+  *priority = 0;
+  *deadline = 0;
+  if (!priority_value->IsUndefined()) {
+    if (!priority_value->IsNumber()) {
+      return false;
+    }
+    *priority = priority_value->Int32Value();
+    if (*priority >= POW_PRIORITY_URGENT) {
+      *priority = POW_PRIORITY_URGENT - 1;
+    }
+  }
+  if (!deadline_value->IsUndefined()) {
+    if (!deadline_value->IsNumber() ||
+        deadline_value->NumberValue() < 0) {
+      return false;
+    }
+    *deadline = deadline_value->IntegerValue();
+  }
+  return true;
+}
+
+// Validate and parse initial hash argument.
+static bool GetInitialHash(Local<Value> value, uint8_t** initial_hash) {
+  if (!node::Buffer::HasInstance(value)) {
+    return false;
+  }
+  char* buf = node::Buffer::Data(value);
+  size_t length = node::Buffer::Length(value);
+  if (buf == NULL || length != HASH_SIZE) {
+    return false;
+  }
+  *initial_hash = reinterpret_cast<uint8_t*>(buf);
+  return true;
+}
+
+// Queue the task and return its handle to JS.
+static void StartTask(NAN_METHOD_ARGS_TYPE info, PowTask* task) {
+  Local<Object> handle = task->NewHandle();
+  int error = task->Submit();
+  if (error) {
+    if (task->IsSubmitted()) {
+      // Already queued jobs will still be reported.
+      task->Cancel(PowTask::ALL_JOBS);
+    } else {
+      task->Abort();
+    }
+    return Nan::ThrowError("Can't start POW pool");
+  }
+  info.GetReturnValue().Set(handle);
+}
+
 NAN_METHOD(PowAsync) {
+  uint64_t target;
+  uint8_t* initial_hash;
+  int priority;
+  uint64_t deadline;
+  int nonce_type;
+  Checkpoint checkpoint;
+  bool resume;
+  NonceRange range;
+  bool ranged;
+  int backends;
+  if (info.Length() != 10 ||
+      !info[0]->IsNumber() ||  // pool_size
+      !GetUInt64(info[1], &target) ||  // target
+      !GetInitialHash(info[2], &initial_hash) ||  // initial_hash
+      !GetPriority(info[3], info[4], &priority, &deadline) ||
+      !GetNonceType(info[5], &nonce_type) ||
+      !GetCheckpoint(info[6], &checkpoint, &resume) ||
+      !GetRange(info[7], GetMaxNonce(nonce_type), &range, &ranged) ||
+      !GetBackends(info[8], &backends) ||
+      !info[9]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+
+  size_t pool_size = info[0]->Uint32Value();
+  if (pool_size < 1 || pool_size > MAX_POOL_SIZE) {
+    return Nan::ThrowError("Bad input");
+  }
+
+  // Job keeps its own copy of the initial hash.
+  PowJob* job = pow_job_new(pool_size,
+                            target,
+                            initial_hash,
+                            GetMaxNonce(nonce_type));
+  if (!job) {
+    return Nan::ThrowError("Internal error");
+  }
+  if (pow_job_set_backends(job, backends)) {
+    pow_job_free(job);
+    return Nan::ThrowError("No POW devices");
+  }
+  if ((ranged &&
+       pow_job_set_range(job, range.start, range.end, range.stride)) ||
+      (resume && !RestoreCheckpoint(job, checkpoint))) {
+    pow_job_free(job);
+    return Nan::ThrowError("Internal error");
+  }
+  pow_job_set_priority(job, priority, deadline);
+  Nan::Callback* callback = new Nan::Callback(info[9].As<Function>());
+  PowTask* task = new PowTask(callback, false, nonce_type);
+  task->AddJob(job);
+  StartTask(info, task);
+}
+
+// Do POW for several objects at once. Jobs are queued together so
+// they share the pool without oversubscribing it. Returns the same
+// handle as `powAsync`.
+NAN_METHOD(PowBatch) {
+  int nonce_type;
+  int backends;
+  if (info.Length() != 5 ||
+      !info[0]->IsNumber() ||  // pool_size
+      // [{initialHash, target, priority?, deadline?, checkpoint?,
+      //   range?}, ...]
+      !info[1]->IsArray() ||
+      !GetNonceType(info[2], &nonce_type) ||
+      !GetBackends(info[3], &backends) ||
+      !info[4]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+
+  size_t pool_size = info[0]->Uint32Value();
+  Local<v8::Array> list = info[1].As<v8::Array>();
+  if (pool_size < 1 || pool_size > MAX_POOL_SIZE || list->Length() == 0) {
+    return Nan::ThrowError("Bad input");
+  }
+
+  Nan::Callback* callback = new Nan::Callback(info[4].As<Function>());
+  PowTask* task = new PowTask(callback, true, nonce_type);
+  Local<String> target_key = Nan::New<String>("target").ToLocalChecked();
+  Local<String> hash_key = Nan::New<String>("initialHash").ToLocalChecked();
+  Local<String> priority_key = Nan::New<String>("priority").ToLocalChecked();
+  Local<String> deadline_key = Nan::New<String>("deadline").ToLocalChecked();
+  Local<String> checkpoint_key =
+    Nan::New<String>("checkpoint").ToLocalChecked();
+  Local<String> range_key = Nan::New<String>("range").ToLocalChecked();
+  for (uint32_t i = 0; i < list->Length(); i++) {
+    Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+    if (!item->IsObject()) {
+      task->Abort();
+      return Nan::ThrowError("Bad input");
+    }
+    Local<Object> obj = item.As<Object>();
+    uint64_t target;
+    uint8_t* initial_hash;
+    int priority;
+    uint64_t deadline;
+    Checkpoint checkpoint;
+    bool resume;
+    NonceRange range;
+    bool ranged;
+    if (!GetUInt64(Nan::Get(obj, target_key).ToLocalChecked(), &target) ||
+        !GetInitialHash(Nan::Get(obj, hash_key).ToLocalChecked(),
+                        &initial_hash) ||
+        !GetPriority(Nan::Get(obj, priority_key).ToLocalChecked(),
+                     Nan::Get(obj, deadline_key).ToLocalChecked(),
+                     &priority,
+                     &deadline) ||
+        !GetCheckpoint(Nan::Get(obj, checkpoint_key).ToLocalChecked(),
+                       &checkpoint,
+                       &resume) ||
+        !GetRange(Nan::Get(obj, range_key).ToLocalChecked(),
+                  GetMaxNonce(nonce_type),
+                  &range,
+                  &ranged)) {
+      task->Abort();
+      return Nan::ThrowError("Bad input");
+    }
+    PowJob* job = pow_job_new(pool_size,
+                              target,
+                              initial_hash,
+                              GetMaxNonce(nonce_type));
+    if (!job) {
+      task->Abort();
+      return Nan::ThrowError("Internal error");
+    }
+    if (pow_job_set_backends(job, backends)) {
+      pow_job_free(job);
+      task->Abort();
+      return Nan::ThrowError("No POW devices");
+    }
+    if ((ranged &&
+         pow_job_set_range(job, range.start, range.end, range.stride)) ||
+        (resume && !RestoreCheckpoint(job, checkpoint))) {
+      pow_job_free(job);
+      task->Abort();
+      return Nan::ThrowError("Internal error");
+    }
+    pow_job_set_priority(job, priority, deadline);
+    task->AddJob(job);
+  }
+  StartTask(info, task);
+}
+
+// Search address keys with ripe of the given length range on the POW
+// pool. Keys are derived from the passphrase if it's given, random
+// otherwise. Returns the same handle as `powAsync`.
+NAN_METHOD(SearchKeys) {
+  if (info.Length() != 5 ||
+      !info[0]->IsNumber() ||  // pool_size
+      // passphrase
+      !(info[1]->IsUndefined() || node::Buffer::HasInstance(info[1])) ||
+      !info[2]->IsNumber() ||  // min_length
+      !info[3]->IsNumber() ||  // max_length
+      !info[4]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+
+  size_t pool_size = info[0]->Uint32Value();
+  if (pool_size < 1 || pool_size > MAX_POOL_SIZE) {
+    return Nan::ThrowError("Bad input");
+  }
+  int mode = ADDR_RANDOM;
+  const uint8_t* passphrase = NULL;
+  size_t passphrase_length = 0;
+  if (!info[1]->IsUndefined()) {
+    mode = ADDR_PASSPHRASE;
+    passphrase = reinterpret_cast<uint8_t*>(node::Buffer::Data(info[1]));
+    passphrase_length = node::Buffer::Length(info[1]);
+  }
+  // Search keeps its own copy of the passphrase.
+  AddrSearch* search = addr_search_new(mode,
+                                       passphrase,
+                                       passphrase_length,
+                                       info[2]->Uint32Value(),
+                                       info[3]->Uint32Value());
+  if (!search) {
+    return Nan::ThrowError("Bad input");
+  }
+  PowJob* job = addr_search_job(search, pool_size);
+  if (!job) {
+    addr_search_free(search);
+    return Nan::ThrowError("Internal error");
+  }
+  Nan::Callback* callback = new Nan::Callback(info[4].As<Function>());
+  PowTask* task = new KeysTask(callback, search);
+  task->AddJob(job);
+  StartTask(info, task);
+}
+
+// Try to decrypt the payload with every private key of the packed
+// buffer on the POW pool. Payload and keys are copied. Returns the same
+// handle as `powAsync`.
+NAN_METHOD(DecryptBatch) {
   if (info.Length() != 4 ||
       !info[0]->IsNumber() ||  // pool_size
-      !info[1]->IsNumber() ||  // target
-      !node::Buffer::HasInstance(info[2]) ||  // initial_hash
+      !node::Buffer::HasInstance(info[1]) ||  // payload
+      !node::Buffer::HasInstance(info[2]) ||  // keys
       !info[3]->IsFunction()) {  // cb
     return Nan::ThrowError("Bad input");
   }
-
   size_t pool_size = info[0]->Uint32Value();
-  uint64_t target = info[1]->IntegerValue();
-  char* buf = node::Buffer::Data(info[2]);
-  size_t length = node::Buffer::Length(info[2]);
+  size_t keys_length = node::Buffer::Length(info[2]);
   if (pool_size < 1 ||
       pool_size > MAX_POOL_SIZE ||
-      buf == NULL ||
-      length != HASH_SIZE) {
+      keys_length % DECRYPT_KEY_SIZE) {
     return Nan::ThrowError("Bad input");
   }
-
-  uint8_t* initial_hash = new uint8_t[length];
-  memcpy(initial_hash, buf, length);
+  DecryptSearch* search = decrypt_search_new(
+    reinterpret_cast<uint8_t*>(node::Buffer::Data(info[1])),
+    node::Buffer::Length(info[1]),
+    reinterpret_cast<uint8_t*>(node::Buffer::Data(info[2])),
+    keys_length / DECRYPT_KEY_SIZE);
+  if (!search) {
+    return Nan::ThrowError("Bad input");
+  }
+  PowJob* job = decrypt_search_job(search, pool_size);
+  if (!job) {
+    decrypt_search_free(search);
+    return Nan::ThrowError("Internal error");
+  }
   Nan::Callback* callback = new Nan::Callback(info[3].As<Function>());
-  Nan::AsyncQueueWorker(
-    new PowWorker(callback, pool_size, target, initial_hash));
+  PowTask* task = new DecryptTask(callback, search);
+  task->AddJob(job);
+  StartTask(info, task);
 }
 
-NAN_MODULE_INIT(InitAll) {
+// Object of `powCheckBatch`, points into the JS buffer memory.
+struct CheckItem {
+  const uint8_t* payload;
+  size_t length;
+  uint64_t target;
+};
+
+// Parse `powCheckBatch` arguments.
+static bool GetCheckItems(Local<Value> buffers_value,
+                          Local<Value> targets_value,
+                          std::vector<CheckItem>* items) {
+  if (!buffers_value->IsArray() || !targets_value->IsArray()) {
+    return false;
+  }
+  Local<v8::Array> buffers = buffers_value.As<v8::Array>();
+  Local<v8::Array> targets = targets_value.As<v8::Array>();
+  if (buffers->Length() != targets->Length()) {
+    return false;
+  }
+  items->resize(buffers->Length());
+  for (uint32_t i = 0; i < buffers->Length(); i++) {
+    Local<Value> buf = Nan::Get(buffers, i).ToLocalChecked();
+    Local<Value> target = Nan::Get(targets, i).ToLocalChecked();
+    CheckItem& item = (*items)[i];
+    if (!node::Buffer::HasInstance(buf) || !GetUInt64(target, &item.target)) {
+      return false;
+    }
+    item.payload = reinterpret_cast<uint8_t*>(node::Buffer::Data(buf));
+    item.length = node::Buffer::Length(buf);
+  }
+  return true;
+}
+
+// Set bit `i % 8` of byte `i / 8` for every passed object.
+static void CheckItems(const std::vector<CheckItem>& items,
+                       std::vector<uint8_t>* bitmap) {
+  bitmap->assign((items.size() + 7) / 8, 0);
+  for (size_t i = 0; i < items.size(); i++) {
+    const CheckItem& item = items[i];
+    if (pow_check(item.payload, item.length, item.target)) {
+      (*bitmap)[i / 8] |= 1 << (i % 8);
+    }
+  }
+}
+
+static Local<Object> CopyVector(const std::vector<uint8_t>& vector) {
+  const char* data = vector.empty() ?
+    NULL :
+    reinterpret_cast<const char*>(&vector[0]);
+  return Nan::CopyBuffer(data, vector.size()).ToLocalChecked();
+}
+
+// Copy the list of Buffers, flattening nested lists, for workers to
+// persist: the caller may change its own arrays while the worker reads
+// the Buffers.
+static Local<v8::Array> CopyBufferList(Local<Value> list_value) {
+  Local<v8::Array> list = list_value.As<v8::Array>();
+  Local<v8::Array> copy = Nan::New<v8::Array>();
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < list->Length(); i++) {
+    Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+    if (item->IsArray()) {
+      Local<v8::Array> nested = item.As<v8::Array>();
+      for (uint32_t j = 0; j < nested->Length(); j++) {
+        Nan::Set(copy, count++, Nan::Get(nested, j).ToLocalChecked());
+      }
+    } else {
+      Nan::Set(copy, count++, item);
+    }
+  }
+  return copy;
+}
+
+// Check objects on the libuv thread pool. Buffers are kept referenced
+// till the end and must not be modified meanwhile.
+class CheckWorker : public Nan::AsyncWorker {
+ public:
+  CheckWorker(Nan::Callback* callback,
+              const std::vector<CheckItem>& items,
+              Local<Value> buffers)
+      : Nan::AsyncWorker(callback), items(items) {
+    SaveToPersistent("buffers", CopyBufferList(buffers));
+  }
+
+  void Execute() {
+    CheckItems(items, &bitmap);
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    Local<Value> argv[] = {Nan::Null(), CopyVector(bitmap)};
+    callback->Call(2, argv);
+  }
+
+ private:
+  std::vector<CheckItem> items;
+  std::vector<uint8_t> bitmap;
+};
+
+// Check POW of several object payloads at once. Returns bitmap Buffer
+// with bit set for every passed object, or passes it to the optional
+// callback as `cb(err, bitmap)` doing the work off the event loop.
+NAN_METHOD(PowCheckBatch) {
+  std::vector<CheckItem> items;
+  if (info.Length() != 3 ||
+      // buffers, targets
+      !GetCheckItems(info[0], info[1], &items) ||
+      !(info[2]->IsUndefined() || info[2]->IsFunction())) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  if (info[2]->IsFunction()) {
+    Nan::Callback* callback = new Nan::Callback(info[2].As<Function>());
+    Nan::AsyncQueueWorker(new CheckWorker(callback, items, info[0]));
+    return;
+  }
+  std::vector<uint8_t> bitmap;
+  CheckItems(items, &bitmap);
+  info.GetReturnValue().Set(CopyVector(bitmap));
+}
+
+static void ThrowCodecError(int error) {
+  switch (error) {
+    case CODEC_IMPRACTICAL:
+      return Nan::ThrowError("Impractical var_int");
+    case CODEC_UNSAFE:
+      return Nan::ThrowError("Unsafe integer");
+    default:
+      return Nan::ThrowError("Buffer is too small");
+  }
+}
+
+// Decode `var_int_list` in one pass. Returns `{list, length}` where
+// `list` is a Float64Array.
+NAN_METHOD(VarIntListDecode) {
+  if (info.Length() != 1 || !node::Buffer::HasInstance(info[0])) {
+    return Nan::ThrowError("Bad input");
+  }
+  const uint8_t* buf =
+    reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0]));
+  size_t length = node::Buffer::Length(info[0]);
+  uint64_t count;
+  size_t size;
+  int error = codec_var_int_decode(buf, length, &count, &size);
+  if (error) {
+    return ThrowCodecError(error);
+  }
+  // Every entry takes at least one byte, so bogus length is rejected
+  // before allocation.
+  if (count > length - size) {
+    return ThrowCodecError(CODEC_TRUNCATED);
+  }
+  Local<v8::ArrayBuffer> array_buffer = v8::ArrayBuffer::New(
+    v8::Isolate::GetCurrent(), count * sizeof(double));
+  Local<v8::Float64Array> list =
+    v8::Float64Array::New(array_buffer, 0, count);
+  Nan::TypedArrayContents<double> values(list);
+  error = codec_var_int_list_decode(buf, length, count, *values, &size);
+  if (error) {
+    return ThrowCodecError(error);
+  }
+  Local<Object> obj = Nan::New<Object>();
+  Nan::Set(obj, Nan::New<String>("list").ToLocalChecked(), list);
+  Nan::Set(obj, Nan::New<String>("length").ToLocalChecked(),
+    Nan::New<Number>(static_cast<double>(size)));
+  info.GetReturnValue().Set(obj);
+}
+
+// Encode array of safe integers as `var_int_list`.
+NAN_METHOD(VarIntListEncode) {
+  if (info.Length() != 1 || !info[0]->IsArray()) {
+    return Nan::ThrowError("Bad input");
+  }
+  Local<v8::Array> list = info[0].As<v8::Array>();
+  uint32_t count = list->Length();
+  std::vector<uint8_t> out((count + 1) * CODEC_VAR_INT_MAX_SIZE);
+  size_t size = codec_var_int_encode(count, &out[0]);
+  for (uint32_t i = 0; i < count; i++) {
+    Local<Value> item = Nan::Get(list, i).ToLocalChecked();
+    if (!item->IsNumber()) {
+      return Nan::ThrowError("Bad input");
+    }
+    double value = item->NumberValue();
+    if (!(value >= 0) ||
+        value > static_cast<double>(MAX_SAFE_INTEGER) ||
+        value != static_cast<double>(static_cast<uint64_t>(value))) {
+      return Nan::ThrowError("Bad input");
+    }
+    size += codec_var_int_encode(static_cast<uint64_t>(value), &out[size]);
+  }
+  out.resize(size);
+  info.GetReturnValue().Set(CopyVector(out));
+}
+
+// Drop `net_addr` entries with private IPs from the packed list.
+NAN_METHOD(AddrFilter) {
+  if (info.Length() != 1 ||
+      !node::Buffer::HasInstance(info[0]) ||
+      node::Buffer::Length(info[0]) % CODEC_ADDR_SIZE) {
+    return Nan::ThrowError("Bad input");
+  }
+  size_t count = node::Buffer::Length(info[0]) / CODEC_ADDR_SIZE;
+  std::vector<uint8_t> out(count * CODEC_ADDR_SIZE);
+  if (count) {
+    count = codec_addr_filter(
+      reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+      count,
+      &out[0]);
+  }
+  out.resize(count * CODEC_ADDR_SIZE);
+  info.GetReturnValue().Set(CopyVector(out));
+}
+
+// Object buffers of `invHashBatch`, point into the JS buffer memory.
+struct HashItems {
+  std::vector<const uint8_t*> payloads;
+  std::vector<size_t> lengths;
+};
+
+static bool GetHashItems(Local<Value> buffers_value, HashItems* items) {
+  if (!buffers_value->IsArray()) {
+    return false;
+  }
+  Local<v8::Array> buffers = buffers_value.As<v8::Array>();
+  items->payloads.resize(buffers->Length());
+  items->lengths.resize(buffers->Length());
+  for (uint32_t i = 0; i < buffers->Length(); i++) {
+    Local<Value> buf = Nan::Get(buffers, i).ToLocalChecked();
+    if (!node::Buffer::HasInstance(buf)) {
+      return false;
+    }
+    items->payloads[i] = reinterpret_cast<uint8_t*>(node::Buffer::Data(buf));
+    items->lengths[i] = node::Buffer::Length(buf);
+  }
+  return true;
+}
+
+static void HashItemsTo(const HashItems& items, std::vector<uint8_t>* out) {
+  out->resize(items.payloads.size() * INV_VECTOR_SIZE);
+  if (!out->empty()) {
+    inv_hash_batch(&items.payloads[0], &items.lengths[0],
+                   items.payloads.size(), &(*out)[0]);
+  }
+}
+
+// Hash objects on the libuv thread pool, the same as `CheckWorker`.
+class HashWorker : public Nan::AsyncWorker {
+ public:
+  HashWorker(Nan::Callback* callback,
+             const HashItems& items,
+             Local<Value> buffers)
+      : Nan::AsyncWorker(callback), items(items) {
+    SaveToPersistent("buffers", CopyBufferList(buffers));
+  }
+
+  void Execute() {
+    HashItemsTo(items, &vectors);
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    Local<Value> argv[] = {Nan::Null(), CopyVector(vectors)};
+    callback->Call(2, argv);
+  }
+
+ private:
+  HashItems items;
+  std::vector<uint8_t> vectors;
+};
+
+// Compute inventory vectors of several objects into one flat Buffer,
+// optionally off the event loop as `cb(err, vectors)`.
+NAN_METHOD(InvHashBatch) {
+  HashItems items;
+  if (info.Length() != 2 ||
+      !GetHashItems(info[0], &items) ||  // buffers
+      !(info[1]->IsUndefined() || info[1]->IsFunction())) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  if (info[1]->IsFunction()) {
+    Nan::Callback* callback = new Nan::Callback(info[1].As<Function>());
+    Nan::AsyncQueueWorker(new HashWorker(callback, items, info[0]));
+    return;
+  }
+  std::vector<uint8_t> vectors;
+  HashItemsTo(items, &vectors);
+  info.GetReturnValue().Set(CopyVector(vectors));
+}
+
+// Verify signatures of packed 65-byte public keys over messages on the
+// POW pool. Messages and signatures are arrays of Buffers; all are
+// copied. Passes bitmap of valid signatures as `cb(err, bitmap)` and
+// returns the same handle as `powAsync`.
+NAN_METHOD(VerifySignatures) {
+  HashItems messages;
+  HashItems sigs;
+  if (info.Length() != 5 ||
+      !info[0]->IsNumber() ||  // pool_size
+      !node::Buffer::HasInstance(info[1]) ||  // public_keys
+      !GetHashItems(info[2], &messages) ||  // messages
+      !GetHashItems(info[3], &sigs) ||  // sigs
+      !info[4]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  size_t pool_size = info[0]->Uint32Value();
+  size_t count = messages.payloads.size();
+  if (pool_size < 1 ||
+      pool_size > MAX_POOL_SIZE ||
+      !count ||
+      sigs.payloads.size() != count ||
+      node::Buffer::Length(info[1]) != count * VERIFY_KEY_SIZE) {
+    return Nan::ThrowError("Bad input");
+  }
+  VerifyBatch* batch = verify_batch_new(
+    reinterpret_cast<uint8_t*>(node::Buffer::Data(info[1])),
+    &messages.payloads[0],
+    &messages.lengths[0],
+    &sigs.payloads[0],
+    &sigs.lengths[0],
+    count);
+  if (!batch) {
+    return Nan::ThrowError("Out of memory");
+  }
+  PowJob* job = verify_batch_job(batch, pool_size);
+  if (!job) {
+    verify_batch_free(batch);
+    return Nan::ThrowError("Internal error");
+  }
+  Nan::Callback* callback = new Nan::Callback(info[4].As<Function>());
+  PowTask* task = new VerifyTask(callback, batch, count);
+  task->AddJob(job);
+  StartTask(info, task);
+}
+
+// Object data of `initialHashAsync`: chunks of all objects flattened,
+// `ends[i]` is the end of i-th object's chunks.
+struct DataItems {
+  HashItems chunks;
+  std::vector<size_t> ends;
+};
+
+static bool GetDataItems(Local<Value> list_value, DataItems* items) {
+  if (!list_value->IsArray()) {
+    return false;
+  }
+  Local<v8::Array> list = list_value.As<v8::Array>();
+  for (uint32_t i = 0; i < list->Length(); i++) {
+    Local<Value> data = Nan::Get(list, i).ToLocalChecked();
+    HashItems chunks;
+    if (node::Buffer::HasInstance(data)) {
+      chunks.payloads.push_back(
+        reinterpret_cast<uint8_t*>(node::Buffer::Data(data)));
+      chunks.lengths.push_back(node::Buffer::Length(data));
+    } else if (!GetHashItems(data, &chunks)) {
+      return false;
+    }
+    items->chunks.payloads.insert(items->chunks.payloads.end(),
+                                  chunks.payloads.begin(),
+                                  chunks.payloads.end());
+    items->chunks.lengths.insert(items->chunks.lengths.end(),
+                                 chunks.lengths.begin(),
+                                 chunks.lengths.end());
+    items->ends.push_back(items->chunks.payloads.size());
+  }
+  return true;
+}
+
+// Hash object data on the libuv thread pool right from the JS buffers.
+class InitialHashWorker : public Nan::AsyncWorker {
+ public:
+  InitialHashWorker(Nan::Callback* callback,
+                    const DataItems& items,
+                    Local<Value> list)
+      : Nan::AsyncWorker(callback), items(items) {
+    SaveToPersistent("list", CopyBufferList(list));
+  }
+
+  void Execute() {
+    hashes.resize(items.ends.size() * HASH_SIZE);
+    size_t begin = 0;
+    for (size_t i = 0; i < items.ends.size(); i++) {
+      size_t end = items.ends[i];
+      // Empty data has no chunks at all.
+      pow_initial_hash(begin < end ? &items.chunks.payloads[begin] : NULL,
+                       begin < end ? &items.chunks.lengths[begin] : NULL,
+                       end - begin,
+                       &hashes[i * HASH_SIZE]);
+      begin = end;
+    }
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    Local<Value> argv[] = {Nan::Null(), CopyVector(hashes)};
+    callback->Call(2, argv);
+  }
+
+ private:
+  DataItems items;
+  std::vector<uint8_t> hashes;
+};
+
+// Compute initial hashes of the list of objects, every one is a Buffer
+// or an array of chunks. Passes packed hashes as `cb(err, hashes)`.
+NAN_METHOD(InitialHashAsync) {
+  DataItems items;
+  if (info.Length() != 2 ||
+      !GetDataItems(info[0], &items) ||  // list
+      !info[1]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  Nan::Callback* callback = new Nan::Callback(info[1].As<Function>());
+  Nan::AsyncQueueWorker(new InitialHashWorker(callback, items, info[0]));
+}
+
+class TuneWorker : public Nan::AsyncWorker {
+ public:
+  explicit TuneWorker(Nan::Callback* callback)
+      : Nan::AsyncWorker(callback), pool_size(0) {}
+
+  void Execute() {
+    pool_size = pow_tuned_pool_size();
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    Local<Value> argv[] = {
+      Nan::Null(),
+      Nan::New<Number>(static_cast<double>(pool_size)),
+    };
+    callback->Call(2, argv);
+  }
+
+ private:
+  size_t pool_size;
+};
+
+// Calibrate the default pool size, see `pow_tuned_pool_size`. Passes it
+// as `cb(err, poolSize)`.
+NAN_METHOD(TunePoolSize) {
+  if (info.Length() != 1 || !info[0]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  Nan::Callback* callback = new Nan::Callback(info[0].As<Function>());
+  Nan::AsyncQueueWorker(new TuneWorker(callback));
+}
+
+// Native state of `structs.inv_vect.Set`. All methods accept packed
+// vectors.
+class InvSetWrap : public Nan::ObjectWrap {
+ public:
+  static NAN_METHOD(New) {
+    if (!info.IsConstructCall()) {
+      return Nan::ThrowError("Bad input");
+    }
+    InvSet* set = inv_set_new();
+    if (!set) {
+      return Nan::ThrowError("Out of memory");
+    }
+    InvSetWrap* wrap = new InvSetWrap(set);
+    wrap->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  // Return number of vectors which were not in the set.
+  static NAN_METHOD(Insert) {
+    InvSetWrap* wrap;
+    const uint8_t* vectors;
+    size_t count;
+    if (!GetArgs(info, &wrap, &vectors, &count)) {
+      return Nan::ThrowError("Bad input");
+    }
+    size_t added;
+    if (!inv_set_insert(wrap->set, vectors, count, &added)) {
+      return Nan::ThrowError("Out of memory");
+    }
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(added)));
+  }
+
+  static NAN_METHOD(Contains) {
+    InvSetWrap* wrap;
+    const uint8_t* vectors;
+    size_t count;
+    if (!GetArgs(info, &wrap, &vectors, &count) || count != 1) {
+      return Nan::ThrowError("Bad input");
+    }
+    info.GetReturnValue().Set(inv_set_contains(wrap->set, vectors));
+  }
+
+  // Return packed vectors missing from the set.
+  static NAN_METHOD(Diff) {
+    InvSetWrap* wrap;
+    const uint8_t* vectors;
+    size_t count;
+    if (!GetArgs(info, &wrap, &vectors, &count)) {
+      return Nan::ThrowError("Bad input");
+    }
+    std::vector<uint8_t> missing(count * INV_VECTOR_SIZE);
+    if (count) {
+      count = inv_set_diff(wrap->set, vectors, count, &missing[0]);
+    }
+    missing.resize(count * INV_VECTOR_SIZE);
+    info.GetReturnValue().Set(CopyVector(missing));
+  }
+
+  static NAN_METHOD(Size) {
+    InvSetWrap* wrap = Nan::ObjectWrap::Unwrap<InvSetWrap>(info.This());
+    double size = static_cast<double>(inv_set_size(wrap->set));
+    info.GetReturnValue().Set(Nan::New<Number>(size));
+  }
+
+  ~InvSetWrap() {
+    inv_set_free(set);
+  }
+
+ private:
+  explicit InvSetWrap(InvSet* set) : set(set) {}
+
+  static bool GetArgs(NAN_METHOD_ARGS_TYPE info,
+                      InvSetWrap** wrap,
+                      const uint8_t** vectors,
+                      size_t* count) {
+    if (info.Length() != 1 || !node::Buffer::HasInstance(info[0])) {
+      return false;
+    }
+    size_t length = node::Buffer::Length(info[0]);
+    if (length % INV_VECTOR_SIZE) {
+      return false;
+    }
+    *wrap = Nan::ObjectWrap::Unwrap<InvSetWrap>(info.This());
+    *vectors = reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0]));
+    *count = length / INV_VECTOR_SIZE;
+    return true;
+  }
+
+  InvSet* set;
+};
+
+static void FreeArena(char* data, void*) {
+  free(data);
+}
+
+// Native state of `structs.message.Framer`. Batches are cut off on the
+// libuv thread pool, so only one `push` may be in flight.
+class FramerWrap : public Nan::ObjectWrap {
+ public:
+  static NAN_METHOD(New) {
+    if (!info.IsConstructCall()) {
+      return Nan::ThrowError("Bad input");
+    }
+    Framer* framer = framer_new();
+    if (!framer) {
+      return Nan::ThrowError("Out of memory");
+    }
+    FramerWrap* wrap = new FramerWrap(framer);
+    wrap->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  // Append chunk and frame all complete messages as
+  // `cb(err, arena, messages)`. `arena` is a Buffer all payloads point
+  // into or undefined if there are none.
+  static NAN_METHOD(Push);
+
+  ~FramerWrap() {
+    framer_free(framer);
+  }
+
+ private:
+  explicit FramerWrap(Framer* framer) : framer(framer), busy(false) {}
+
+  friend class FrameWorker;
+  Framer* framer;
+  bool busy;
+};
+
+class FrameWorker : public Nan::AsyncWorker {
+ public:
+  FrameWorker(Nan::Callback* callback, FramerWrap* wrap)
+      : Nan::AsyncWorker(callback), wrap(wrap) {
+    memset(&batch, 0, sizeof(batch));
+    SaveToPersistent("framer", wrap->handle());
+  }
+
+  ~FrameWorker() {
+    // Arena is owned by the Buffer on success.
+    free(batch.arena);
+    framer_batch_free(&batch);
+  }
+
+  void Execute() {
+    if (!framer_take(wrap->framer, &batch)) {
+      SetErrorMessage("Out of memory");
+    }
+  }
+
+  void HandleOKCallback() {
+    Nan::HandleScope scope;
+    wrap->busy = false;
+    Local<Value> arena = Nan::Undefined();
+    if (batch.arena) {
+      arena = Nan::NewBuffer(reinterpret_cast<char*>(batch.arena),
+                             batch.arena_length,
+                             FreeArena,
+                             NULL).ToLocalChecked();
+      batch.arena = NULL;
+    }
+    Local<v8::Array> messages = Nan::New<v8::Array>(batch.count);
+    for (size_t i = 0; i < batch.count; i++) {
+      const FramerMessage& message = batch.messages[i];
+      Local<Object> obj = Nan::New<Object>();
+      Nan::Set(obj, Nan::New<String>("status").ToLocalChecked(),
+        Nan::New<Number>(message.status));
+      if (message.status == FRAMER_OK) {
+        Nan::Set(obj, Nan::New<String>("command").ToLocalChecked(),
+          Nan::New<String>(message.command).ToLocalChecked());
+        Nan::Set(obj, Nan::New<String>("offset").ToLocalChecked(),
+          Nan::New<Number>(static_cast<double>(message.offset)));
+        Nan::Set(obj, Nan::New<String>("length").ToLocalChecked(),
+          Nan::New<Number>(static_cast<double>(message.length)));
+      }
+      Nan::Set(messages, static_cast<uint32_t>(i), obj);
+    }
+    Local<Value> argv[] = {Nan::Null(), arena, messages};
+    callback->Call(3, argv);
+  }
+
+  void HandleErrorCallback() {
+    wrap->busy = false;
+    Nan::AsyncWorker::HandleErrorCallback();
+  }
+
+ private:
+  FramerWrap* wrap;
+  FramerBatch batch;
+};
+
+NAN_METHOD(FramerWrap::Push) {
+  if (info.Length() != 2 ||
+      !node::Buffer::HasInstance(info[0]) ||  // chunk
+      !info[1]->IsFunction()) {  // cb
+    return Nan::ThrowError("Bad input");
+  }
+  FramerWrap* wrap = Nan::ObjectWrap::Unwrap<FramerWrap>(info.This());
+  if (wrap->busy) {
+    return Nan::ThrowError("Framer is busy");
+  }
+  // The only copy of the data, socket chunks are not retained.
+  if (!framer_push(wrap->framer,
+                   reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+                   node::Buffer::Length(info[0]))) {
+    return Nan::ThrowError("Out of memory");
+  }
+  wrap->busy = true;
+  Nan::Callback* callback = new Nan::Callback(info[1].As<Function>());
+  Nan::AsyncQueueWorker(new FrameWorker(callback, wrap));
+}
+
+static void ReleaseRegion(char*, void* hint) {
+  store_region_release(static_cast<StoreRegion*>(hint));
+}
+
+static void ThrowStoreError(int error) {
+  switch (error) {
+    case STORE_BAD_FILE:
+      return Nan::ThrowError("Bad store file");
+    case STORE_NO_MEMORY:
+      return Nan::ThrowError("Out of memory");
+    case STORE_TOO_LARGE:
+      return Nan::ThrowError("Object is too large");
+    case STORE_UNSUPPORTED:
+      return Nan::ThrowError("Not supported");
+    default:
+      return Nan::ThrowError("Store I/O error");
+  }
+}
+
+// Native state of `store.ObjectStore`. Methods are synchronous, writes
+// go to the page cache and `sync` is left to the caller.
+class StoreWrap : public Nan::ObjectWrap {
+ public:
+  // Accepts `path` and current time in seconds.
+  static NAN_METHOD(New) {
+    if (!info.IsConstructCall() ||
+        info.Length() != 2 ||
+        !info[0]->IsString() ||  // path
+        !info[1]->IsNumber()) {  // now
+      return Nan::ThrowError("Bad input");
+    }
+    Nan::Utf8String path(info[0]);
+    ObjectStore* store;
+    int error = store_open(*path, info[1]->IntegerValue(), &store);
+    if (error) {
+      return ThrowStoreError(error);
+    }
+    StoreWrap* wrap = new StoreWrap(store);
+    wrap->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+  }
+
+  // Accepts `vector`, `expires` and payload. Returns false if the object
+  // is already stored.
+  static NAN_METHOD(Put) {
+    StoreWrap* wrap;
+    if (info.Length() != 3 ||
+        !IsVector(info[0]) ||  // vector
+        !info[1]->IsNumber() ||  // expires
+        !node::Buffer::HasInstance(info[2])) {  // data
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    bool added;
+    int error = store_put(
+      wrap->store,
+      reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+      info[1]->IntegerValue(),
+      reinterpret_cast<uint8_t*>(node::Buffer::Data(info[2])),
+      node::Buffer::Length(info[2]),
+      &added);
+    if (error) {
+      return ThrowStoreError(error);
+    }
+    info.GetReturnValue().Set(added);
+  }
+
+  // Return payload as a read-only Buffer pointing into the mapped log,
+  // or null.
+  static NAN_METHOD(Get) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 || !IsVector(info[0])) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    const uint8_t* data;
+    size_t length;
+    int64_t expires;
+    StoreRegion* region;
+    if (!store_get(wrap->store,
+                   reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+                   &data,
+                   &length,
+                   &expires,
+                   &region)) {
+      return info.GetReturnValue().SetNull();
+    }
+    info.GetReturnValue().Set(
+      Nan::NewBuffer(reinterpret_cast<char*>(const_cast<uint8_t*>(data)),
+                     length,
+                     ReleaseRegion,
+                     region).ToLocalChecked());
+  }
+
+  static NAN_METHOD(Contains) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 || !IsVector(info[0])) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    info.GetReturnValue().Set(store_contains(
+      wrap->store, reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0]))));
+  }
+
+  // Return false if there was no such object.
+  static NAN_METHOD(Delete) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 || !IsVector(info[0])) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    bool deleted;
+    int error = store_delete(
+      wrap->store,
+      reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+      &deleted);
+    if (error) {
+      return ThrowStoreError(error);
+    }
+    info.GetReturnValue().Set(deleted);
+  }
+
+  // Accepts current time, returns number of dropped objects.
+  static NAN_METHOD(Prune) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 || !info[0]->IsNumber()) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    size_t pruned = store_prune(wrap->store, info[0]->IntegerValue());
+    info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(pruned)));
+  }
+
+  // Return packed vectors of all objects.
+  static NAN_METHOD(Vectors) {
+    StoreWrap* wrap;
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    std::vector<uint8_t> vectors(store_size(wrap->store) * INV_VECTOR_SIZE);
+    if (!vectors.empty()) {
+      store_vectors(wrap->store, &vectors[0]);
+    }
+    info.GetReturnValue().Set(CopyVector(vectors));
+  }
+
+  // Return packed vectors missing from the store.
+  static NAN_METHOD(Diff) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 ||
+        !node::Buffer::HasInstance(info[0]) ||
+        node::Buffer::Length(info[0]) % INV_VECTOR_SIZE) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    size_t count = node::Buffer::Length(info[0]) / INV_VECTOR_SIZE;
+    std::vector<uint8_t> missing(count * INV_VECTOR_SIZE);
+    if (count) {
+      count = store_diff(
+        wrap->store,
+        reinterpret_cast<uint8_t*>(node::Buffer::Data(info[0])),
+        count,
+        &missing[0]);
+    }
+    missing.resize(count * INV_VECTOR_SIZE);
+    info.GetReturnValue().Set(CopyVector(missing));
+  }
+
+  // Accepts current time.
+  static NAN_METHOD(Compact) {
+    StoreWrap* wrap;
+    if (info.Length() != 1 || !info[0]->IsNumber()) {
+      return Nan::ThrowError("Bad input");
+    }
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    int error = store_compact(wrap->store, info[0]->IntegerValue());
+    if (error) {
+      return ThrowStoreError(error);
+    }
+  }
+
+  static NAN_METHOD(Sync) {
+    StoreWrap* wrap;
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    int error = store_sync(wrap->store);
+    if (error) {
+      return ThrowStoreError(error);
+    }
+  }
+
+  // Payloads returned by `get` stay valid.
+  static NAN_METHOD(Close) {
+    StoreWrap* wrap = Nan::ObjectWrap::Unwrap<StoreWrap>(info.This());
+    if (wrap->store) {
+      store_close(wrap->store);
+      wrap->store = NULL;
+    }
+  }
+
+  static NAN_METHOD(Size) {
+    StoreWrap* wrap;
+    if (!GetStore(info, &wrap)) {
+      return;
+    }
+    double size = static_cast<double>(store_size(wrap->store));
+    info.GetReturnValue().Set(Nan::New<Number>(size));
+  }
+
+  ~StoreWrap() {
+    if (store) {
+      store_close(store);
+    }
+  }
+
+ private:
+  explicit StoreWrap(ObjectStore* store) : store(store) {}
+
+  static bool IsVector(Local<Value> value) {
+    return node::Buffer::HasInstance(value) &&
+           node::Buffer::Length(value) == INV_VECTOR_SIZE;
+  }
+
+  // Throw if the store is closed.
+  static bool GetStore(NAN_METHOD_ARGS_TYPE info, StoreWrap** wrap) {
+    *wrap = Nan::ObjectWrap::Unwrap<StoreWrap>(info.This());
+    if (!(*wrap)->store) {
+      Nan::ThrowError("Store is closed");
+      return false;
+    }
+    return true;
+  }
+
+  ObjectStore* store;
+};
+
+// Compute exact target, see `pow_target`. Accepts `ttl`,
+// `payload_length`, `trials_per_byte` and `extra_bytes`.
+NAN_METHOD(GetTarget) {
+  if (info.Length() != 4 ||
+      !info[0]->IsNumber() ||  // ttl
+      !info[1]->IsNumber() ||  // payload_length
+      !info[2]->IsNumber() ||  // trials_per_byte
+      !info[3]->IsNumber()) {  // extra_bytes
+    return Nan::ThrowError("Bad input");
+  }
+  uint64_t payload_length;
+  uint64_t trials_per_byte;
+  uint64_t extra_bytes;
+  uint64_t target;
+  if (!GetUInt64(info[1], &payload_length) ||
+      !GetUInt64(info[2], &trials_per_byte) ||
+      !GetUInt64(info[3], &extra_bytes) ||
+      pow_target(info[0]->IntegerValue(),
+                 payload_length,
+                 trials_per_byte,
+                 extra_bytes,
+                 &target)) {
+    return Nan::ThrowError("Bad input");
+  }
+  info.GetReturnValue().Set(NewUInt64(target));
+}
+
+NAN_METHOD(SetPoolSize) {
+  if (info.Length() != 1 || !info[0]->IsNumber()) {
+    return Nan::ThrowError("Bad input");
+  }
+  if (pow_set_pool_size(info[0]->Uint32Value())) {
+    return Nan::ThrowError("Bad pool size");
+  }
+}
+
+NAN_METHOD(SetBudget) {
+  if (info.Length() != 1 || !info[0]->IsNumber()) {
+    return Nan::ThrowError("Bad input");
+  }
+  if (pow_set_budget(info[0]->Int32Value())) {
+    return Nan::ThrowError("Bad CPU budget");
+  }
+}
+
+// Accepts `pin`, `physical_only`, `node` and optional CPU list, see
+// `pow_set_affinity`.
+NAN_METHOD(SetAffinity) {
+  if (info.Length() != 4 ||
+      !info[0]->IsBoolean() ||  // pin
+      !info[1]->IsBoolean() ||  // physical_only
+      !info[2]->IsNumber() ||  // node
+      !(info[3]->IsUndefined() || info[3]->IsArray())) {  // cpus
+    return Nan::ThrowError("Bad input");
+  }
+  std::vector<int> cpus;
+  if (info[3]->IsArray()) {
+    Local<v8::Array> list = info[3].As<v8::Array>();
+    for (uint32_t i = 0; i < list->Length() && i < MAX_CPUS; i++) {
+      Local<Value> cpu = Nan::Get(list, i).ToLocalChecked();
+      if (!cpu->IsNumber()) {
+        return Nan::ThrowError("Bad input");
+      }
+      cpus.push_back(cpu->Int32Value());
+    }
+  }
+  PowAffinity affinity;
+  affinity.pin = info[0]->BooleanValue();
+  affinity.physical_only = info[1]->BooleanValue();
+  affinity.node = info[2]->Int32Value();
+  affinity.cpu_count = cpus.size();
+  affinity.cpus = cpus.empty() ? NULL : &cpus[0];
+  if (pow_set_affinity(&affinity)) {
+    return Nan::ThrowError("No matching CPUs");
+  }
+}
+
+NAN_METHOD(GetTopology) {
+  const PowTopology* topology = pow_topology();
+  Local<v8::Array> cpus = Nan::New<v8::Array>(topology->count);
+  for (size_t i = 0; i < topology->count; i++) {
+    const PowCpu& cpu = topology->cpus[i];
+    Local<Object> obj = Nan::New<Object>();
+    Nan::Set(obj, Nan::New<String>("id").ToLocalChecked(),
+      Nan::New<Number>(cpu.id));
+    Nan::Set(obj, Nan::New<String>("package").ToLocalChecked(),
+      Nan::New<Number>(cpu.package));
+    Nan::Set(obj, Nan::New<String>("core").ToLocalChecked(),
+      Nan::New<Number>(cpu.core));
+    Nan::Set(obj, Nan::New<String>("node").ToLocalChecked(),
+      Nan::New<Number>(cpu.node));
+    Nan::Set(obj, Nan::New<String>("thread").ToLocalChecked(),
+      Nan::New<Number>(cpu.thread));
+    Nan::Set(cpus, i, obj);
+  }
+  Local<Object> obj = Nan::New<Object>();
+  Nan::Set(obj, Nan::New<String>("cpus").ToLocalChecked(), cpus);
+  Nan::Set(obj, Nan::New<String>("cores").ToLocalChecked(),
+    Nan::New<Number>(static_cast<double>(topology->cores)));
+  Nan::Set(obj, Nan::New<String>("packages").ToLocalChecked(),
+    Nan::New<Number>(static_cast<double>(topology->packages)));
+  Nan::Set(obj, Nan::New<String>("nodes").ToLocalChecked(),
+    Nan::New<Number>(static_cast<double>(topology->nodes)));
+  Nan::Set(obj, Nan::New<String>("quota").ToLocalChecked(),
+    Nan::New<Number>(topology->quota));
+  info.GetReturnValue().Set(obj);
+}
+
+// Open shared library with UTF-8 path. Returns NULL on failure.
+static void* OpenModule(const char* path) {
+#ifdef _WIN32
+  int size = MultiByteToWideChar(CP_UTF8, 0, path, -1, NULL, 0);
+  if (size <= 0) {
+    return NULL;
+  }
+  std::vector<wchar_t> wide(size);
+  MultiByteToWideChar(CP_UTF8, 0, path, -1, &wide[0], size);
+  return reinterpret_cast<void*>(LoadLibraryW(&wide[0]));
+#else
+  return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+static void* FindSymbol(void* module, const char* name) {
+#ifdef _WIN32
+  return reinterpret_cast<void*>(
+    GetProcAddress(reinterpret_cast<HMODULE>(module), name));
+#else
+  return dlsym(module, name);
+#endif
+}
+
+static void CloseModule(void* module) {
+#ifdef _WIN32
+  FreeLibrary(reinterpret_cast<HMODULE>(module));
+#else
+  dlclose(module);
+#endif
+}
+
+// Load device module (see `PowDeviceProbeFn`) and add its devices to
+// the pool. Returns the number of added devices, zero if module can't
+// be loaded or there are no devices.
+NAN_METHOD(LoadDevices) {
+  if (info.Length() != 1 || !info[0]->IsString()) {
+    return Nan::ThrowError("Bad input");
+  }
+  size_t added = 0;
+  Nan::Utf8String path(info[0]);
+  void* module = OpenModule(*path);
+  if (module) {
+    PowDeviceProbeFn probe =
+      reinterpret_cast<PowDeviceProbeFn>(FindSymbol(module, POW_DEVICE_PROBE));
+    PowDevice devices[MAX_DEVICES];
+    size_t count = 0;
+    if (probe) {
+      count = probe(devices, MAX_DEVICES - pow_get_device_count());
+    }
+    for (size_t i = 0; i < count; i++) {
+      if (pow_add_device(&devices[i]) == RESULT_OK) {
+        added++;
+      }
+    }
+    // Added devices use the module till the exit.
+    if (!added) {
+      CloseModule(module);
+    }
+  }
+  info.GetReturnValue().Set(Nan::New<Number>(static_cast<double>(added)));
+}
+
+// Return the number of POW devices added to the pool.
+NAN_METHOD(GetDeviceCount) {
+  info.GetReturnValue().Set(
+    Nan::New<Number>(static_cast<double>(pow_get_device_count())));
+}
+
+NAN_METHOD(GetPoolSize) {
+  info.GetReturnValue().Set(
+    Nan::New<Number>(static_cast<double>(pow_get_pool_size())));
+}
+
+// Return stats of all pool threads.
+NAN_METHOD(GetStats) {
+  std::vector<PowStats> threads(MAX_POOL_SIZE);
+  threads.resize(pow_thread_stats(&threads[0], threads.size()));
+  // Pool hashrate is the sum of thread hashrates.
+  double trials = 0;
+  double hashrate = 0;
+  for (size_t i = 0; i < threads.size(); i++) {
+    trials += static_cast<double>(threads[i].trials);
+    if (threads[i].elapsed) {
+      hashrate += threads[i].trials * 1e9 / threads[i].elapsed;
+    }
+  }
+  Local<Object> obj = Nan::New<Object>();
+  Nan::Set(obj, Nan::New<String>("trials").ToLocalChecked(),
+    Nan::New<Number>(trials));
+  Nan::Set(obj, Nan::New<String>("hashrate").ToLocalChecked(),
+    Nan::New<Number>(hashrate));
+  SetThreadStats(obj, threads);
+  info.GetReturnValue().Set(obj);
+}
+
+NAN_METHOD(Shutdown) {
+  pow_shutdown();
+}
+
+NAN_MODULE_INIT(InitAll) {
+  Local<ObjectTemplate> tpl = Nan::New<ObjectTemplate>();
+  tpl->SetInternalFieldCount(1);
+  job_template.Reset(tpl);
+
   Nan::Set(target, Nan::New<String>("powAsync").ToLocalChecked(),
     Nan::GetFunction(Nan::New<FunctionTemplate>(PowAsync)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("powBatch").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(PowBatch)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("searchKeys").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(SearchKeys)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("getTarget").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(GetTarget)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("decryptBatch").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(DecryptBatch)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("powCheckBatch").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(PowCheckBatch)).ToLocalChecked());
+  Local<FunctionTemplate> framer_tpl =
+    Nan::New<FunctionTemplate>(FramerWrap::New);
+  framer_tpl->SetClassName(Nan::New<String>("Framer").ToLocalChecked());
+  framer_tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(framer_tpl, "push", FramerWrap::Push);
+  Nan::Set(target, Nan::New<String>("Framer").ToLocalChecked(),
+    Nan::GetFunction(framer_tpl).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("varIntListDecode").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(VarIntListDecode)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("varIntListEncode").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(VarIntListEncode)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("addrFilter").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(AddrFilter)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("initialHashAsync").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(InitialHashAsync)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("verifyBatch").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(VerifySignatures)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("invHashBatch").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(InvHashBatch)).ToLocalChecked());
+  Local<FunctionTemplate> inv_set_tpl =
+    Nan::New<FunctionTemplate>(InvSetWrap::New);
+  inv_set_tpl->SetClassName(Nan::New<String>("InvSet").ToLocalChecked());
+  inv_set_tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(inv_set_tpl, "insert", InvSetWrap::Insert);
+  Nan::SetPrototypeMethod(inv_set_tpl, "contains", InvSetWrap::Contains);
+  Nan::SetPrototypeMethod(inv_set_tpl, "diff", InvSetWrap::Diff);
+  Nan::SetPrototypeMethod(inv_set_tpl, "size", InvSetWrap::Size);
+  Nan::Set(target, Nan::New<String>("InvSet").ToLocalChecked(),
+    Nan::GetFunction(inv_set_tpl).ToLocalChecked());
+  Local<FunctionTemplate> store_tpl =
+    Nan::New<FunctionTemplate>(StoreWrap::New);
+  store_tpl->SetClassName(Nan::New<String>("ObjectStore").ToLocalChecked());
+  store_tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  Nan::SetPrototypeMethod(store_tpl, "put", StoreWrap::Put);
+  Nan::SetPrototypeMethod(store_tpl, "get", StoreWrap::Get);
+  Nan::SetPrototypeMethod(store_tpl, "contains", StoreWrap::Contains);
+  Nan::SetPrototypeMethod(store_tpl, "delete", StoreWrap::Delete);
+  Nan::SetPrototypeMethod(store_tpl, "prune", StoreWrap::Prune);
+  Nan::SetPrototypeMethod(store_tpl, "vectors", StoreWrap::Vectors);
+  Nan::SetPrototypeMethod(store_tpl, "diff", StoreWrap::Diff);
+  Nan::SetPrototypeMethod(store_tpl, "compact", StoreWrap::Compact);
+  Nan::SetPrototypeMethod(store_tpl, "sync", StoreWrap::Sync);
+  Nan::SetPrototypeMethod(store_tpl, "close", StoreWrap::Close);
+  Nan::SetPrototypeMethod(store_tpl, "size", StoreWrap::Size);
+  Nan::Set(target, Nan::New<String>("ObjectStore").ToLocalChecked(),
+    Nan::GetFunction(store_tpl).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("setPoolSize").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(SetPoolSize)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("setAffinity").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(SetAffinity)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("getTopology").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(GetTopology)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("loadDevices").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(LoadDevices)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("getDeviceCount").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(GetDeviceCount)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("getPoolSize").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(GetPoolSize)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("setBudget").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(SetBudget)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("tunePoolSize").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(TunePoolSize)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("getStats").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(GetStats)).ToLocalChecked());
+  Nan::Set(target, Nan::New<String>("shutdown").ToLocalChecked(),
+    Nan::GetFunction(Nan::New<FunctionTemplate>(Shutdown)).ToLocalChecked());
 }
 
 NODE_MODULE(worker, InitAll)
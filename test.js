@@ -101,6 +101,50 @@ describe("Crypto", function() {
     });
   });
 
+  it("should verify signatures in batch", function() {
+    var privateKey = Buffer(32);
+    privateKey.fill(1);
+    var publicKey = bmcrypto.getPublic(privateKey);
+    var msgs = [Buffer("a"), Buffer("b"), Buffer("c")];
+    var sigs = [];
+    function sign(i) {
+      if (i >= msgs.length) {
+        return;
+      }
+      return bmcrypto.sign(privateKey, msgs[i]).then(function(sig) {
+        sigs.push(sig);
+        return sign(i + 1);
+      });
+    }
+    return sign(0).then(function() {
+      var publicKeys = [publicKey, publicKey, publicKey, Buffer("bad")];
+      var checked = [msgs[0], msgs[2], msgs[2], msgs[2]];
+      return bmcrypto.verifyBatch(publicKeys, checked, sigs.concat(sigs[2]));
+    }).then(function(bitmap) {
+      expect(bitmap.toString("hex")).to.equal("05");
+    });
+  });
+
+  if (typeof window === "undefined") {
+    it("should verify signatures while POW is running", function() {
+      var privateKey = Buffer(32);
+      privateKey.fill(1);
+      var publicKey = bmcrypto.getPublic(privateKey);
+      var initialHash = bmcrypto.sha512(Buffer("test"));
+      var powp = POW.doAsync({target: 0, initialHash: initialHash});
+      return bmcrypto.sign(privateKey, Buffer("a")).then(function(sig) {
+        return bmcrypto.verify(publicKey, Buffer("a"), sig);
+      }).then(function() {
+        powp.cancel();
+        return powp.then(function() {
+          throw new Error("Not cancelled");
+        }, function(err) {
+          expect(err).to.be.instanceof(POW.CancelError);
+        });
+      });
+    });
+  }
+
   it("should allow to encrypt and decrypt message", function() {
     var privateKeyA = bmcrypto.getPrivate();
     var publicKeyA = bmcrypto.getPublic(privateKeyA);
@@ -112,6 +156,45 @@ describe("Crypto", function() {
       });
     });
   });
+
+  it("should find the matching key with batch decryption", function() {
+    var privateKeys = [1, 2, 3, 4].map(function() {
+      return bmcrypto.getPrivate();
+    });
+    var publicKey = bmcrypto.getPublic(privateKeys[2]);
+    return bmcrypto.encrypt(publicKey, Buffer("msg to c")).then(function(buf) {
+      return bmcrypto.decryptBatch(privateKeys, buf).then(function(res) {
+        expect(res.index).to.equal(2);
+        expect(res.plaintext.toString()).to.equal("msg to c");
+        var wrongKeys = [privateKeys[0], privateKeys[1], privateKeys[3]];
+        return bmcrypto.decryptBatch(wrongKeys, buf).then(function() {
+          throw new Error("Not rejected");
+        }, function(err) {
+          expect(err.message).to.equal("Failed to decrypt");
+        });
+      });
+    });
+  });
+
+  if (typeof window === "undefined") {
+    it("should decrypt in batch while POW is running", function() {
+      var privateKeys = [bmcrypto.getPrivate(), bmcrypto.getPrivate()];
+      var publicKey = bmcrypto.getPublic(privateKeys[1]);
+      var initialHash = bmcrypto.sha512(Buffer("test"));
+      var powp = POW.doAsync({target: 0, initialHash: initialHash});
+      return bmcrypto.encrypt(publicKey, Buffer("msg")).then(function(buf) {
+        return bmcrypto.decryptBatch(privateKeys, buf);
+      }).then(function(res) {
+        expect(res.index).to.equal(1);
+        powp.cancel();
+        return powp.then(function() {
+          throw new Error("Not cancelled");
+        }, function(err) {
+          expect(err).to.be.instanceof(POW.CancelError);
+        });
+      });
+    });
+  }
 });
 
 describe("Common structures", function() {
@@ -173,6 +256,40 @@ describe("Common structures", function() {
       expect(res).to.not.have.property("message");
     });
 
+    it("should frame messages split between chunks", function() {
+      var payload = Buffer(1000);
+      payload.fill(7);
+      var stream = Buffer.concat([
+        Buffer("junk"),
+        message.encode("ping"),
+        message.encode("data", payload),
+        message.encode("verack", Buffer("ok")),
+      ]);
+      stream[stream.length - 1] ^= 1;  // Corrupt last payload
+      var framer = new message.Framer();
+      var chunks = [stream.slice(0, 10), stream.slice(10, 500),
+                    stream.slice(500)];
+      var pushps = chunks.map(function(chunk) {
+        return framer.push(chunk);
+      });
+      return pushps[0].then(function(res) {
+        expect(res).to.have.length(0);
+        return pushps[1];
+      }).then(function(res) {
+        expect(res).to.have.length(2);
+        expect(res[0].error).to.match(/magic in the middle/i);
+        expect(res[1].message.command).to.equal("ping");
+        expect(res[1].message.payload).to.have.length(0);
+        return pushps[2];
+      }).then(function(res) {
+        expect(res).to.have.length(2);
+        expect(res[0].message.command).to.equal("data");
+        expect(res[0].message.length).to.equal(1024);
+        expect(res[0].message.payload[999]).to.equal(7);
+        expect(res[1].error).to.match(/bad checksum/i);
+      });
+    });
+
     it("should check for max payload length", function() {
       var fn = message.encode.bind(null, "test", Buffer(2000000));
       expect(fn).to.throw(/payload is too big/i);
@@ -386,6 +503,16 @@ describe("Common structures", function() {
       expect(var_int_list.encode([]).toString("hex")).to.equal("00");
       expect(var_int_list.encode([1, 1024, 1125899906842624, 40000, 100000]).toString("hex")).to.equal("0501fd0400ff0004000000000000fd9c40fe000186a0");
     });
+
+    it("should decode into typed array", function() {
+      var res = var_int_list.decodePacked(Buffer("0301fd9c40fe000186a0ff", "hex"));
+      expect(res.list).to.be.an.instanceof(Float64Array);
+      expect(Array.prototype.slice.call(res.list)).to.deep.equal([1, 40000, 100000]);
+      expect(res.length).to.equal(10);
+      expect(res.rest.toString("hex")).to.equal("ff");
+      expect(var_int_list.decodePacked.bind(null, Buffer("02fd0001", "hex"))).to.throw(Error);
+      expect(var_int_list.decodePacked.bind(null, Buffer("ff00000000ffffffff", "hex"))).to.throw(Error);
+    });
   });
 
   // FIXME(Kagami): Add more tests for inet_pton, inet_ntop; add more
@@ -445,6 +572,35 @@ describe("Common structures", function() {
     it("should encode", function() {
       expect(inv_vect.encode("test").toString("hex")).to.equal("faadcaf60afd35dfcdb5e9ea0d0a0531f6338c62187cff37a1efe11f1d41a348");
     });
+
+    it("should encode vectors in batch", function() {
+      var bufs = [Buffer("test"), Buffer("test2"), Buffer("")];
+      var expected = Buffer.concat(bufs.map(inv_vect.encode));
+      var packed = inv_vect.encodeBatch(bufs);
+      expect(packed.toString("hex")).to.equal(expected.toString("hex"));
+      return inv_vect.encodeBatchAsync(bufs).then(function(res) {
+        expect(res.toString("hex")).to.equal(expected.toString("hex"));
+      });
+    });
+
+    it("should find vectors missing from the set", function() {
+      var vect1 = inv_vect.encode(Buffer("test"));
+      var vect2 = inv_vect.encode(Buffer("test2"));
+      var vect3 = inv_vect.encode(Buffer("test3"));
+      var set = new inv_vect.Set();
+      expect(set.add([vect1, vect2, vect1])).to.equal(2);
+      expect(set.add(vect2)).to.equal(0);
+      expect(set.size()).to.equal(2);
+      expect(set.has(vect1)).to.be.true;
+      expect(set.has(vect3)).to.be.false;
+      var payload = inv.encodePayload([vect3, vect1, vect2, vect3]);
+      var decoded = var_int.decode(payload);
+      var missing = set.diff(decoded.rest);
+      expect(missing.toString("hex")).to.equal(
+        Buffer.concat([vect3, vect3]).toString("hex"));
+      expect(inv.decodePayload(inv.encodePayload(missing)).vectors)
+        .to.have.length(2);
+    });
   });
 
   describe("encrypted", function() {
@@ -580,6 +736,21 @@ describe("Message types", function() {
       expect(res.addrs[1].port).to.equal(18444);
     });
 
+    it("should decode packed entries", function() {
+      var payload = addr.encodePayload([
+        {host: "1.2.3.4", port: 8444},
+        {host: "ff::1", port: 18444},
+      ]);
+      // Private entry put by hand since encode filters them.
+      var local = net_addr.encode({host: "127.0.0.1", port: 1});
+      payload = Buffer.concat([Buffer([3]), payload.slice(1), local]);
+      var res = addr.decodePayloadPacked(payload);
+      expect(res.count).to.equal(2);
+      expect(res.entries).to.have.length(76);
+      expect(res.length).to.equal(115);
+      expect(net_addr.decode(res.entries.slice(38)).port).to.equal(18444);
+    });
+
     it("shouldn't encode/decode more than 1000 entires", function() {
       var addrs = new Array(1001);
       var ip = {host: "1.2.3.4"};
@@ -628,6 +799,17 @@ describe("Message types", function() {
       expect(inv.encode.bind(null, Array(60000))).to.throw(/too many/i);
       expect(inv.decodePayload.bind(null, var_int.encode(60000))).to.throw(/too many/i);
     });
+
+    it("should decode packed vectors", function() {
+      var vect1 = inv_vect.encode(Buffer("test"));
+      var vect2 = inv_vect.encode(Buffer("test2"));
+      var payload = Buffer.concat([inv.encodePayload([vect1, vect2]), Buffer("x")]);
+      var res = inv.decodePayloadPacked(payload);
+      expect(res.count).to.equal(2);
+      expect(res.length).to.equal(65);
+      expect(bufferEqual(res.vectors, Buffer.concat([vect1, vect2]))).to.be.true;
+      expect(inv.decodePayloadPacked.bind(null, payload.slice(0, 40))).to.throw(/too small/i);
+    });
   });
 
   describe("getdata", function() {
@@ -1166,12 +1348,141 @@ describe("POW", function() {
     expect(POW.getTarget({ttl: 86400, payloadLength: 636})).to.equal(4863575534951);
   });
 
+  it("should calculate and accept targets above 2^53", function() {
+    var target = POW.getTarget({ttl: -65535, payloadLength: 1});
+    expect(target).to.not.be.a("number");
+    var hex = Buffer.isBuffer(target) ?
+              target.toString("hex") :
+              target.toString(16);
+    expect(hex).to.equal("10c2ad36ed7f999a");
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    return POW.doAsync({target: target, initialHash: initialHash})
+    .then(function(nonce) {
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
+  it("should return nonce as a Buffer", function() {
+    var target = 297422525267;
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    return POW.doAsync({
+      target: target,
+      initialHash: initialHash,
+      nonceType: "buffer",
+    }).then(function(nonce) {
+      expect(Buffer.isBuffer(nonce)).to.be.true;
+      expect(nonce.length).to.equal(8);
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
   it("should check a POW", function() {
     expect(POW.check({nonce: 21997550, target: 297422525267, initialHash: Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex")})).to.be.true;
     expect(POW.check({nonce: 3122437, target: 4864647698763, initialHash: Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex")})).to.be.true;
     expect(POW.check({nonce: 3122436, target: 4864647698763, initialHash: Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex")})).to.be.false;
   });
 
+  it("should do a POW of data passed by chunks", function() {
+    var data = Buffer("chunked object data");
+    var target = 1125899906842624;
+    var chunks = [data.slice(0, 5), data.slice(5, 6), data.slice(6)];
+    return POW.doAsync({data: chunks, target: target}).then(function(nonce) {
+      var nonceBuf = new Buffer(8);
+      nonceBuf.writeUInt32BE(Math.floor(nonce / 4294967296), 0);
+      nonceBuf.writeUInt32BE(nonce % 4294967296, 4);
+      var payload = Buffer.concat([nonceBuf, data]);
+      return POW.checkAsync({payload: payload, target: target});
+    }).then(function(ok) {
+      expect(ok).to.be.true;
+    });
+  });
+
+  it("should reuse cached POW solutions", function() {
+    var cache = new POW.SolutionCache({size: 1});
+    var target = 297422525267;
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var otherHash = bmcrypto.sha512(Buffer("other"));
+    return POW.doAsync({
+      target: target,
+      initialHash: initialHash,
+      cache: cache,
+    }).then(function(nonce) {
+      expect(cache.get(initialHash, target)).to.equal(nonce);
+      expect(cache.get(initialHash, target * 2)).to.equal(nonce);
+      var nonceBuf = cache.get(initialHash, target, "buffer");
+      expect(nonceBuf.readUInt32BE(4)).to.equal(nonce % 4294967296);
+      var powp = POW.doAsync({
+        target: target,
+        initialHash: initialHash,
+        cache: cache,
+      });
+      expect(powp.getStats().trials).to.equal(0);
+      return powp.then(function(cached) {
+        expect(cached).to.equal(nonce);
+        cache.set(otherHash, target, 1);
+        expect(cache.get(otherHash, target)).to.equal(1);
+        expect(cache.get(initialHash, target)).to.be.null;
+      });
+    });
+  });
+
+  if (typeof window === "undefined") {
+    it("should persist cached POW solutions", function() {
+      var path = require("path").join(
+        require("os").tmpdir(),
+        "bitmessage-pow-cache-" + process.pid);
+      var initialHash = bmcrypto.sha512(Buffer("test"));
+      try {
+        var cache = new POW.SolutionCache({size: 2, path: path});
+        cache.set(initialHash, 1000, 10);
+        cache.set(initialHash, 100, 20);
+        cache.set(initialHash, 500, 30);
+        for (var i = 0; i < 5; i++) {
+          cache.set(bmcrypto.sha512(Buffer([i])), 100, i);
+        }
+        cache.set(initialHash, 100, 20);
+        var loaded = new POW.SolutionCache({size: 2, path: path});
+        expect(loaded.get(initialHash, 100)).to.equal(20);
+        expect(loaded.get(bmcrypto.sha512(Buffer([4])), 100)).to.equal(4);
+        expect(loaded.get(bmcrypto.sha512(Buffer([3])), 100)).to.be.null;
+      } finally {
+        require("fs").unlinkSync(path);
+      }
+    });
+  }
+
+  it("should check POWs in batch", function() {
+    var data = Buffer("test");
+    var target = 1125899906842624;
+    return POW.doAsync({data: data, target: target}).then(function(nonce) {
+      var nonceBuf = new Buffer(8);
+      nonceBuf.writeUInt32BE(Math.floor(nonce / 4294967296), 0);
+      nonceBuf.writeUInt32BE(nonce % 4294967296, 4);
+      var payload = Buffer.concat([nonceBuf, data]);
+      var short = new Buffer(4);
+      short.fill(0);
+      expect(POW.check({payload: payload, target: target})).to.be.true;
+      var list = [
+        {payload: payload, target: target},
+        {payload: payload, target: 0},
+        {payload: short, target: target},
+        {payload: payload, target: target},
+      ];
+      expect(POW.checkBatch(list).toString("hex")).to.equal("09");
+      return POW.checkBatchAsync(list).then(function(bitmap) {
+        expect(bitmap.toString("hex")).to.equal("09");
+      });
+    });
+  });
+
   it("should reject promise on bad POW arguments", function(done) {
     POW.doAsync({target: 123, initialHash: {}}).catch(function() {
       POW.doAsync({target: 123, initialHash: Buffer("test")}).catch(function() {
@@ -1183,6 +1494,256 @@ describe("POW", function() {
     });
   });
 
+  it("should allow to change pool size", function() {
+    var target = 9007199254740991;
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    POW.setPoolSize(2);
+    return POW.doAsync({target: target, initialHash: initialHash})
+    .then(function(nonce) {
+      POW.setPoolSize(0);
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
+  it("should detect CPU topology", function() {
+    var topology = POW.getTopology();
+    expect(topology.cores).to.be.at.least(1);
+    expect(topology.cpus.length).to.be.at.least(topology.cores);
+    expect(topology.cpus[0]).to.have.property("node");
+  });
+
+  it("should calibrate POW pool size", function() {
+    this.timeout(10000);
+    var topology = POW.getTopology();
+    return POW.tunePoolSize().then(function(poolSize) {
+      expect(poolSize).to.be.at.least(1);
+      if (topology.quota) {
+        expect(poolSize).to.be.at.most(Math.ceil(topology.quota));
+      }
+      return POW.tunePoolSize();
+    }).then(function(poolSize) {
+      expect(poolSize).to.be.at.most(topology.cpus.length);
+    });
+  });
+
+  it("should allow to pin POW threads", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    POW.setAffinity({physicalOnly: true});
+    return POW.doAsync({target: 9007199254740991, initialHash: initialHash})
+    .then(function(nonce) {
+      expect(nonce).to.be.a("number");
+      POW.setAffinity(false);
+    });
+  });
+
+  it("should limit CPU budget of POW threads", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    POW.setBudget(50);
+    var powp = POW.doAsync({target: 297422525267, initialHash: initialHash});
+    setTimeout(function() {
+      POW.setBudget(100);
+    }, 50);
+    return powp.then(function(nonce) {
+      expect(POW.check({
+        nonce: nonce,
+        target: 297422525267,
+        initialHash: initialHash,
+      })).to.be.true;
+      if (typeof window === "undefined") {
+        expect(function() {
+          POW.setBudget(0);
+        }).to.throw(Error);
+      }
+    });
+  });
+
+  it("should allow to cancel a POW", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var powp = POW.doAsync({target: 0, initialHash: initialHash});
+    setTimeout(function() {
+      powp.cancel();
+    }, 100);
+    return powp.then(function() {
+      throw new Error("Not cancelled");
+    }, function(err) {
+      expect(err).to.be.instanceof(POW.CancelError);
+    });
+  });
+
+  if (typeof window === "undefined") {
+    it("should report POW progress", function(done) {
+      var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+      var powp = POW.doAsync({
+        target: 0,
+        initialHash: initialHash,
+        poolSize: 2,
+        progressInterval: 50,
+        progress: function(stats) {
+          expect(stats.trials).to.be.above(0);
+          expect(stats.elapsed).to.be.above(0);
+          expect(stats.hashrate).to.be.above(0);
+          expect(stats.threads).to.have.length(2);
+          expect(powp.getStats().trials).to.be.at.least(stats.trials);
+          expect(POW.getStats().threads).to.not.be.empty;
+          powp.cancel();
+        },
+      });
+      powp.catch(function(err) {
+        expect(err).to.be.instanceof(POW.CancelError);
+        done();
+      });
+    });
+  }
+
+  if (typeof window === "undefined") {
+    it("should resume a POW from checkpoint", function(done) {
+      var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+      var target = 297422525267;
+      var powp = POW.doAsync({target: 0, initialHash: initialHash});
+      setTimeout(function() {
+        var checkpoint = powp.checkpoint();
+        powp.cancel();
+        expect(Buffer.isBuffer(checkpoint)).to.be.true;
+        expect((checkpoint.length - 8) % 16).to.equal(0);
+        expect(checkpoint.readUInt32BE(4)).to.be.above(0);
+        powp.catch(function(err) {
+          expect(err).to.be.instanceof(POW.CancelError);
+          return POW.doAsync({
+            target: target,
+            initialHash: initialHash,
+            checkpoint: checkpoint,
+          });
+        }).then(function(nonce) {
+          expect(POW.check({
+            nonce: nonce,
+            target: target,
+            initialHash: initialHash,
+          })).to.be.true;
+          done();
+        }).catch(done);
+      }, 100);
+    });
+  }
+
+  it("should search only the given nonce range", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    return POW.doAsync({
+      target: 0,
+      initialHash: initialHash,
+      start: 100,
+      end: 5000,
+      stride: 3,
+    }).then(function() {
+      throw new Error("Solved");
+    }, function(err) {
+      expect(err.message).to.match(/exhausted/);
+    });
+  });
+
+  it("should split a POW between several workers", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var target = 297422525267;
+    var jobs = [];
+    function transport(job) {
+      jobs.push(job);
+      return POW.localTransport(job);
+    }
+    return POW.doDistributedAsync({
+      target: target,
+      initialHash: initialHash,
+      poolSize: 1,
+    }, [transport, transport, transport]).then(function(nonce) {
+      expect(jobs).to.have.length(3);
+      expect(jobs[2].start).to.equal(2);
+      expect(jobs[2].stride).to.equal(3);
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
+  it("should fall back to JS POW without WebAssembly kernel", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var target = 297422525267;
+    POW.setWasm(null);
+    return POW.doAsync({
+      target: target,
+      initialHash: initialHash,
+    }).then(function(nonce) {
+      POW.setWasm();
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
+  it("should solve a POW on GPU backend", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var target = 297422525267;
+    // Falls back to CPU if there are no devices.
+    expect(POW.getDeviceCount()).to.be.at.least(0);
+    return POW.doAsync({
+      target: target,
+      initialHash: initialHash,
+      backend: "gpu",
+    }).then(function(nonce) {
+      expect(POW.check({
+        nonce: nonce,
+        target: target,
+        initialHash: initialHash,
+      })).to.be.true;
+    });
+  });
+
+  it("should run POWs with higher priority first", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var lowp = POW.doAsync({target: 0, initialHash: initialHash});
+    var lowDone = false;
+    lowp.catch(function() {
+      lowDone = true;
+    });
+    return POW.doAsync({
+      target: 9007199254740991,
+      initialHash: initialHash,
+      priority: 1,
+      deadline: new Date(),
+    }).then(function(nonce) {
+      expect(nonce).to.be.a("number");
+      expect(lowDone).to.be.false;
+      lowp.cancel();
+    });
+  });
+
+  it("should do a batch of POWs", function() {
+    var initialHash = Buffer("8ff2d685db89a0af2e3dbfd3f700ae96ef4d9a1eac72fd778bbb368c7510cddda349e03207e1c4965bd95c6f7265e8f1a481a08afab3874eaafb9ade09a10880", "hex");
+    var powps = POW.doBatchAsync([
+      {target: 9007199254740991, initialHash: initialHash},
+      {target: 0, initialHash: initialHash},
+      {target: 9007199254740991, data: Buffer("test")},
+    ]);
+    expect(powps).to.have.length(3);
+    powps[1].cancel();
+    return powps[0].then(function(nonce) {
+      expect(nonce).to.be.a("number");
+      return powps[1];
+    }).then(function() {
+      throw new Error("Not cancelled");
+    }, function(err) {
+      expect(err).to.be.instanceof(POW.CancelError);
+      return powps[2];
+    }).then(function(nonce) {
+      expect(nonce).to.be.a("number");
+    });
+  });
+
   if (allTests) {
     it("should do a POW", function() {
       this.timeout(300000);
@@ -1208,6 +1769,70 @@ describe("POW", function() {
   }
 });
 
+if (typeof window === "undefined") {
+  describe("Object store", function() {
+    var ObjectStore = require("./lib/store").ObjectStore;
+
+    function makeObject(expires, data) {
+      var payload = new Buffer(16 + data.length);
+      payload.fill(0, 0, 12);
+      payload.writeUInt32BE(expires, 12);
+      Buffer(data).copy(payload, 16);
+      return payload;
+    }
+
+    it("should persist, prune and compact objects", function() {
+      var path = require("path").join(
+        require("os").tmpdir(),
+        "bitmessage-store-" + process.pid);
+      var obj1 = makeObject(1000, "test");
+      var obj2 = makeObject(2000, "test2");
+      var obj3 = makeObject(3000, "test3");
+      var store;
+      try {
+        store = new ObjectStore(path, 500);
+        var vect1 = store.add(obj1);
+        var vect2 = store.add(obj2);
+        var vect3 = store.add(obj3);
+        expect(store.add(obj1).toString("hex")).to.equal(
+          inv_vect.encode(obj1).toString("hex"));
+        expect(store.size()).to.equal(3);
+        expect(store.remove(vect3)).to.be.true;
+        expect(store.remove(vect3)).to.be.false;
+        expect(store.get(vect2).toString("hex")).to.equal(
+          obj2.toString("hex"));
+        store.close();
+
+        store = new ObjectStore(path, 500);
+        expect(store.size()).to.equal(2);
+        expect(store.has(vect3)).to.be.false;
+        var view = store.get(vect1);
+        expect(view.toString("hex")).to.equal(obj1.toString("hex"));
+        expect(store.diff([vect3, vect1, vect2]).toString("hex")).to.equal(
+          vect3.toString("hex"));
+        expect(store.prune(1500)).to.equal(1);
+        expect(store.get(vect1)).to.be.null;
+        expect(store.vectors().toString("hex")).to.equal(
+          vect2.toString("hex"));
+        store.compact(1500);
+        expect(view.toString("hex")).to.equal(obj1.toString("hex"));
+        store.close();
+        expect(function() {
+          store.size();
+        }).to.throw(Error);
+
+        store = new ObjectStore(path, 2500);
+        expect(store.size()).to.equal(0);
+      } finally {
+        if (store) {
+          store.close();
+        }
+        require("fs").unlinkSync(path);
+      }
+    });
+  });
+}
+
 describe("High-level classes", function() {
   // FIXME(Kagami): Add more fail tests.
   describe("Address", function() {
@@ -1257,6 +1882,39 @@ describe("High-level classes", function() {
       expect(addr.encode()).to.equal("BM-2cWFkyuXXFw6d393RGnin2RpSXj8wxtt6F");
     });
 
+    it("should create address from passphrase asynchronously", function() {
+      this.timeout(60000);
+      return Address.fromPassphraseAsync("test").then(function(addr) {
+        expect(addr.version).to.equal(4);
+        expect(bufferEqual(addr.signPrivateKey, WIF.decode("5JY1CFeeyN4eyfL35guWAuUqu5VLmd7LojtkNP6wmt5msZxxZ57"))).to.be.true;
+        expect(bufferEqual(addr.encPrivateKey, WIF.decode("5J1oDgZDicNhUgbfzBDQqi2m5jUPnDrfZinnTqEEEaLv63jVFTM"))).to.be.true;
+        expect(addr.encode()).to.equal("BM-2cWFkyuXXFw6d393RGnin2RpSXj8wxtt6F");
+      });
+    });
+
+    it("should create random address asynchronously", function() {
+      this.timeout(60000);
+      return Address.fromRandomAsync({poolSize: 2}).then(function(addr) {
+        expect(addr.version).to.equal(4);
+        expect(addr.signPrivateKey.length).to.equal(32);
+        expect(addr.encPrivateKey.length).to.equal(32);
+        expect(addr.ripe[0]).to.equal(0);
+      });
+    });
+
+    if (typeof window === "undefined") {
+      it("should allow to cancel address generation", function() {
+        this.timeout(60000);
+        var addrp = Address.fromRandomAsync({ripeLength: 4, poolSize: 1});
+        addrp.cancel();
+        return addrp.then(function() {
+          throw new Error("Not cancelled");
+        }, function(err) {
+          expect(err.name).to.equal("PowCancelError");
+        });
+      });
+    }
+
     it("should accept string in Address.fromPassphrase", function() {
       this.timeout(60000);
       var addr = Address.fromPassphrase("test");